@@ -0,0 +1,66 @@
+#include "../include/vamana.h"
+
+// Build time of VamanaIndexingAlgorithm over the whole dummy dataset with 1, 4, 16 and 64 threads,
+// and the recall of the unfiltered queries on each graph.
+int main() {
+    const int k = 100;
+    const int L = 120;
+    const int R = 60;
+    const float a = 1.2;
+
+    ifstream data_file("datasets/dummy-data.bin");
+    if (!data_file.good()) {
+        cerr << "datasets/dummy-data.bin not found, run the benchmark from the project root" << endl;
+        return 1;
+    }
+
+    VectorStore store;
+    vector<float> label_values;
+    vector<Node*> nodes = ReadNodes("datasets/dummy-data.bin", store, label_values);
+
+    VectorStore query_store;
+    vector<Query> queries = ReadQueries("datasets/dummy-queries.bin", query_store, label_values);
+
+    vector<vector<float>> groundtruth = ReadGroundTruth("datasets/dummy-groundtruth.bin");
+
+    cout << endl << "hardware threads: " << thread::hardware_concurrency() << ", L: " << L << ", R: " << R << endl << endl;
+    cout << "threads\tbuild s\tspeedup\trecall" << endl;
+
+    double sequential = 0.0;
+    for (unsigned int threads : {1, 4, 16, 64}) {
+        DirectedGraph graph(store.count, R);
+
+        auto start = chrono::high_resolution_clock::now();
+        VamanaIndexingAlgorithm(store, graph, nodes, k, L, R, a, nodes.size(), 1, 1000, threads);
+        auto end = chrono::high_resolution_clock::now();
+
+        double seconds = chrono::duration<double>(end - start).count();
+        if (threads == 1) {
+            sequential = seconds;
+        }
+
+        // Recall of the unfiltered queries, searched from the same node on every graph
+        double recall = 0.0;
+        int count = 0;
+        for (size_t i = 0; i < queries.size(); i++) {
+            if (queries[i].type != 0) {
+                continue;
+            }
+
+            vector<unsigned int> result = GreedySearch(store, graph, 0, query_store.row(queries[i].id), k, L);
+            size_t expected = min<size_t>(k, groundtruth[i].size());
+            unordered_set<unsigned int> truth(groundtruth[i].begin(), groundtruth[i].begin() + expected);
+            size_t found = count_if(result.begin(), result.end(), [&](unsigned int id) { return truth.count(id) > 0; });
+            recall += expected == 0 ? 1.0 : static_cast<double>(found) / expected;
+            count++;
+        }
+
+        cout << threads << "\t" << seconds << "\t" << sequential / seconds << "x\t" << recall / count << endl;
+    }
+
+    for (Node* node : nodes) {
+        delete node;
+    }
+
+    return 0;
+}
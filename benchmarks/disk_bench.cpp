@@ -0,0 +1,100 @@
+#include "../include/vamana.h"
+
+#include <fcntl.h>
+
+// Latency and reads of DiskSearch on the unfiltered dummy queries, for beams of 1 to 8 nodes per hop,
+// with the reads of a hop issued in turn or over 4 threads. Cold runs drop the pages of the index
+// from the page cache before every query, so every read goes to the disk; warm runs read from the cache.
+int main() {
+    const unsigned int k = 100;
+    const unsigned int L = 120;
+    const int R = 60;
+    const string index_path = "disk_bench.bin";
+
+    ifstream data_file("datasets/dummy-data.bin");
+    if (!data_file.good()) {
+        cerr << "datasets/dummy-data.bin not found, run the benchmark from the project root" << endl;
+        return 1;
+    }
+
+    VectorStore store;
+    vector<float> label_values;
+    vector<Node*> nodes = ReadNodes("datasets/dummy-data.bin", store, label_values);
+
+    VectorStore query_store;
+    vector<Query> queries = ReadQueries("datasets/dummy-queries.bin", query_store, label_values);
+
+    vector<vector<float>> groundtruth = ReadGroundTruth("datasets/dummy-groundtruth.bin");
+
+    // The graph is built in memory as usual, then written out with 32-byte PQ codes
+    srand(42);
+    DirectedGraph graph(store.count, R);
+    VamanaIndexingAlgorithm(store, graph, nodes, k, L, R, 1.2, nodes.size(), 2);
+    ProductQuantizer pq(store, nodes, 32, nodes.size(), 42);
+    SaveDiskIndex(index_path, store, graph, pq, datasetMedoid(store, nodes), diverseEntryPoints(store, nodes, ENTRY_POINTS, 42));
+
+    DiskIndex index, threaded;
+    if (!OpenDiskIndex(index_path, index) || !OpenDiskIndex(index_path, threaded, 4)) {
+        return 1;
+    }
+
+    cout << "k: " << k << ", L: " << L << ", R: " << R << ", record bytes: " << index.node_bytes
+         << ", nodes per sector: " << index.nodes_per_sector << ", memory per node: " << pq.subspaces << " bytes" << endl << endl;
+    cout << "beam\tio\tcache\tqueries\treads\thops\tmean us\tp50 us\tp90 us\tp99 us\trecall\tr@10" << endl;
+
+    SearchScratch scratch;
+    for (unsigned int beam_width : {1, 2, 4, 8}) {
+        for (unsigned int io_threads : {0, 4}) {
+            if (io_threads > 0 && beam_width == 1) {
+                continue;  // a hop of one read has nothing to spread
+            }
+            const DiskIndex& disk = io_threads > 0 ? threaded : index;
+
+            for (bool cold : {true, false}) {
+                vector<double> latencies;
+                double recall = 0.0, recall10 = 0.0, reads = 0.0, hops = 0.0;
+
+                for (size_t i = 0; i < queries.size(); i++) {
+                    if (queries[i].type != 0) {
+                        continue;
+                    }
+                    if (cold) {
+                        posix_fadvise(disk.fd, 0, 0, POSIX_FADV_DONTNEED);
+                    }
+                    const float* x_q = query_store.row(queries[i].id);
+
+                    auto start = chrono::high_resolution_clock::now();
+                    vector<unsigned int> result = DiskSearch(disk, x_q, k, L, beam_width, scratch);
+                    auto end = chrono::high_resolution_clock::now();
+                    latencies.push_back(chrono::duration<double, micro>(end - start).count());
+                    reads += scratch.reads;
+                    hops += scratch.hops;
+
+                    size_t expected = min<size_t>(k, groundtruth[i].size());
+                    unordered_set<unsigned int> truth(groundtruth[i].begin(), groundtruth[i].begin() + expected);
+                    size_t found = count_if(result.begin(), result.end(), [&](unsigned int id) { return truth.count(id) > 0; });
+                    recall += expected == 0 ? 1.0 : static_cast<double>(found) / expected;
+
+                    size_t expected10 = min<size_t>(10, groundtruth[i].size());
+                    unordered_set<unsigned int> truth10(groundtruth[i].begin(), groundtruth[i].begin() + expected10);
+                    size_t found10 = count_if(result.begin(), result.begin() + min<size_t>(10, result.size()), [&](unsigned int id) { return truth10.count(id) > 0; });
+                    recall10 += expected10 == 0 ? 1.0 : static_cast<double>(found10) / expected10;
+                }
+
+                sort(latencies.begin(), latencies.end());
+                size_t n = latencies.size();
+                double mean = accumulate(latencies.begin(), latencies.end(), 0.0) / n;
+                cout << beam_width << "\t" << io_threads << "\t" << (cold ? "cold" : "warm") << "\t" << n << "\t" << reads / n << "\t" << hops / n << "\t"
+                     << mean << "\t" << latencies[n / 2] << "\t" << latencies[n * 9 / 10] << "\t" << latencies[n * 99 / 100] << "\t"
+                     << recall / n << "\t" << recall10 / n << endl;
+            }
+        }
+    }
+
+    remove(index_path.c_str());
+    for (Node* node : nodes) {
+        delete node;
+    }
+
+    return 0;
+}
@@ -0,0 +1,66 @@
+#include "../include/vamana.h"
+
+// Microbenchmark of the distance kernels: one query against every row of a store,
+// the same access pattern as a brute force scan.
+int main() {
+    const size_t num_vectors = 1000;
+    const int repeats = 200;
+
+    mt19937 gen(42);
+    uniform_real_distribution<float> dist(-100.0, 100.0);
+
+    cout << "Dispatched kernel: " << distanceKernelName(bestDistanceKernel()) << endl << endl;
+    cout << "dim\tkernel\t\tns/distance\tspeedup" << endl;
+
+    for (size_t dim : {96, 100, 128, 768}) {
+        VectorStore store(num_vectors, dim);
+        for (size_t i = 0; i < num_vectors; i++) {
+            for (size_t d = 0; d < dim; d++) {
+                store.row(i)[d] = dist(gen);
+            }
+        }
+        vector<float> query(dim);
+        for (float& x : query) {
+            x = dist(gen);
+        }
+
+        double scalar_ns = 0.0;
+        auto run = [&](DistanceFunction f, const string& name) {
+            volatile float sink = 0.0;
+            auto start = chrono::high_resolution_clock::now();
+            for (int r = 0; r < repeats; r++) {
+                float sum = 0.0;
+                for (size_t i = 0; i < num_vectors; i++) {
+                    sum += f(store.row(i), query.data(), dim);
+                }
+                sink = sink + sum;
+            }
+            auto end = chrono::high_resolution_clock::now();
+
+            double ns = chrono::duration<double, nano>(end - start).count() / (num_vectors * repeats);
+            if (scalar_ns == 0.0) {
+                scalar_ns = ns;
+            }
+
+            cout << dim << "\t" << name << "\t" << (name.size() < 8 ? "\t" : "")
+                 << ns << "\t\t" << scalar_ns / ns << "x" << endl;
+        };
+
+        for (DistanceKernel kernel : {KERNEL_SCALAR, KERNEL_SSE, KERNEL_AVX2, KERNEL_AVX512}) {
+            DistanceFunction f = distanceKernel(kernel);
+            if (f) {
+                run(f, distanceKernelName(kernel));
+            }
+        }
+
+        // The kernels unrolled for this dimension
+        for (DistanceKernel kernel : {KERNEL_AVX2, KERNEL_AVX512}) {
+            DistanceFunction f = distanceKernel(kernel, dim);
+            if (f && f != distanceKernel(kernel)) {
+                run(f, string(distanceKernelName(kernel)) + "/" + to_string(dim));
+            }
+        }
+    }
+
+    return 0;
+}
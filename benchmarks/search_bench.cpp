@@ -0,0 +1,180 @@
+#include "../include/vamana.h"
+
+// Fraction of the first `k` neighbors of the ground truth that are in the first `k` ids of the result
+static double recallAt(const vector<unsigned int>& result, const vector<float>& groundtruth, size_t k) {
+    size_t expected = min<size_t>(k, groundtruth.size());
+    unordered_set<unsigned int> truth(groundtruth.begin(), groundtruth.begin() + expected);
+    size_t found = count_if(result.begin(), result.begin() + min<size_t>(k, result.size()), [&](unsigned int id) { return truth.count(id) > 0; });
+    return expected == 0 ? 1.0 : static_cast<double>(found) / expected;
+}
+
+// Query latency of GreedySearch and FilteredGreedySearch on the dummy dataset,
+// over a stitched graph built the same way as main does it. The unfiltered searches
+// also report the nodes they expand (hops) and the distances they compute per query.
+int main() {
+    const unsigned int k = 100;
+    const unsigned int L = 120;
+    const int R = 60;
+
+    ifstream data_file("datasets/dummy-data.bin");
+    if (!data_file.good()) {
+        cerr << "datasets/dummy-data.bin not found, run the benchmark from the project root" << endl;
+        return 1;
+    }
+
+    VectorStore store;
+    vector<float> label_values;
+    vector<Node*> nodes = ReadNodes("datasets/dummy-data.bin", store, label_values);
+
+    VectorStore query_store;
+    vector<Query> queries = ReadQueries("datasets/dummy-queries.bin", query_store, label_values);
+
+    vector<vector<float>> groundtruth = ReadGroundTruth("datasets/dummy-groundtruth.bin");
+
+    srand(42);
+    DirectedGraph graph = StitchedVamana(store, nodes, 1.2, 80, 40, R);
+
+    // Filtered queries start from the medoid of their label, as in main
+    LabelIndex labels(nodes);
+    vector<vector<unsigned int>> label_starts;
+    const vector<unsigned int> no_starts;
+    for (unsigned int medoid : findmedoid(labels, 100)) {
+        label_starts.push_back({medoid});
+    }
+
+    // The stitched graph only links nodes of the same label, so the unfiltered queries walk a
+    // Vamana graph over the whole dataset instead. They start from node 0, from a random node
+    // or from the entry points closest to them.
+    auto build_start = chrono::high_resolution_clock::now();
+    DirectedGraph full(store.count, R);
+    VamanaIndexingAlgorithm(store, full, nodes, k, L, R, 1.2, nodes.size(), 2);
+    double full_build = chrono::duration<double>(chrono::high_resolution_clock::now() - build_start).count();
+    vector<unsigned int> entry_points = diverseEntryPoints(store, nodes, ENTRY_POINTS, 42);
+    SearchScratch scratch;
+
+    // The same two searches on product quantized codes of 16 and 32 bytes
+    ProductQuantizer pq16(store, nodes, 16, nodes.size(), 42);
+    ProductQuantizer pq32(store, nodes, 32, nodes.size(), 42);
+
+    // And on SQ8 and FP16 rows, each with a Vamana graph built on its own distances. The
+    // unfiltered searches run with and without the exact re-rank of the search list.
+    ScalarQuantizedStore sq8(store, PRECISION_SQ8), fp16(store, PRECISION_FP16);
+    unsigned int medoid = datasetMedoid(store, nodes);
+    DirectedGraph full_sq8(store.count, R), full_fp16(store.count, R);
+    build_start = chrono::high_resolution_clock::now();
+    VamanaIndexingAlgorithm(sq8, full_sq8, nodes, L, R, 1.2, medoid);
+    double sq8_build = chrono::duration<double>(chrono::high_resolution_clock::now() - build_start).count();
+    build_start = chrono::high_resolution_clock::now();
+    VamanaIndexingAlgorithm(fp16, full_fp16, nodes, L, R, 1.2, medoid);
+    double fp16_build = chrono::duration<double>(chrono::high_resolution_clock::now() - build_start).count();
+
+    cout << "k: " << k << ", L: " << L << ", R: " << R << ", entry points: " << entry_points.size() << endl;
+    cout << "bytes per vector: " << store.dim * sizeof(float) << ", pq " << pq16.subspaces << " and " << pq32.subspaces
+         << ", sq8 " << sq8.dim << ", fp16 " << fp16.dim * sizeof(uint16_t) << endl;
+    cout << "build s: fp32 " << full_build << ", sq8 " << sq8_build << ", fp16 " << fp16_build << endl << endl;
+    cout << "search\t\tqueries\tmean us\tp99 us\thops\tdists\trecall\tr@10" << endl;
+
+    const char* names[] = {"greedy\t", "greedy random", "greedy entry", "filtered", "pq16 greedy", "pq16 filtered", "pq32 greedy", "pq32 filtered",
+                           "sq8 greedy", "sq8 rerank", "sq8 filtered", "fp16 greedy", "fp16 rerank", "fp16 filtered"};
+    for (int mode = 0; mode < 14; mode++) {
+        int type = mode == 3 || mode == 5 || mode == 7 || mode == 10 || mode == 13 ? 1 : 0;
+        const ProductQuantizer& pq = mode < 6 ? pq16 : pq32;
+        const ScalarQuantizedStore& codes = mode < 11 ? sq8 : fp16;
+        const DirectedGraph& codes_graph = mode < 11 ? full_sq8 : full_fp16;
+        bool rerank = mode == 9 || mode == 12;
+        vector<double> latencies;
+        double recall = 0.0, recall10 = 0.0, hops = 0.0, distances = 0.0;
+
+        for (size_t i = 0; i < queries.size(); i++) {
+            const Query& query = queries[i];
+            if (query.type != type) {
+                continue;
+            }
+            const float* x_q = query_store.row(query.id);
+            unsigned int random_start = rand() % nodes.size();
+            const vector<unsigned int>& start_nodes = query.label < label_starts.size() ? label_starts[query.label] : no_starts;
+
+            auto start = chrono::high_resolution_clock::now();
+            vector<unsigned int> result;
+            if (mode == 0) {
+                result = GreedySearch(store, full, 0, x_q, k, L, scratch);
+            } else if (mode == 1) {
+                result = GreedySearch(store, full, random_start, x_q, k, L, scratch);
+            } else if (mode == 2) {
+                // The scan of the entry points is part of the query, so its distances are counted too
+                result = GreedySearch(store, full, closestEntryPoints(store, entry_points, x_q, ENTRY_SEEDS), x_q, k, L, scratch);
+                scratch.distances += entry_points.size();
+            } else if (mode == 3) {
+                result = FilteredGreedySearch(store, graph, labels, start_nodes, x_q, k, L, query.label, scratch);
+            } else if (mode >= 8 && type == 0) {
+                result = GreedySearch(codes, codes_graph, closestEntryPoints(store, entry_points, x_q, ENTRY_SEEDS), x_q, k, L, scratch, rerank ? &store : nullptr);
+            } else if (mode >= 8) {
+                result = FilteredGreedySearch(codes, graph, labels, start_nodes, x_q, k, L, query.label, scratch, &store);
+            } else if (type == 0) {
+                result = GreedySearch(store, pq, full, closestEntryPoints(store, entry_points, x_q, ENTRY_SEEDS), x_q, k, L, scratch);
+            } else {
+                result = FilteredGreedySearch(store, pq, graph, labels, start_nodes, x_q, k, L, query.label, scratch);
+            }
+            auto end = chrono::high_resolution_clock::now();
+            latencies.push_back(chrono::duration<double, micro>(end - start).count());
+            hops += scratch.hops;
+            distances += scratch.distances;
+
+            // Recall against the ground truth, which can have fewer than k neighbors
+            recall += recallAt(result, groundtruth[i], k);
+            recall10 += recallAt(result, groundtruth[i], 10);
+        }
+
+        if (latencies.empty()) {
+            continue;
+        }
+
+        sort(latencies.begin(), latencies.end());
+        double mean = accumulate(latencies.begin(), latencies.end(), 0.0) / latencies.size();
+        double p99 = latencies[latencies.size() * 99 / 100];
+
+        // FilteredGreedySearch does not count its hops, on the codes dists are the distances of the walk
+        // without the exact distances of the re-rank
+        cout << names[mode] << "\t" << latencies.size() << "\t" << mean << "\t" << p99 << "\t";
+        if (type == 1) {
+            cout << "-\t-";
+        } else {
+            cout << hops / latencies.size() << "\t" << distances / latencies.size();
+        }
+        cout << "\t" << recall / latencies.size() << "\t" << recall10 / latencies.size() << endl;
+    }
+
+    // The unfiltered queries from the entry points, expanding 1 to 8 nodes per hop. Hops are
+    // the rounds of the walk, dists the distances it computes.
+    cout << endl << "beam\tqueries\tmean us\tp99 us\thops\tdists\trecall\tr@10" << endl;
+    for (unsigned int beam_width : {1, 2, 4, 8}) {
+        vector<double> latencies;
+        double recall = 0.0, recall10 = 0.0, hops = 0.0, distances = 0.0;
+        for (size_t i = 0; i < queries.size(); i++) {
+            if (queries[i].type != 0) {
+                continue;
+            }
+            const float* x_q = query_store.row(queries[i].id);
+
+            auto start = chrono::high_resolution_clock::now();
+            vector<unsigned int> result = GreedySearch(store, full, closestEntryPoints(store, entry_points, x_q, ENTRY_SEEDS), x_q, k, L, scratch, beam_width);
+            auto end = chrono::high_resolution_clock::now();
+            latencies.push_back(chrono::duration<double, micro>(end - start).count());
+            hops += scratch.hops;
+            distances += scratch.distances;
+            recall += recallAt(result, groundtruth[i], k);
+            recall10 += recallAt(result, groundtruth[i], 10);
+        }
+
+        sort(latencies.begin(), latencies.end());
+        size_t n = latencies.size();
+        cout << beam_width << "\t" << n << "\t" << accumulate(latencies.begin(), latencies.end(), 0.0) / n << "\t" << latencies[n * 99 / 100] << "\t"
+             << hops / n << "\t" << distances / n << "\t" << recall / n << "\t" << recall10 / n << endl;
+    }
+
+    for (Node* node : nodes) {
+        delete node;
+    }
+
+    return 0;
+}
@@ -1,177 +1,35 @@
-#include <iostream>
-#include <vector>
-#include <cmath>
-#include <algorithm>
-#include <fstream>
-#include <cassert>
-
-using namespace std;
-
-
-struct Node {
-    unsigned int id;
-    float distance;
-    vector<float> coords;
-    vector<Node*> out_neighbors; 
-    float filter;
-};
-
-/// @brief Reading binary data vectors. Raw data store as a (N x dim)
-/// @param file_path file path of binary data
-/// @param data returned 2D data vectors
-vector<vector<float>> ReadBin(const string &file_path, const int num_dimensions) {
-    cout << "Reading Data: " << file_path << endl;
-    ifstream ifs;
-    ifs.open(file_path, ios::binary);
-    assert(ifs.is_open());
-    uint32_t N;  // num of points
-    ifs.read((char *)&N, sizeof(uint32_t));
-    std::vector<std::vector<float>> data(N);
-    cout << "# of points: " << N << endl;
-    vector<float> buff(num_dimensions);
-    int counter = 0;
-    while (ifs.read((char *)buff.data(), num_dimensions * sizeof(float))) {
-        vector<float> row(num_dimensions);
-        for (int d = 0; d < num_dimensions; d++) {
-            row[d] = static_cast<float>(buff[d]);
-        }
-        data[counter++] = move(row);
-    }
-    ifs.close();
-    cout << "Finish Reading Data" << endl;
-
-    return data;
-}
-
-/// @brief Save the vector of nodes (created by createVectorFromNodes) to a binary file
-/// @param vectors The 2D vector containing nodes (each row representing a node)
-/// @param file_path The path to the binary file
-void SaveVectorToBinary(const vector<vector<float>>& vectors, const string& file_path) {
-    ofstream ofs(file_path, ios::binary);
-    assert(ofs.is_open());
-
-    uint32_t N = vectors.size();
-    ofs.write(reinterpret_cast<const char*>(&N), sizeof(uint32_t));  // Write number of points
-
-    // Write the actual data for each vector
-    for (const vector<float>& node : vectors) {
-        size_t num_dimensions = node.size();  // Get the number of dimensions for this particular vector
-        ofs.write(reinterpret_cast<const char*>(&num_dimensions), sizeof(size_t));  // Write number of dimensions for this vector
-
-        // Write the values of this vector
-        for (float value : node) {
-            ofs.write(reinterpret_cast<const char*>(&value), sizeof(float));
-        }
-    }
-
-    ofs.close();
-    cout << "Vector saved to " << file_path << endl;
-}
-
-
-
-vector<Node*> createNodesFromVectors(const vector<vector<float>>& vectors) {
-    vector<Node*> nodes;
-
-    for (size_t i = 0; i < vectors.size(); ++i) {
-        Node* newNode = new Node;
-        newNode->id = i;  // Use index as the ID
-        newNode->filter = vectors[i].at(0);
-        newNode->coords.assign(vectors[i].begin() + 2, vectors[i].end());  // Copy coordinates into the Node
-        nodes.push_back(newNode);  // Add the Node to the list
-    }
-
-    return nodes;
-}
-
-vector<Node*> createQueriesFromVectors(const vector<vector<float>>& vectors) {
-    vector<Node*> nodes;
-
-    for (size_t i = 0; i < vectors.size(); ++i) {
-        Node* newNode = new Node;
-        newNode->id = i;  // Use index as the ID
-        newNode->distance = vectors[i].at(0);
-        if (newNode->distance == 2 || newNode->distance == 3) {
-            delete newNode;
-            continue;
-        } 
-        newNode->filter = vectors[i].at(1);
-        newNode->coords.assign(vectors[i].begin() + 4, vectors[i].end());  // Copy coordinates into the Node
-        nodes.push_back(newNode);  // Add the Node to the list
-    }
-
-    return nodes;
-}
-
-// This is the euklideian method to calculate the distance of 2 nodes
-float euclidean(const Node* a, const Node* b) {
-    float sum = 0.0;
-    for (size_t i = 0; i < a->coords.size(); ++i) {
-        float diff = a->coords[i] - b->coords[i];
-        sum += diff * diff;
-    }
-    return sqrt(sum);
-}
-
-// Compare function for 2 nodes based to their distance to another common node
-bool compare_distance(Node* node1, Node* node2) {
-    if (node1->distance == node2->distance) {
-        return node1->id < node2->id; // Secondary criterion: sort by ID
-    }
-    return node1->distance < node2->distance;
-}
-
-
-vector<vector<float>> brute_force(vector<Node*>& nodes, vector<Node*>& queries) {
-    vector<vector<float>> groundtruth(5012);
-    int i = 0;
-
-    for (Node* query : queries) {
-        if (query->distance == 0) {
-            for (Node* node : nodes) {
-                node->distance = euclidean(query, node);
-            }
+#include "../include/vamana.h"
 
-            sort(nodes.begin(), nodes.end(), compare_distance);
 
-            vector<float> k_closest;
-            int k = 0;
-            for (Node* node : nodes) {
-                if (k == 100) {
-                    break;
-                }
-                k_closest.push_back(static_cast<float>(node->id));
-                k++;
-            }
-
-            groundtruth[i] = k_closest;
-
-            i++;
-        } else {
-            vector<Node*> new_nodes;
-            for (Node* node : nodes) {
-                if (node->filter == query->filter) {
-                    node->distance = euclidean(query, node);
-                    new_nodes.push_back(node);
-                }
-            }
-
-            sort(new_nodes.begin(), new_nodes.end(), compare_distance);
+// Exact k nearest neighbors of every query of the four types, the distances go through the dispatched l2_distance kernel.
+// The (distance, id) pairs live in a buffer of this call, so the nodes are only read.
+vector<vector<float>> brute_force(const VectorStore& store, const vector<Node*>& nodes, const VectorStore& query_store, const vector<Query>& queries) {
+    vector<vector<float>> groundtruth(queries.size());
+    vector<pair<float, unsigned int>> distances;
+    distances.reserve(nodes.size());
 
-            vector<float> k_closest;
-            int k = 0;
-            for (Node* node : new_nodes) {
-                if (k == 100 || k == new_nodes.size()) {
-                    break;
-                }
-                k_closest.push_back(static_cast<float>(node->id));
-                k++;
+    for (size_t i = 0; i < queries.size(); i++) {
+        const Query& query = queries[i];
+        const float* x_q = query_store.row(query.id);
+
+        distances.clear();
+        for (Node* node : nodes) {
+            bool label_ok = (query.type != 1 && query.type != 3) || node->label == query.label;
+            bool window_ok = (query.type != 2 && query.type != 3) || (node->timestamp >= query.l && node->timestamp <= query.r);
+            if (label_ok && window_ok) {
+                distances.emplace_back(euclidean(store, store.row(node->id), x_q), node->id);
             }
+        }
 
-            groundtruth[i] = k_closest;
+        size_t k = min<size_t>(100, distances.size());
+        partial_sort(distances.begin(), distances.begin() + k, distances.end(), compare_distance);
 
-            i++;
+        vector<float> k_closest;
+        for (size_t j = 0; j < k; j++) {
+            k_closest.push_back(static_cast<float>(distances[j].second));
         }
+
+        groundtruth[i] = k_closest;
     }
 
     return groundtruth;
@@ -183,28 +41,32 @@ void print_vectors(vector<float> coords) {
     }
 }
 
-void print_groundtruth(vector<vector<float>> groundtruth, vector<Node*> queries) {
+void print_groundtruth(const vector<vector<float>>& groundtruth, const vector<Query>& queries) {
     for (size_t i = 0; i < queries.size(); i++) {
-        Node* query = queries[i];
-        vector<float> ground = groundtruth[i];
-        cout << "Node id " << query->id << endl;
+        cout << "Node id " << queries[i].id << endl;
         print_vectors(groundtruth.at(i));
         cout << endl << endl;
     }
 }
 
 int main() {
-    vector<vector<float>> data = ReadBin("dummy-data.bin", 102);
-    vector<Node*> nodes = createNodesFromVectors(data);
+    VectorStore store;
+    vector<float> label_values;
+    vector<Node*> nodes = ReadNodes("dummy-data.bin", store, label_values);
+
+    VectorStore query_store;
+    vector<Query> queries = ReadQueries("dummy-queries.bin", query_store, label_values);
 
-    vector<vector<float>> queries_vectors = ReadBin("dummy-queries.bin", 104);
-    vector<Node*> queries = createQueriesFromVectors(queries_vectors);
+    cout << "Distance kernel: " << distanceKernelName(bestDistanceKernel()) << endl;
 
-    vector<vector<float>> groundtruth = brute_force(nodes, queries);
+    vector<vector<float>> groundtruth = brute_force(store, nodes, query_store, queries);
 
     SaveVectorToBinary(groundtruth, "dummy-groundtruth.bin");
 
     print_groundtruth(groundtruth, queries);
 
     cout << endl;
-}
\ No newline at end of file
+
+    for (Node* node : nodes)
+        delete node;
+}
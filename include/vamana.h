@@ -22,6 +22,11 @@
 #include <chrono>
 #include <thread>
 #include <mutex> 
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
 
 
 using namespace std;
@@ -30,67 +35,902 @@ using namespace std;
 constexpr float EPSILON = 1e-6;
 
 
+// Squared L2 distance kernels. The widest one the CPU supports is picked at startup for
+// the l2_distance pointer, and every VectorStore picks the same kernel unrolled for its dimension.
+using DistanceFunction = float (*)(const float* a, const float* b, size_t dim);
+
+enum DistanceKernel { KERNEL_SCALAR, KERNEL_SSE, KERNEL_AVX2, KERNEL_AVX512 };
+
+extern DistanceFunction l2_distance;
+
+bool distanceKernelSupported(DistanceKernel kernel);
+
+// Returns nullptr if the CPU does not support the kernel
+DistanceFunction distanceKernel(DistanceKernel kernel);
+
+// Same as above, but returns a kernel unrolled for the given dimension when there is one
+// (96, 100, 128 and 768), and the runtime dimension kernel for any other size
+DistanceFunction distanceKernel(DistanceKernel kernel, size_t dim);
+
+const char* distanceKernelName(DistanceKernel kernel);
+
+DistanceKernel bestDistanceKernel();
+
+inline float euclidean(const float* a, const float* b, size_t dim) {
+    return l2_distance(a, b, dim);
+}
+
+
+// Dense storage for the vectors of a dataset: one 64-byte aligned block of
+// count x stride floats, where row `id` holds the coordinates of the node with that id.
+// Each row is zero padded up to a multiple of 16 floats so that every row starts on a cache line.
+struct VectorStore {
+    float* data = nullptr;
+    size_t count = 0;   // number of vectors
+    size_t dim = 0;     // dimensions of each vector
+    size_t stride = 0;  // floats between the start of two consecutive rows
+    DistanceFunction l2 = nullptr;  // distance kernel picked for dim
+    bool owns_data = true;  // false when data points into memory the store does not own, like a mapped index
+
+    VectorStore() = default;
+    VectorStore(size_t count, size_t dim);
+    VectorStore(const vector<vector<float>>& rows);
+
+    // A store over rows that are already laid out in memory, which it does not copy or free
+    VectorStore(float* data, size_t count, size_t dim, size_t stride);
+    ~VectorStore();
+
+    VectorStore(VectorStore&& other) noexcept;
+    VectorStore& operator=(VectorStore&& other) noexcept;
+    VectorStore(const VectorStore&) = delete;
+    VectorStore& operator=(const VectorStore&) = delete;
+
+    float* row(unsigned int id) {
+        return data + id * stride;
+    }
+
+    const float* row(unsigned int id) const {
+        return data + id * stride;
+    }
+};
+
+// The label of a node is a dense id: the filter values of the data file are numbered
+// 0, 1, 2, ... in the order they first appear, see ReadNodes. A node can have more labels,
+// which only the LabelIndex it is built into holds, and then this is its first one.
 struct Node {
     unsigned int id;
-    float distance;
-    vector<float> coords;
-    vector<Node*> out_neighbors; 
-    float filter;
+    uint32_t label;
+    float timestamp;
+};
+
+// Label of a query whose filter no node has, or that has no filter
+constexpr uint32_t NO_LABEL = numeric_limits<uint32_t>::max();
+
+// A query of the query file. The id is its row in the query store. The type is 0 for unfiltered
+// queries, 1 for a label, 2 for a timestamp window [l, r] and 3 for a label and a timestamp window.
+struct Query {
+    unsigned int id;
+    int type;
+    uint32_t label;
+    float l;
+    float r;
+};
+
+// Whether a node passes a label filter with any one of its labels or only with all of them
+enum FilterMode {
+    MATCH_ANY,
+    MATCH_ALL
 };
 
+// A set of labels to match against the labels of the nodes. The labels are kept as the
+// non-zero 64-bit words of their bitset, so a single label is one word and one AND.
+struct LabelFilter {
+    FilterMode mode = MATCH_ANY;
+    vector<uint32_t> labels;                 // sorted, without duplicates
+    vector<pair<uint32_t, uint64_t>> words;  // (word, bits) of the labels, in word order
+    uint32_t single = NO_LABEL;              // the label, when there is exactly one
+
+    LabelFilter() = default;
+
+    // A single label, NO_LABEL matches no node
+    LabelFilter(uint32_t label);
+
+    LabelFilter(vector<uint32_t> labels, FilterMode mode);
+};
+
+// Nodes with more labels than this many words of bits hold them as sorted lists only,
+// so the bitset of a node never takes more than one cache line
+constexpr size_t LABEL_BITSET_WORDS = 8;
+
+// Labels of the nodes, in two CSR blocks:
+// the labels of node id are node_labels[node_offsets[id]] .. node_labels[node_offsets[id + 1] - 1], sorted,
+// the members of label f are members[offsets[f]] .. members[offsets[f + 1] - 1], in ascending id order.
+// The filters are matched against the cheapest form the labels fit: the label of every node when no node
+// has more than one, else a bitset of `words` words per node when there are at most LABEL_BITSET_WORDS * 64
+// labels, else the sorted labels of the node.
+// The blocks are either owned, in the vectors, or the label sections of a mapped index file.
+struct LabelIndex {
+    vector<uint32_t> node_offsets;  // nodeCount() + 1 entries
+    vector<uint32_t> node_labels;
+    vector<uint32_t> offsets;       // size() + 1 entries
+    vector<uint32_t> members;
+    vector<uint32_t> of_node;       // label of every node, NO_LABEL for none, when no node has more than one
+    size_t words = 0;               // words of bits per node, 0 when the bitsets are not built
+    vector<uint64_t> bits;
+
+    // The same blocks in memory the index does not own, used instead of the vectors when node_offsets is set
+    struct Mapped {
+        const uint32_t* node_offsets = nullptr;
+        const uint32_t* node_labels = nullptr;
+        const uint32_t* offsets = nullptr;
+        const uint32_t* members = nullptr;
+        const uint32_t* of_node = nullptr;  // null when a node has more than one label
+        const uint64_t* bits = nullptr;
+        size_t node_count = 0;
+        size_t label_count = 0;
+    } mapped;
+
+    LabelIndex() = default;
+
+    // One label per node, nodes[i] is the node with id i and the labels are dense ids
+    explicit LabelIndex(const vector<Node*>& nodes);
+
+    // Any number of labels per node, node_labels[id] holds the labels of node id
+    explicit LabelIndex(const vector<vector<uint32_t>>& node_labels);
+
+    // An index over blocks that are already laid out in memory, which it does not copy or free
+    LabelIndex(const Mapped& mapped, size_t words) : words(words), mapped(mapped) {}
+
+    const uint32_t* nodeOffsets() const {
+        return mapped.node_offsets ? mapped.node_offsets : node_offsets.data();
+    }
+
+    const uint32_t* nodeLabels() const {
+        return mapped.node_offsets ? mapped.node_labels : node_labels.data();
+    }
+
+    const uint32_t* labelOffsets() const {
+        return mapped.node_offsets ? mapped.offsets : offsets.data();
+    }
+
+    const uint32_t* memberIds() const {
+        return mapped.node_offsets ? mapped.members : members.data();
+    }
+
+    // Label of every node, or null when a node has more than one
+    const uint32_t* ofNode() const {
+        return mapped.node_offsets ? mapped.of_node : (of_node.empty() ? nullptr : of_node.data());
+    }
+
+    const uint64_t* bitRows() const {
+        return mapped.node_offsets ? mapped.bits : bits.data();
+    }
+
+    size_t size() const {
+        if (mapped.node_offsets) {
+            return mapped.label_count;
+        }
+        return offsets.empty() ? 0 : offsets.size() - 1;
+    }
+
+    size_t nodeCount() const {
+        if (mapped.node_offsets) {
+            return mapped.node_count;
+        }
+        return node_offsets.empty() ? 0 : node_offsets.size() - 1;
+    }
+
+    // Labels of all the nodes together
+    size_t labelCount() const {
+        return nodeCount() == 0 ? 0 : nodeOffsets()[nodeCount()];
+    }
+
+    // Number of members of a label, 0 for NO_LABEL or an unknown one
+    size_t count(uint32_t label) const {
+        return label < size() ? labelOffsets()[label + 1] - labelOffsets()[label] : 0;
+    }
+
+    const uint32_t* begin(uint32_t label) const {
+        return memberIds() + labelOffsets()[label];
+    }
+
+    const uint32_t* end(uint32_t label) const {
+        return memberIds() + labelOffsets()[label + 1];
+    }
+
+    const uint32_t* labelsBegin(unsigned int id) const {
+        return nodeLabels() + nodeOffsets()[id];
+    }
+
+    const uint32_t* labelsEnd(unsigned int id) const {
+        return nodeLabels() + nodeOffsets()[id + 1];
+    }
+
+    bool has(unsigned int id, uint32_t label) const {
+        if (const uint32_t* labels = ofNode()) {
+            return label != NO_LABEL && labels[id] == label;
+        }
+        if (words > 0) {
+            return label < size() && (bitRows()[id * words + label / 64] >> (label % 64) & 1);
+        }
+        return binary_search(labelsBegin(id), labelsEnd(id), label);
+    }
+
+    // Whether node id passes the filter
+    bool matches(unsigned int id, const LabelFilter& filter) const {
+        const uint32_t* labels = ofNode();
+        if (labels && filter.single != NO_LABEL) {
+            return labels[id] == filter.single;
+        }
+        if (words == 0) {
+            return matchLists(id, filter);
+        }
+
+        const uint64_t* row = bitRows() + id * words;
+        if (filter.mode == MATCH_ANY) {
+            for (const auto& [word, mask] : filter.words) {
+                if (word < words && (row[word] & mask) != 0) {
+                    return true;
+                }
+            }
+            return false;
+        }
+        for (const auto& [word, mask] : filter.words) {
+            if (word >= words || (row[word] & mask) != mask) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // matches() over the sorted labels of the node, when there are no bitsets
+    bool matchLists(unsigned int id, const LabelFilter& filter) const;
+
+    // Whether nodes a and b have a label in common
+    bool shares(unsigned int a, unsigned int b) const;
+
+    // Whether node c has every label that nodes a and b have in common
+    bool covers(unsigned int a, unsigned int b, unsigned int c) const;
+};
+
+// Fixed-degree adjacency of the graph: one block of count x (R + 1) ids, where slot 0 of
+// row `id` holds the out-degree of that node and slots 1..degree hold its out-neighbors.
+// The block is either owned, in `adjacency`, or the adjacency section of a mapped index file.
 struct DirectedGraph {
-    unordered_map<Node*, unordered_set<Node*>> adjacency_list;
+    vector<uint32_t> adjacency;
+    uint32_t* mapped = nullptr;  // used instead of adjacency when set, not owned
+    size_t count = 0;    // number of nodes
+    unsigned int R = 0;  // maximum out-degree
+
+    DirectedGraph() = default;
+    DirectedGraph(size_t count, unsigned int R) : adjacency(count * (R + 1), 0), count(count), R(R) {}
+
+    // A graph over a block that is already laid out in memory, which it does not copy or free
+    DirectedGraph(uint32_t* mapped, size_t count, unsigned int R) : mapped(mapped), count(count), R(R) {}
 
     size_t size() const {
-        return adjacency_list.size();
+        return count;
+    }
+
+    uint32_t* row(unsigned int id) {
+        return (mapped ? mapped : adjacency.data()) + static_cast<size_t>(id) * (R + 1);
+    }
+
+    const uint32_t* row(unsigned int id) const {
+        return (mapped ? mapped : adjacency.data()) + static_cast<size_t>(id) * (R + 1);
+    }
+
+    uint32_t degree(unsigned int id) const {
+        return row(id)[0];
     }
+
+    const uint32_t* neighbors(unsigned int id) const {
+        return row(id) + 1;
+    }
+
+    bool hasNeighbor(unsigned int id, unsigned int neighbor) const;
+
+    // Appends an out-neighbor in place, returns false if the node already has R of them
+    bool addNeighbor(unsigned int id, unsigned int neighbor);
+
+    // Replaces the out-neighbors of a node, keeping at most R of them
+    void setNeighbors(unsigned int id, const vector<unsigned int>& ids);
 };
 
 
-vector<Node*> GreedySearch(Node* s, const Node* x_q, unsigned int k, unsigned int list_size);
+// Set of node ids that is emptied in O(1), for the searches to reuse across queries.
+// An id is in the set when its tag equals the current epoch, so emptying it only bumps the epoch,
+// and the tags are wiped only when the 16-bit epoch wraps around.
+struct VisitedSet {
+    vector<uint16_t> tags;
+    uint16_t epoch = 0;
+
+    // Empties the set and makes room for ids below count
+    void reset(size_t count);
 
-float euclidean(const Node* a, const Node* b);
+    bool contains(unsigned int id) const {
+        return tags[id] == epoch;
+    }
 
-bool compare_distance(Node* node1, Node* node2);
+    // Returns false if the id was already in the set
+    bool insert(unsigned int id) {
+        if (tags[id] == epoch) {
+            return false;
+        }
+        tags[id] = epoch;
+        return true;
+    }
+};
+
+
+struct Candidate {
+    float distance;
+    unsigned int id;
+    bool expanded;
+};
+
+// Search list of the greedy searches: at most `capacity` candidates sorted by distance,
+// with the distance of each one computed once. `cursor` is the closest candidate not expanded yet.
+struct CandidatePool {
+    vector<Candidate> candidates;
+    size_t capacity = 0;
+    size_t cursor = 0;
+
+    // Empties the pool, keeping its memory
+    void reset(size_t capacity);
+
+    // Inserts a candidate in its sorted position, dropping the farthest one if the pool overflows.
+    // Returns false if the candidate is farther than all of a full pool. The caller skips duplicates.
+    bool insert(unsigned int id, float distance);
+
+    bool hasUnexpanded() const {
+        return cursor < candidates.size();
+    }
+
+    // Marks the closest unexpanded candidate as expanded and returns its id
+    unsigned int expandNext();
+
+    size_t size() const {
+        return candidates.size();
+    }
+
+    // Ids of the first k candidates, closest first
+    vector<unsigned int> closest(size_t k) const;
+};
 
-void RobustPrune(Node* node, vector<Node*> possible_neighbours, float a, int max_neighbours);
 
-void VamanaIndexingAlgorithm(vector<Node*>& nodes, int k, int L, int R, float a, int n, int medoidCase, int subsetSize = 10);
+// Worker threads created once and shared by the whole process. Every worker has its own task queue:
+// tasks are spread over the queues round robin, a worker takes the newest task of its own queue
+// and steals the oldest task of another queue when its own is empty.
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t num_threads);
+    ~ThreadPool();
 
-vector<vector<float>> ReadBin(const string &file_path, const int num_dimensions);
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // The process-wide pool, with one worker per hardware thread
+    static ThreadPool& instance();
+
+    size_t size() const {
+        return workers.size();
+    }
+
+    void submit(function<void()> task);
+
+    // Calls body(i) for every i in [begin, end) and returns once all calls are done. The range is cut
+    // into chunks of `grain` indices, which the workers and the calling thread pick up one at a time.
+    // The calling thread works through the chunks itself, so it is safe to call from inside a task.
+    void parallelFor(size_t begin, size_t end, const function<void(size_t)>& body, size_t grain = 1);
+
+    // Same as parallelFor, but also passes the slot of the thread that runs the call, a number below
+    // size() + 1 that no other thread of the same loop has, for indexing per-thread scratch memory
+    void parallelForSlots(size_t begin, size_t end, const function<void(size_t, size_t)>& body, size_t grain = 1);
+
+private:
+    struct TaskQueue {
+        mutex lock;
+        deque<function<void()>> tasks;
+    };
+
+    vector<thread> workers;
+    vector<unique_ptr<TaskQueue>> queues;  // one per worker
+    atomic<size_t> next_queue{0};
+    atomic<size_t> pending{0};  // tasks queued and not taken yet
+    mutex sleep_lock;
+    condition_variable wake;
+    bool stopping = false;
+
+    void workerLoop(size_t index);
+    bool takeTask(size_t index, function<void()>& task);
+};
+
+// Distances per chunk of a parallel loop. A distance takes tens of nanoseconds, so shorter
+// loops, like the few hundred candidates of a prune, stay on the calling thread.
+constexpr size_t DISTANCE_GRAIN = 1024;
+
+
+// Scratch memory of one search. Every thread that searches owns one, so concurrent
+// searches and build workers share nothing but the read-only store and graph.
+struct SearchScratch {
+    VisitedSet visited;
+    CandidatePool pool;     // (distance, id) pairs of the search list
+    CandidatePool results;  // nodes inside the timestamp window, for the range searches
+    size_t hops = 0;        // hops of the last GreedySearch, each expanding beam_width nodes
+    size_t distances = 0;   // distances computed by the last GreedySearch
+    vector<float> table;    // distances of the query to the centroids, for the searches on PQ codes
+    size_t reads = 0;       // reads of sectors by the last DiskSearch
+    vector<char> sectors;   // the sectors a hop of DiskSearch reads
+    vector<unsigned int> pending;  // unvisited neighbors a hop collects before their distances
+};
+
+vector<unsigned int> GreedySearch(const VectorStore& store, const DirectedGraph& graph, unsigned int s, const float* x_q, unsigned int k, unsigned int list_size, SearchScratch& scratch);
+
+// Same as above, with the scratch of the calling thread
+vector<unsigned int> GreedySearch(const VectorStore& store, const DirectedGraph& graph, unsigned int s, const float* x_q, unsigned int k, unsigned int list_size);
+
+// Neighbors between the one whose distance is computed and the one whose lines are prefetched,
+// for the prefetching GreedySearch
+constexpr unsigned int PREFETCH_AHEAD = 4;
+
+// Same as above, with every start node in the search list from the start. With beam_width > 1
+// every hop expands the beam_width closest unexpanded nodes together: it collects and prefetches the
+// unvisited neighbors of all of them before it computes any distance, so their cache misses overlap.
+// With prefetch_ahead > 0 a hop first collects the unvisited neighbors, then computes their distances
+// in one batch, prefetching the vector and adjacency lines of the neighbor prefetch_ahead entries on.
+vector<unsigned int> GreedySearch(const VectorStore& store, const DirectedGraph& graph, const vector<unsigned int>& start_nodes, const float* x_q, unsigned int k, unsigned int list_size, SearchScratch& scratch, unsigned int beam_width = 1, unsigned int prefetch_ahead = 0);
+
+// Centroids of every subspace of a ProductQuantizer, so a code is one byte per subspace
+constexpr unsigned int PQ_CENTROIDS = 256;
+
+// Product quantization of the vectors of a store, see modules/product_quantizer.cpp. The dimensions
+// are split into `subspaces` runs and every run of a vector is replaced by the byte id of its closest
+// centroid, so a vector takes `subspaces` bytes instead of 4 x dim. The searches on the codes add up
+// the distances of a query to the centroids from a table that is computed once per query.
+struct ProductQuantizer {
+    size_t dim = 0;
+    unsigned int subspaces = 0;
+    size_t sub_dim = 0;             // dimensions of the longest subspace, and floats per centroid
+    vector<uint32_t> offsets;       // subspace m covers the dimensions [offsets[m], offsets[m + 1])
+    vector<float> centroids;        // subspaces x sub_dim x PQ_CENTROIDS, dimension d of every centroid of a subspace side by side
+    vector<uint8_t> codes;          // subspaces bytes for every row of the store
+
+    ProductQuantizer() = default;
+
+    // Trains the codebooks with kMeans on up to train_size random nodes, then encodes every node,
+    // all of it on the threads of `pool`
+    ProductQuantizer(const VectorStore& store, const vector<Node*>& nodes, unsigned int subspaces, size_t train_size, unsigned int seed, ThreadPool& pool = ThreadPool::instance());
+
+    // Dimension d of subspace m of all the centroids of that subspace
+    const float* column(unsigned int m, size_t d) const {
+        return centroids.data() + (m * sub_dim + d) * PQ_CENTROIDS;
+    }
+
+    float* column(unsigned int m, size_t d) {
+        return centroids.data() + (m * sub_dim + d) * PQ_CENTROIDS;
+    }
+
+    // In size_t, id x subspaces passes 2^32 on a shard of 100M points
+    const uint8_t* code(unsigned int id) const {
+        return codes.data() + static_cast<size_t>(id) * subspaces;
+    }
+
+    uint8_t* code(unsigned int id) {
+        return codes.data() + static_cast<size_t>(id) * subspaces;
+    }
+
+    // The closest centroid of every subspace of x
+    void encode(const float* x, uint8_t* code) const;
+
+    // subspaces x PQ_CENTROIDS squared distances of the runs of x_q to the centroids
+    void distanceTable(const float* x_q, vector<float>& table) const;
+
+    // Squared distance of the query of the table to the code of row id
+    float distance(const float* table, unsigned int id) const {
+        const uint8_t* c = code(id);
+        float sum = 0.0f;
+        for (unsigned int m = 0; m < subspaces; m++, table += PQ_CENTROIDS) {
+            sum += table[c[m]];
+        }
+        return sum;
+    }
+};
+
+// The k candidates of a search list on PQ codes that are closest to x_q by the exact distances of the store
+vector<unsigned int> rerankExact(const VectorStore& store, const CandidatePool& candidates, const float* x_q, unsigned int k, CandidatePool& reranked);
+
+// Same as GreedySearch, walking the graph on the PQ codes. The search list is then re-ranked with
+// the exact distances of the store and the k closest of it are returned.
+vector<unsigned int> GreedySearch(const VectorStore& store, const ProductQuantizer& pq, const DirectedGraph& graph, const vector<unsigned int>& start_nodes, const float* x_q, unsigned int k, unsigned int list_size, SearchScratch& scratch);
+
+// Precision of the rows of a ScalarQuantizedStore: half floats, or one byte per dimension
+enum ScalarPrecision { PRECISION_FP16, PRECISION_SQ8 };
+
+using QueryDistanceFunction = float (*)(const float* x_q, const uint8_t* row, const float* scale, const float* offset, size_t dim);
+using CodeDistanceFunction = float (*)(const uint8_t* a, const uint8_t* b, const float* scale, size_t dim);
+
+// The rows of a VectorStore in 2 or 1 bytes per dimension instead of 4, see modules/scalar_quantizer.cpp.
+// SQ8 maps dimension d to 256 steps from its minimum: x[d] = offset[d] + scale[d] * code[d].
+// The squared distances to a float query and between two rows run on AVX2 kernels, with F16C for
+// the half floats, picked when the store is built. Every row starts on a cache line.
+struct ScalarQuantizedStore {
+    ScalarPrecision precision = PRECISION_SQ8;
+    size_t count = 0;
+    size_t dim = 0;
+    size_t row_bytes = 0;           // bytes between the start of two consecutive rows
+    vector<uint8_t> codes;
+    vector<float> scale, offset;    // of every dimension, for SQ8
+    QueryDistanceFunction to_query = nullptr;
+    CodeDistanceFunction between = nullptr;
+
+    ScalarQuantizedStore() = default;
+
+    // Encodes every row of the store. simd = false keeps the plain loops, for comparing the kernels.
+    ScalarQuantizedStore(const VectorStore& store, ScalarPrecision precision, bool simd = true);
+
+    const uint8_t* row(unsigned int id) const {
+        return codes.data() + id * row_bytes;
+    }
+
+    float distance(const float* x_q, unsigned int id) const {
+        return to_query(x_q, row(id), scale.data(), offset.data(), dim);
+    }
+
+    float distance(unsigned int a, unsigned int b) const {
+        return between(row(a), row(b), scale.data(), dim);
+    }
+
+    // The floats that row id stands for
+    void decode(unsigned int id, float* x) const;
+};
+
+// Same as GreedySearch, walking the graph on the quantized rows. With an exact store the search list
+// is then re-ranked with its distances, else the k closest by the quantized distances are returned.
+vector<unsigned int> GreedySearch(const ScalarQuantizedStore& codes, const DirectedGraph& graph, const vector<unsigned int>& start_nodes, const float* x_q, unsigned int k, unsigned int list_size, SearchScratch& scratch, const VectorStore* exact = nullptr);
+
+// Entry points an unfiltered search starts from
+constexpr unsigned int ENTRY_SEEDS = 4;
+
+// The `count` entry points closest to x_q, closest first
+vector<unsigned int> closestEntryPoints(const VectorStore& store, const vector<unsigned int>& entry_points, const float* x_q, unsigned int count);
+
+// Distance between two vectors with the dimension of the store, through its specialised kernel
+inline float euclidean(const VectorStore& store, const float* a, const float* b) {
+    return store.l2(a, b, store.dim);
+}
+
+float euclidean(const VectorStore& store, const Node* a, const Node* b);
+
+bool compare_distance(const pair<float, unsigned int>& a, const pair<float, unsigned int>& b);
+
+// The out-neighbors that RobustPrune picks for p, without changing the graph
+vector<unsigned int> RobustPruneNeighbors(const VectorStore& store, const DirectedGraph& graph, unsigned int p, vector<unsigned int> possible_neighbours, float a, int max_neighbours);
+
+void RobustPrune(const VectorStore& store, DirectedGraph& graph, unsigned int p, vector<unsigned int> possible_neighbours, float a, int max_neighbours);
+
+// Same as the two above, on the distances between the quantized rows
+vector<unsigned int> RobustPruneNeighbors(const ScalarQuantizedStore& codes, const DirectedGraph& graph, unsigned int p, vector<unsigned int> possible_neighbours, float a, int max_neighbours);
+
+void RobustPrune(const ScalarQuantizedStore& codes, DirectedGraph& graph, unsigned int p, vector<unsigned int> possible_neighbours, float a, int max_neighbours);
+
+// With num_threads > 1 the points are inserted in parallel batches, see modules/vamana.cpp
+void VamanaIndexingAlgorithm(const VectorStore& store, DirectedGraph& graph, vector<Node*>& nodes, int k, int L, int R, float a, int n, int medoidCase, int subsetSize = 10, unsigned int num_threads = 1);
+
+// Same as above, on the threads of a pool the caller owns, with parallel batches if it has workers
+void VamanaIndexingAlgorithm(const VectorStore& store, DirectedGraph& graph, vector<Node*>& nodes, int k, int L, int R, float a, int n, int medoidCase, int subsetSize, ThreadPool& pool);
+
+// Same as above on the quantized rows, every search and prune of the build on their distances.
+// The walks start from node s, which the caller picks, for example with datasetMedoid before quantizing.
+void VamanaIndexingAlgorithm(const ScalarQuantizedStore& codes, DirectedGraph& graph, vector<Node*>& nodes, int L, int R, float a, unsigned int s, unsigned int num_threads = 1);
+
+// Layout of the contest files. Data rows hold the filter, the timestamp and the coordinates,
+// query rows hold the query type, the filter, the timestamp range and the coordinates.
+constexpr int VECTOR_DIMENSIONS = 100;
+constexpr int DATA_COLUMNS = VECTOR_DIMENSIONS + 2;
+constexpr int QUERY_COLUMNS = VECTOR_DIMENSIONS + 4;
+
+// Reads a contest .bin file, a uint32 N followed by N rows of `columns` floats, one block of rows
+// at a time. With `mapped` the file is memory mapped and the blocks point straight into the mapping,
+// otherwise they are read into one reusable buffer, so memory stays bounded by the block size.
+class BinReader {
+public:
+    BinReader(const string& file_path, size_t columns, bool mapped = false, size_t block_rows = 4096);
+    ~BinReader();
+
+    BinReader(const BinReader&) = delete;
+    BinReader& operator=(const BinReader&) = delete;
+
+    bool is_open() const {
+        return open;
+    }
+
+    // Rows in the file: N, or fewer if the file ends before N full rows
+    size_t size() const {
+        return rows;
+    }
+
+    size_t columns() const {
+        return row_columns;
+    }
+
+    // Points `block` at the next rows, row-major, and returns how many there are, 0 at the end.
+    // The block stays valid until the next call.
+    size_t next(const float*& block);
+
+private:
+    ifstream ifs;
+    bool open = false;
+    size_t rows = 0;
+    size_t row_columns = 0;
+    size_t block_rows = 0;
+    size_t position = 0;  // rows handed out so far
+    vector<float> buffer;
+    void* mapping = nullptr;
+    size_t mapping_size = 0;
+};
 
 void SaveVectorToBinary(const vector<vector<float>>& vectors, const string& file_path);
 
 vector<vector<float>> ReadGroundTruth(const string& file_path);
 
-vector<Node*> createNodesFromVectors(const vector<vector<float>>& vectors);
+// Stream a data file into the store and return its nodes, which the caller deletes.
+// label_values gets the filter value of every label.
+vector<Node*> ReadNodes(const string& file_path, VectorStore& store, vector<float>& label_values, bool mapped = false);
+
+// Stream a query file into the store and return its queries, of all four types.
+// The filters are turned into the labels of label_values, NO_LABEL for a value no node has.
+vector<Query> ReadQueries(const string& file_path, VectorStore& store, const vector<float>& label_values, bool mapped = false);
+
+// A built index, saved as one file that is mapped read-only and searched in place, see modules/index_file.cpp.
+// The store, graph and labels point into the mapping, so they are only valid while the IndexFile lives.
+struct IndexFile {
+    void* mapping = nullptr;
+    size_t mapping_size = 0;
+    VectorStore store;
+    DirectedGraph graph;
+    unsigned int entry_point = 0;              // medoid of the whole dataset
+    LabelIndex labels;              // labels of every node
+    vector<Node> nodes;             // of every point, with its first label and its timestamp
+    vector<float> label_values;     // filter value of every label
+    vector<unsigned int> medoids;   // entry point of every label
+    vector<unsigned int> entry_points;  // spread over the whole dataset, see diverseEntryPoints
+
+    IndexFile() = default;
+    ~IndexFile();
+    IndexFile(const IndexFile&) = delete;
+    IndexFile& operator=(const IndexFile&) = delete;
+};
+
+void SaveIndex(const string& file_path, const VectorStore& store, const DirectedGraph& graph, const vector<Node*>& nodes, const LabelIndex& labels, const vector<float>& label_values, unsigned int entry_point, const vector<unsigned int>& medoids, const vector<unsigned int>& entry_points = {});
+
+// Maps the index file into `index` and returns its nodes, which point into index.nodes.
+// Prints the reason and returns no nodes if the file is missing, truncated or of another version,
+// or if a medoid or entry point is out of range. Only the header and the ends of the sections are
+// read, so opening takes the same time for any size. verify also checks every neighbor and label,
+// one pass over the whole file, for files that may be corrupted: the searches trust them.
+vector<Node*> OpenIndex(const string& file_path, IndexFile& index, bool verify = false);
+
+// Sector size of a DiskIndex, the unit the disk reads in
+constexpr size_t DISK_SECTOR = 4096;
+
+// An index whose vectors and graph stay on disk, see modules/disk_index.cpp. The record of a node, its
+// full vector and its neighbor list padded to R ids, is packed into 4 KB sectors. Only the PQ codes,
+// which steer the search, and the entry points are kept in memory.
+struct DiskIndex {
+    int fd = -1;
+    size_t count = 0;
+    size_t dim = 0;
+    unsigned int R = 0;
+    size_t node_bytes = 0;          // dim floats, the degree and R neighbor ids
+    size_t nodes_per_sector = 1;    // records of a sector, 1 if a record needs more than one sector
+    size_t node_sectors = 1;        // sectors one read of a record takes
+    uint64_t nodes_offset = 0;
+    unsigned int entry_point = 0;
+    vector<unsigned int> entry_points;
+    ProductQuantizer pq;
+    DistanceFunction l2 = nullptr;  // distance kernel picked for dim
+    unique_ptr<ThreadPool> io;      // issues the reads of a hop together, without it they run in turn
+
+    DiskIndex() = default;
+    ~DiskIndex();
+    DiskIndex(const DiskIndex&) = delete;
+    DiskIndex& operator=(const DiskIndex&) = delete;
+
+    // Where the read of node id starts in the file, and where its record is in what that read returns
+    uint64_t readOffset(unsigned int id) const {
+        return nodes_offset + id / nodes_per_sector * node_sectors * DISK_SECTOR;
+    }
+
+    size_t recordOffset(unsigned int id) const {
+        return id % nodes_per_sector * node_bytes;
+    }
+};
+
+// Writes the graph, the vectors of the store and the codes of pq as a DiskIndex file
+void SaveDiskIndex(const string& file_path, const VectorStore& store, const DirectedGraph& graph, const ProductQuantizer& pq, unsigned int entry_point, const vector<unsigned int>& entry_points = {});
+
+// Reads the header, the codes and the entry points of the file into `index`, the records stay on disk.
+// With io_threads > 0 the reads of a hop are spread over that many threads besides the searching one.
+// Prints the reason and returns false if the file is missing, truncated or of another version.
+bool OpenDiskIndex(const string& file_path, DiskIndex& index, unsigned int io_threads = 0);
+
+// GreedySearch on a DiskIndex, from its entry points. Every hop expands the beam_width closest
+// unexpanded nodes of the search list, by their PQ distances, and reads all their records at once.
+// The nodes that are read are ranked by the exact distances of their vectors. Throws runtime_error
+// if a read fails. scratch.hops counts the hops and scratch.reads the reads.
+vector<unsigned int> DiskSearch(const DiskIndex& index, const float* x_q, unsigned int k, unsigned int list_size, unsigned int beam_width, SearchScratch& scratch);
+
+// Mean of the nodes, summed in one parallel pass over the store. Like the other medoid and k-means
+// routines it runs on the threads of `pool`, the process-wide one unless the caller owns another.
+vector<float> datasetCentroid(const VectorStore& store, const vector<Node*>& nodes, ThreadPool& pool = ThreadPool::instance());
+
+// The node closest to the centroid of the dataset, an O(n) stand-in for the exact medoid
+unsigned int datasetMedoid(const VectorStore& store, const vector<Node*>& nodes, ThreadPool& pool = ThreadPool::instance());
+
+// A medoid picked from samples, with the mean distance of the node to the dataset that the
+// samples estimate and the half-width of the 95% confidence interval of that estimate
+struct MedoidEstimate {
+    unsigned int id;
+    float mean_distance;
+    float error;
+};
+
+// The candidate with the smallest mean distance to the samples, both drawn at random with the seed
+MedoidEstimate sampledMedoid(const VectorStore& store, const vector<Node*>& nodes, size_t candidates, size_t samples, unsigned int seed, ThreadPool& pool = ThreadPool::instance());
+
+// Entry points kept in an index file
+constexpr unsigned int ENTRY_POINTS = 16;
 
-vector<Node*> createQueriesFromVectors(const vector<vector<float>>& vectors);
+// Up to `count` entry points spread over the dataset by k-means++ seeding, the dataset medoid first
+vector<unsigned int> diverseEntryPoints(const VectorStore& store, const vector<Node*>& nodes, unsigned int count, unsigned int seed, ThreadPool& pool = ThreadPool::instance());
 
-vector<vector<float>> createVectorFromNodes(const vector<Node*>& nodes);
+// The filtered routines only walk through the nodes that pass the filter of the query
+vector<unsigned int> FilteredGreedySearch(const VectorStore& store, const DirectedGraph& graph, const LabelIndex& labels, const vector<unsigned int>& start_nodes, const float* x_q, unsigned int k, unsigned int list_size, const LabelFilter& filter, SearchScratch& scratch);
 
-vector<Node*> CreateGraph(vector<vector<float>> vectors);
+// Same as above, with the scratch of the calling thread
+vector<unsigned int> FilteredGreedySearch(const VectorStore& store, const DirectedGraph& graph, const LabelIndex& labels, const vector<unsigned int>& start_nodes, const float* x_q, unsigned int k, unsigned int list_size, const LabelFilter& filter);
 
-vector<vector<float>> ReadGraph(const string &file_path);
+// Same as the first one, walking the graph on the PQ codes and re-ranking the search list with the store
+vector<unsigned int> FilteredGreedySearch(const VectorStore& store, const ProductQuantizer& pq, const DirectedGraph& graph, const LabelIndex& labels, const vector<unsigned int>& start_nodes, const float* x_q, unsigned int k, unsigned int list_size, const LabelFilter& filter, SearchScratch& scratch);
 
-vector<Node*> FilteredGreedySearch(const vector<Node*>& start_nodes, const Node* x_q, unsigned int k, unsigned int list_size, const unordered_set<float>& query_filter);
+// Same as the first one, walking the graph on the quantized rows, re-ranked with the exact store if there is one
+vector<unsigned int> FilteredGreedySearch(const ScalarQuantizedStore& codes, const DirectedGraph& graph, const LabelIndex& labels, const vector<unsigned int>& start_nodes, const float* x_q, unsigned int k, unsigned int list_size, const LabelFilter& filter, SearchScratch& scratch, const VectorStore* exact = nullptr);
 
-void FilteredRobustPrune(Node* node, vector<Node*> possible_neighbours, float a, int max_neighbours);
+// Node ids sorted by timestamp, so the nodes inside a timestamp window are one contiguous range
+struct SortedTimestamps {
+    vector<float> timestamps;
+    vector<unsigned int> ids;  // ids[i] is the node with timestamps[i]
+
+    // The range [first, second) of the nodes with l <= timestamp <= r
+    pair<size_t, size_t> window(float l, float r) const;
+};
+
+// Sorted timestamps of the whole dataset and of the members of every label
+struct TimestampIndex {
+    SortedTimestamps all;
+    vector<SortedTimestamps> by_label;
+
+    TimestampIndex() = default;
+    TimestampIndex(const vector<Node*>& nodes, const LabelIndex& labels);
+};
 
-void StitchedVamana(vector<Node*>& nodes, float a, int L_small, int R_small, int R_stiched);
+// Exact k nearest of the `count` nodes in `ids`, closest first
+vector<unsigned int> BruteForceSearch(const VectorStore& store, const unsigned int* ids, size_t count, const float* x_q, unsigned int k, SearchScratch& scratch);
 
-unordered_map<float,  unsigned int> findmedoid(const vector<Node*>& P, unsigned int tau);
+// Greedy search that walks the graph through every node, or only through the members of walk_label
+// when it is not NO_LABEL, and returns the k closest nodes it saw with l <= timestamp <= r that are also
+// members of result_label when it is not NO_LABEL. The walk starts from the start nodes it can walk.
+vector<unsigned int> RangeGreedySearch(const VectorStore& store, const DirectedGraph& graph, const vector<Node*>& nodes, const LabelIndex& labels, const vector<unsigned int>& start_nodes, const float* x_q, unsigned int k, unsigned int list_size, uint32_t walk_label, uint32_t result_label, float l, float r, SearchScratch& scratch);
 
-DirectedGraph FilteredVamana(vector<Node*>& databasePoints,int k, unsigned int L, unsigned int R, float alpha, unsigned int tau);
+// Most times the search list of a range search is grown for a narrow window
+constexpr unsigned int RANGE_LIST_GROWTH = 8;
 
-vector<vector<float>> brute_force(vector<Node*>& nodes, vector<Node*>& queries);
+// Search list of a range search: list_size grown by the inverse of the fraction of the walked
+// nodes inside the window, so the walk still sees about list_size of them, up to RANGE_LIST_GROWTH times
+unsigned int rangeListSize(unsigned int list_size, size_t window, size_t walked);
 
-Node* findCentroid(const vector<Node*>& cluster);
+// How a query is searched:
+//   PLAN_GRAPH           GreedySearch, or RangeGreedySearch over the whole graph for a window
+//   PLAN_FILTERED_GRAPH  FilteredGreedySearch, or RangeGreedySearch through the nodes of the filter
+//   PLAN_POST_FILTER     RangeGreedySearch over the whole graph, keeping only the nodes of the filter
+//   PLAN_SCAN            BruteForceSearch over the nodes that pass the filter and the window
+enum PlanKind { PLAN_GRAPH, PLAN_FILTERED_GRAPH, PLAN_POST_FILTER, PLAN_SCAN };
+
+constexpr int PLAN_KINDS = 4;
+
+const char* planName(PlanKind kind);
+
+struct QueryPlan {
+    PlanKind kind;
+    const SortedTimestamps* candidates;  // the nodes that pass the label of the query
+    size_t first, last;                  // the range of candidates inside the timestamp window
+    unsigned int list_size;              // search list of the graph plans
+    double cost;                         // estimated, in distances of a scan
+};
+
+// Picks the cheapest plan for a query from the number of nodes that pass its filter and its window,
+// which the timestamp index gives with two binary searches. start_count is the number of start nodes
+// of the filtered walk of the query, 0 if its label has none. Unfiltered queries (type 0) always walk the graph.
+QueryPlan planQuery(const TimestampIndex& timestamps, const DirectedGraph& graph, size_t start_count, const Query& query, unsigned int L);
+
+// Slot of a result matrix row that has fewer than k neighbors
+constexpr uint32_t NO_NEIGHBOR = numeric_limits<uint32_t>::max();
+
+// Runs a whole batch of queries over one index. The queries are handed out a few at a time to the
+// threads of its own pool, and every thread searches with its own preallocated scratch memory.
+// Every query is searched with the plan that planQuery picks for it.
+class BatchSearcher {
+public:
+    vector<unsigned int> entry_points;  // walks over the whole graph start from the ENTRY_SEEDS closest to the query, node 0 if empty
+    vector<unsigned int> medoids;       // start node of the filtered walks of every label, from findmedoid. Labels past its end are scanned.
+    LabelIndex labels;                  // of the nodes, built by the constructor
+    TimestampIndex timestamps;          // of the nodes, built by the constructor
+    double search_seconds = 0.0;        // time of the last search, without any I/O
+    vector<QueryPlan> plans;            // plan of every query of the last search
+    vector<float> query_seconds;        // time of every query of the last search
+
+    BatchSearcher(const VectorStore& store, const DirectedGraph& graph, const vector<Node*>& nodes, unsigned int num_threads);
+
+    // Same as above, with the labels of the nodes given, for nodes with more than one label
+    BatchSearcher(const VectorStore& store, const DirectedGraph& graph, const vector<Node*>& nodes, LabelIndex labels, unsigned int num_threads);
+
+    // Searches every query and returns a queries.size() x k row-major matrix of neighbor ids,
+    // closest first, with NO_NEIGHBOR in the slots of rows that have fewer than k neighbors
+    vector<uint32_t> search(const VectorStore& query_store, const vector<Query>& queries, unsigned int k, unsigned int L);
+
+private:
+    const VectorStore& store;
+    const DirectedGraph& graph;
+    const vector<Node*>& nodes;
+    ThreadPool pool;
+    vector<SearchScratch> scratch;            // one per slot of the pool
+
+    vector<unsigned int> runPlan(const QueryPlan& plan, const Query& query, const float* x_q, unsigned int k, unsigned int L, size_t slot);
+};
+
+void FilteredRobustPrune(const VectorStore& store, DirectedGraph& graph, const LabelIndex& labels, unsigned int p, vector<unsigned int> possible_neighbours, float a, int max_neighbours);
+
+// The labels are built at the same time on num_threads threads, largest first, see modules/stitchedvamana.cpp
+DirectedGraph StitchedVamana(const VectorStore& store, vector<Node*>& nodes, float a, int L_small, int R_small, int R_stiched, unsigned int num_threads = 1);
+
+// Same as above, with the labels of the nodes given. A node with several labels is in the graph of each.
+DirectedGraph StitchedVamana(const VectorStore& store, vector<Node*>& nodes, const LabelIndex& labels, float a, int L_small, int R_small, int R_stiched, unsigned int num_threads = 1);
+
+// Medoid of every label, picked among tau random members. One pass over the members.
+vector<unsigned int> findmedoid(const LabelIndex& labels, unsigned int tau);
+
+DirectedGraph FilteredVamana(const VectorStore& store, vector<Node*>& databasePoints,int k, unsigned int L, unsigned int R, float alpha, unsigned int tau);
+
+// Same as above, with the labels of the nodes given. A node with several labels starts from the
+// medoid of each and searches through the nodes that share any of them.
+DirectedGraph FilteredVamana(const VectorStore& store, vector<Node*>& databasePoints, const LabelIndex& labels, int k, unsigned int L, unsigned int R, float alpha, unsigned int tau);
+
+vector<vector<float>> brute_force(const VectorStore& store, const vector<Node*>& nodes, const VectorStore& query_store, const vector<Query>& queries);
+
+vector<float> findCentroid(const VectorStore& store, const vector<Node*>& cluster);
+
+vector<vector<Node*>> kMeansClustering(const VectorStore& store, const vector<Node*>& nodes, int k, int maxIterations = 100, unsigned int seed = 1, ThreadPool& pool = ThreadPool::instance());
+
+// Positions in nodes of up to `count` k-means++ seeds: nodes[first], then every next one drawn
+// with probability proportional to its squared distance to the closest seed so far
+vector<size_t> kMeansPlusPlusSeeds(const VectorStore& store, const vector<Node*>& nodes, size_t count, size_t first, unsigned int seed, ThreadPool& pool = ThreadPool::instance());
+
+struct KMeansResult {
+    VectorStore centroids;              // one row per cluster
+    vector<unsigned int> assignment;    // cluster of nodes[i]
+    double inertia = 0.0;               // sum of the squared distances of the nodes to their centroids
+    unsigned int iterations = 0;        // iterations, or batches, that ran
+};
 
-vector<vector<Node*>> kMeansClustering(const vector<Node*>& nodes, int k, int maxIterations = 100);
+// k-means with k-means++ seeding, the same result for a seed on a pool of any size, see modules/kmeans.cpp.
+// Lloyd iterations until no node changes cluster, or max_iterations mini-batches of batch_size random nodes.
+KMeansResult kMeans(const VectorStore& store, const vector<Node*>& nodes, unsigned int k, unsigned int max_iterations, unsigned int seed, size_t batch_size = 0, ThreadPool& pool = ThreadPool::instance());
 
-int approximateMedoid(const vector<Node*>& nodes, int k);
+int approximateMedoid(const VectorStore& store, const vector<Node*>& nodes, int k);
 
 void fisherYatesShuffle(vector<Node*>& databasePoints);
 
-void initializeRandomGraph(vector<Node*>& nodes, unsigned int R);
\ No newline at end of file
+// Draws from rand(), as do the builds that call it, so seeding it with srand repeats a build.
+// main seeds it from the clock.
+void initializeRandomGraph(DirectedGraph& graph, vector<Node*>& nodes, unsigned int R);
\ No newline at end of file
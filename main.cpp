@@ -1,13 +1,18 @@
 #include "include/vamana.h"
 
 
-float computeRecall(const vector<float>& groundTruth, const vector<Node*>& retrievedNeighbors) {
+float computeRecall(const vector<float>& groundTruth, const vector<unsigned int>& retrievedNeighbors) {
+    // A timestamp window can hold no nodes at all, then the only right answer is no neighbors
+    if (groundTruth.empty()) {
+        return retrievedNeighbors.empty() ? 1 : 0;
+    }
+
     int truePositiveCount = 0;
     unordered_set<int> retrievedIds;
 
     // Store retrieved neighbor IDs in a set for fast lookup
-    for (Node* node : retrievedNeighbors) {
-        retrievedIds.insert(node->id);
+    for (unsigned int id : retrievedNeighbors) {
+        retrievedIds.insert(id);
     }
 
     // Count the number of true positives (common neighbors)
@@ -25,21 +30,104 @@ float computeRecall(const vector<float>& groundTruth, const vector<Node*>& retri
     return static_cast<float>(truePositiveCount) / retrievedNeighbors.size();
 }
 
+// Searches all the queries as one batch, then prints the neighbors of every query and returns the average recall
+float searchQueries(BatchSearcher& searcher, const VectorStore& query_store, const vector<Query>& queries, const vector<vector<float>>& groundtruth, int k, int L) {
+    vector<uint32_t> results = searcher.search(query_store, queries, k, L);
+
+    float totalRecall = 0.0;
+    float typeRecall[4] = {0.0, 0.0, 0.0, 0.0};
+    int typeCount[4] = {0, 0, 0, 0};
+
+    // Per query type and plan, for tuning the thresholds of the planner
+    float planRecall[4][PLAN_KINDS] = {};
+    double planCost[4][PLAN_KINDS] = {};
+    double planSeconds[4][PLAN_KINDS] = {};
+    int planCount[4][PLAN_KINDS] = {};
+    for (size_t i = 0; i < queries.size(); i++) {
+        const Query& query = queries[i];
+        const vector<float>& groundTruthForQuery = groundtruth[i];
+
+        vector<unsigned int> nearestNeighbors;
+        for (int j = 0; j < k && results[i * k + j] != NO_NEIGHBOR; j++) {
+            nearestNeighbors.push_back(results[i * k + j]);
+        }
+
+        cout << "Nearest neighbors from GreedySearch for query " << query.id << " with type " << query.type << ": ";
+        for (unsigned int neighbor : nearestNeighbors) {
+            cout << neighbor << " ";
+        }
+        cout << "\n";
+
+        cout << "Ground truth neighbors for query " << query.id << ": ";
+        for (int gtId : groundTruthForQuery) {
+            cout << gtId << " ";
+        }
+        cout << "\n";
+
+        float recall = computeRecall(groundTruthForQuery, nearestNeighbors);
+        totalRecall += recall;
+        const QueryPlan& plan = searcher.plans[i];
+        if (query.type >= 0 && query.type < 4) {
+            typeRecall[query.type] += recall;
+            typeCount[query.type]++;
+
+            planRecall[query.type][plan.kind] += recall;
+            planCost[query.type][plan.kind] += plan.cost;
+            planSeconds[query.type][plan.kind] += searcher.query_seconds[i];
+            planCount[query.type][plan.kind]++;
+        }
+
+        cout << "Recall for query " << query.id << ": " << recall << "\n";
+        cout << "Plan for query " << query.id << ": " << planName(plan.kind) << ", "
+             << plan.last - plan.first << " candidates, estimated cost " << plan.cost << "\n";
+        cout << "--------------------------------------------------\n";
+    }
+
+    cout << "Search time (without I/O): " << searcher.search_seconds << " seconds, "
+         << queries.size() / searcher.search_seconds << " queries per second" << endl;
+
+    cout << "\ntype\tplan\t\tqueries\tcost\tus\trecall" << endl;
+    for (int type = 0; type < 4; type++) {
+        for (int kind = 0; kind < PLAN_KINDS; kind++) {
+            int count = planCount[type][kind];
+            if (count > 0) {
+                string name = planName(static_cast<PlanKind>(kind));
+                cout << type << "\t" << name << (name.size() < 8 ? "\t\t" : "\t") << count << "\t"
+                     << planCost[type][kind] / count << "\t" << planSeconds[type][kind] / count * 1e6 << "\t"
+                     << planRecall[type][kind] / count << endl;
+            }
+        }
+    }
+    cout << endl;
+
+    for (int type = 0; type < 4; type++) {
+        if (typeCount[type] > 0) {
+            cout << "Average recall of type " << type << " queries: " << typeRecall[type] / typeCount[type] << endl;
+        }
+    }
+
+    return queries.empty() ? 0.0 : totalRecall / queries.size();
+}
+
 int main(int argc, char* argv[]) {
     if (argc < 11) {
-        cerr << "Usage: " << argv[0] << " -i <base.vecs> -q <query.vecs> -g <groundtruth.vecs> -k <k> -l <L> -r <R> -a <a> -s <graph.vecs> -f <stitched_or_filtered> -t <tau>\n";
+        cerr << "Usage: " << argv[0] << " -i <base.vecs> -q <query.vecs> -g <groundtruth.vecs> -k <k> -l <L> -r <R> -a <a> -s <graph.vecs> -f <stitched_or_filtered> -t <tau> [-n <threads>]\n";
         return 1;
     }
 
+    // Every build draws from rand(), a different graph on every run
+    srand(static_cast<unsigned int>(time(nullptr)));
+
     string base_file, query_file, groundtruth_file;
     string saved_graph;
     string stitched_or_filtered;
     int k = 0, L = 0, R = 0;
     float a = 0.0;
     unsigned int tau = 0;
+    unsigned int num_threads = thread::hardware_concurrency();
 
     int opt;
-    while ((opt = getopt(argc, argv, "i:q:g:k:l:r:a:s:f:t:")) != -1) {
+    while ((opt = getopt(argc, argv, "i:q:g:k:l:r:a:s:f:t:n:")) != -1) {
         switch (opt) {
             case 'i':
                 base_file = optarg;
@@ -71,6 +159,9 @@ int main(int argc, char* argv[]) {
             case 't':
                 tau = stoi(optarg);
                 break;
+            case 'n':
+                num_threads = stoi(optarg);
+                break;
             default:
                 cerr << "Invalid arguments.\n";
                 return 1;
@@ -79,8 +170,9 @@ int main(int argc, char* argv[]) {
 
     if (stitched_or_filtered == "stitched") {
         if (saved_graph == "no") {
-            vector<vector<float>> nodes_vecs = ReadBin(base_file, 102);
-            vector<Node*> nodes = createNodesFromVectors(nodes_vecs);
+            VectorStore store;
+            vector<float> label_values;
+            vector<Node*> nodes = ReadNodes(base_file, store, label_values);
 
             if (R <= log2(nodes.size())) {
                 cerr << "R must be greater than log2(n), so that the graph is well connected" << endl;
@@ -94,7 +186,7 @@ int main(int argc, char* argv[]) {
 
             auto start = chrono::high_resolution_clock::now();
 
-            StitchedVamana(nodes, a, 80, 40, R);
+            DirectedGraph graph = StitchedVamana(store, nodes, a, 80, 40, R, num_threads);
 
             auto end = chrono::high_resolution_clock::now();
             chrono::duration<float> graph_duration = end - start;
@@ -102,80 +194,18 @@ int main(int argc, char* argv[]) {
             cout << "The filtered vamana graph has been successfully implemented" << endl;
             cout << "Time took to create graph: " << graph_duration.count() << " seconds" << endl;
 
-            vector<vector<float>> queries_vectors = ReadBin(query_file, 104);
-            vector<Node*> queries = createQueriesFromVectors(queries_vectors);
+            VectorStore query_store;
+            vector<Query> queries = ReadQueries(query_file, query_store, label_values);
 
             vector<vector<float>> groundtruth = ReadGroundTruth(groundtruth_file);
 
-            // Process queries in chunks using threads
-            float totalRecall = 0.0;
-            int queryCount = 0;
-
-            int chunk_size = (queries.size() + 15) / 16; // Ceiling division for 16 chunks
-            vector<thread> threads;
-            vector<float> thread_recall(16, 0.0); // Store recall results for each thread
-
-            for (int t = 0; t < 16; ++t) {
-                int start_idx = t * chunk_size;
-                int end_idx = std::min(start_idx + chunk_size, (int)queries.size());
-
-                if (start_idx < end_idx) {
-                    threads.emplace_back([&, start_idx, end_idx, t]() {
-                        float localRecall = 0.0;
-                        for (int i = start_idx; i < end_idx; ++i) {
-                            Node* query = queries[i];
-                            vector<float>& groundTruthForQuery = groundtruth[i];
-                            int medoid = rand() % nodes.size();
-
-                            vector<Node*> nearestNeighbors;
-                            if (query->distance == 0) {
-                                nearestNeighbors = GreedySearch(nodes.at(medoid), query, k, L);
-                            } else {
-                                unordered_set<float> query_filter;
-                                query_filter.insert(query->filter);
-                                nearestNeighbors = FilteredGreedySearch(nodes, nodes.at(medoid), k, L, query_filter);
-                            }
-
-                            cout << "Nearest neighbors from GreedySearch for query " << query->id << " with type " << query->distance << ": ";
-                            for (Node* neighbor : nearestNeighbors) {
-                                cout << neighbor->id << " ";
-                            }
-                            cout << endl;
-
-                            cout << "Ground truth neighbors for query " << query->id << ": ";
-                            for (int gtId : groundTruthForQuery) {
-                                cout << gtId << " ";
-                            }
-                            cout << endl;
-
-                            float recall = computeRecall(groundTruthForQuery, nearestNeighbors);
-                            totalRecall += recall;
-                            queryCount++;
-
-                            cout << "Recall for query " << query->id << ": " << recall << endl;
-                            cout << "--------------------------------------------------" << endl;
-
-                            localRecall += computeRecall(groundTruthForQuery, nearestNeighbors);
-                        }
-                        thread_recall[t] = localRecall;
-                    });
-                }
-            }
-
-            // Join threads
-            for (thread& th : threads) {
-                if (th.joinable()) {
-                    th.join();
-                }
-            }
+            // Filtered queries start from the medoid of their label, unfiltered ones from the entry points closest to them
+            vector<unsigned int> entry_points = diverseEntryPoints(store, nodes, ENTRY_POINTS, rand());
+            BatchSearcher searcher(store, graph, nodes, num_threads);
+            searcher.medoids = findmedoid(searcher.labels, tau);
+            searcher.entry_points = entry_points;
 
-            // Calculate total recall
-            for (float recall : thread_recall) {
-                totalRecall += recall;
-            }
-
-            queryCount = queries.size();
-            float averageRecall = totalRecall / queryCount;
+            float averageRecall = searchQueries(searcher, query_store, queries, groundtruth, k, L);
 
             cout << "Average Recall: " << averageRecall << endl;
 
@@ -188,18 +218,20 @@ int main(int argc, char* argv[]) {
             chrono::duration<float> total = graph_duration + queries_duration;
             cout << "\nTotal time: " << total.count() << " seconds" << endl;
 
-            vector<vector<float>> graph_vector = createVectorFromNodes(nodes);
-            SaveVectorToBinary(graph_vector, "graph.bin");
+            SaveIndex("graph.bin", store, graph, nodes, searcher.labels, label_values, entry_points[0], searcher.medoids, entry_points);
 
             // Cleanup: free memory
             for (Node* node : nodes) 
                 delete node;
-            for (Node* node : queries)
-                delete node;
         } else {
 
-            vector<vector<float>> nodes_vecs = ReadGraph(saved_graph);
-            vector<Node*> nodes = CreateGraph(nodes_vecs);
+            IndexFile index;
+            vector<Node*> nodes = OpenIndex(saved_graph, index);
+            if (nodes.empty()) {
+                return 1;
+            }
+            const VectorStore& store = index.store;
+            const DirectedGraph& graph = index.graph;
 
             auto start = chrono::high_resolution_clock::now();
 
@@ -215,79 +247,17 @@ int main(int argc, char* argv[]) {
             cout << endl;
             cout << "Now the implementation of the stitched vamana algorithm is starting!" << endl;
 
-            vector<vector<float>> queries_vectors = ReadBin(query_file, 104);
-            vector<Node*> queries = createQueriesFromVectors(queries_vectors);
+            VectorStore query_store;
+            vector<Query> queries = ReadQueries(query_file, query_store, index.label_values);
 
             vector<vector<float>> groundtruth = ReadGroundTruth(groundtruth_file);
 
-            float totalRecall = 0.0;
-            int queryCount = 0;
-            
-            int chunk_size = (queries.size() + 15) / 16; // Ceiling division for 16 chunks
-            vector<thread> threads;
-            vector<float> thread_recall(16, 0.0); // Store recall results for each thread
-
-            for (int t = 0; t < 16; ++t) {
-                int start_idx = t * chunk_size;
-                int end_idx = std::min(start_idx + chunk_size, (int)queries.size());
-
-                if (start_idx < end_idx) {
-                    threads.emplace_back([&, start_idx, end_idx, t]() {
-                        float localRecall = 0.0;
-                        for (int i = start_idx; i < end_idx; ++i) {
-                            Node* query = queries[i];
-                            vector<float>& groundTruthForQuery = groundtruth[i];
-                            int medoid = rand() % nodes.size();
-
-                            vector<Node*> nearestNeighbors;
-                            if (query->distance == 0) {
-                                nearestNeighbors = GreedySearch(nodes.at(medoid), query, k, L);
-                            } else {
-                                unordered_set<float> query_filter;
-                                query_filter.insert(query->filter);
-                                nearestNeighbors = FilteredGreedySearch(nodes, nodes.at(medoid), k, L, query_filter);
-                            }
-
-                            cout << "Nearest neighbors from GreedySearch for query " << query->id << " with type " << query->distance << ": ";
-                            for (Node* neighbor : nearestNeighbors) {
-                                cout << neighbor->id << " ";
-                            }
-                            cout << endl;
-
-                            cout << "Ground truth neighbors for query " << query->id << ": ";
-                            for (int gtId : groundTruthForQuery) {
-                                cout << gtId << " ";
-                            }
-                            cout << endl;
-
-                            float recall = computeRecall(groundTruthForQuery, nearestNeighbors);
-                            totalRecall += recall;
-                            queryCount++;
-
-                            cout << "Recall for query " << query->id << ": " << recall << endl;
-                            cout << "--------------------------------------------------" << endl;
-
-                            localRecall += computeRecall(groundTruthForQuery, nearestNeighbors);
-                        }
-                        thread_recall[t] = localRecall;
-                    });
-                }
-            }
-
-            // Join threads
-            for (thread& th : threads) {
-                if (th.joinable()) {
-                    th.join();
-                }
-            }
-
-            // Calculate total recall
-            for (float recall : thread_recall) {
-                totalRecall += recall;
-            }
-            queryCount = queries.size();
+            // Filtered queries start from the medoid of their label, unfiltered ones from the entry points closest to them
+            BatchSearcher searcher(store, graph, nodes, index.labels, num_threads);
+            searcher.medoids = index.medoids;
+            searcher.entry_points = index.entry_points;
 
-            float averageRecall = totalRecall / queryCount;
+            float averageRecall = searchQueries(searcher, query_store, queries, groundtruth, k, L);
             cout << "Average Recall: " << averageRecall << endl;
 
             auto end = chrono::high_resolution_clock::now();
@@ -296,18 +266,12 @@ int main(int argc, char* argv[]) {
             cout << "The search from the querries is complete!" << endl;
             cout << "Time took to complete the search: " << queries_duration.count() << " seconds" << endl;
             cout << endl;
-
-            // Cleanup: free memory
-            for (Node* node : nodes) 
-                delete node;
-
-            for (Node* node : queries)
-                delete node;
         }
     } else {
         if (saved_graph == "no") {
-            vector<vector<float>> nodes_vecs = ReadBin(base_file, 102);
-            vector<Node*> nodes = createNodesFromVectors(nodes_vecs);
+            VectorStore store;
+            vector<float> label_values;
+            vector<Node*> nodes = ReadNodes(base_file, store, label_values);
 
             if (R <= log2(nodes.size())) {
                 cerr << "R must be greater than log2(n), so that the graph is well connected" << endl;
@@ -321,7 +285,7 @@ int main(int argc, char* argv[]) {
 
             auto start = chrono::high_resolution_clock::now();
 
-            DirectedGraph d = FilteredVamana(nodes, k, L, R, a, tau);
+            DirectedGraph graph = FilteredVamana(store, nodes, k, L, R, a, tau);
 
             auto end = chrono::high_resolution_clock::now();
 
@@ -330,77 +294,18 @@ int main(int argc, char* argv[]) {
             cout << "The filtered vamana graph has been successfully implemented" << endl;
             cout << "Time took to create graph: " << graph_duration.count() << " seconds" << endl;
 
-            vector<vector<float>> queries_vectors = ReadBin(query_file, 104);
-            vector<Node*> queries = createQueriesFromVectors(queries_vectors);
+            VectorStore query_store;
+            vector<Query> queries = ReadQueries(query_file, query_store, label_values);
 
             vector<vector<float>> groundtruth = ReadGroundTruth(groundtruth_file);
 
-            float totalRecall = 0.0;
-            int queryCount = 0;
-            int chunk_size = (queries.size() + 15) / 16; // Ceiling division for 16 chunks
-            vector<thread> threads;
-            vector<float> thread_recall(16, 0.0); // Store recall results for each thread
-
-            for (int t = 0; t < 16; ++t) {
-                int start_idx = t * chunk_size;
-                int end_idx = std::min(start_idx + chunk_size, (int)queries.size());
-
-                if (start_idx < end_idx) {
-                    threads.emplace_back([&, start_idx, end_idx, t]() {
-                        float localRecall = 0.0;
-                        for (int i = start_idx; i < end_idx; ++i) {
-                            Node* query = queries[i];
-                            vector<float>& groundTruthForQuery = groundtruth[i];
-                            int medoid = rand() % nodes.size();
-
-                            vector<Node*> nearestNeighbors;
-                            if (query->distance == 0) {
-                                nearestNeighbors = GreedySearch(nodes.at(medoid), query, k, L);
-                            } else {
-                                unordered_set<float> query_filter;
-                                query_filter.insert(query->filter);
-                                nearestNeighbors = FilteredGreedySearch(nodes, nodes.at(medoid), k, L, query_filter);
-                            }
-
-                            cout << "Nearest neighbors from GreedySearch for query " << query->id << " with type " << query->distance << ": ";
-                            for (Node* neighbor : nearestNeighbors) {
-                                cout << neighbor->id << " ";
-                            }
-                            cout << endl;
-
-                            cout << "Ground truth neighbors for query " << query->id << ": ";
-                            for (int gtId : groundTruthForQuery) {
-                                cout << gtId << " ";
-                            }
-                            cout << endl;
-
-                            float recall = computeRecall(groundTruthForQuery, nearestNeighbors);
-                            totalRecall += recall;
-                            queryCount++;
-
-                            cout << "Recall for query " << query->id << ": " << recall << endl;
-                            cout << "--------------------------------------------------" << endl;
-
-                            localRecall += computeRecall(groundTruthForQuery, nearestNeighbors);
-                        }
-                        thread_recall[t] = localRecall;
-                    });
-                }
-            }
-
-            // Join threads
-            for (thread& th : threads) {
-                if (th.joinable()) {
-                    th.join();
-                }
-            }
+            // Filtered queries start from the medoid of their label, unfiltered ones from the entry points closest to them
+            vector<unsigned int> entry_points = diverseEntryPoints(store, nodes, ENTRY_POINTS, rand());
+            BatchSearcher searcher(store, graph, nodes, num_threads);
+            searcher.medoids = findmedoid(searcher.labels, tau);
+            searcher.entry_points = entry_points;
 
-            // Calculate total recall
-            for (float recall : thread_recall) {
-                totalRecall += recall;
-            }
-            queryCount = queries.size();
-            float averageRecall = totalRecall / queryCount;
+            float averageRecall = searchQueries(searcher, query_store, queries, groundtruth, k, L);
 
             cout << "Average Recall: " << averageRecall << endl;
 
@@ -416,21 +321,22 @@ int main(int argc, char* argv[]) {
             
             cout << endl << "Total time: " << total.count() << " seconds" << endl;
 
-            vector<vector<float>> graph_vector = createVectorFromNodes(nodes);
-            SaveVectorToBinary(graph_vector, "graph.bin");
+            SaveIndex("graph.bin", store, graph, nodes, searcher.labels, label_values, entry_points[0], searcher.medoids, entry_points);
 
             // Cleanup: free memory
             for (Node* node : nodes) 
                 delete node;
-
-            for (Node* node : queries)
-                delete node;
         } else {
 
             auto start = chrono::high_resolution_clock::now();
 
-            vector<vector<float>> nodes_vecs = ReadBin(base_file, 102);
-            vector<Node*> nodes = createNodesFromVectors(nodes_vecs);
+            IndexFile index;
+            vector<Node*> nodes = OpenIndex(saved_graph, index);
+            if (nodes.empty()) {
+                return 1;
+            }
+            const VectorStore& store = index.store;
+            const DirectedGraph& graph = index.graph;
 
             cout << endl << endl;
             cout << "Base file: " << base_file << endl;
@@ -444,50 +350,17 @@ int main(int argc, char* argv[]) {
             cout << endl;
             cout << "Now the implementation of the stitched vamana algorithm is starting!" << endl;
 
-            vector<vector<float>> queries_vectors = ReadBin(query_file, 104);
-            vector<Node*> queries = createQueriesFromVectors(queries_vectors);
+            VectorStore query_store;
+            vector<Query> queries = ReadQueries(query_file, query_store, index.label_values);
 
             vector<vector<float>> groundtruth = ReadGroundTruth(groundtruth_file);
 
-            float totalRecall = 0.0;
-            int queryCount = 0;
-
-            for (size_t i = 0; i < queries.size(); i++) {
-                Node* query = queries[i];
-                vector<float>& groundTruthForQuery = groundtruth[i];
-
-                int medoid = rand() % nodes.size();
-
-                vector<Node*> nearestNeighbors;
-                if (query->distance == 0) {
-                    nearestNeighbors = GreedySearch(nodes.at(medoid), query, k, L);
-                } else {
-                    unordered_set<float> query_filter;
-                    query_filter.insert(query->filter);
-                    nearestNeighbors = FilteredGreedySearch(nodes, nodes.at(medoid), k, L, query_filter);
-                }
-
-                cout << "Nearest neighbors from GreedySearch for query " << query->id << " with type " << query->distance << ": ";
-                for (Node* neighbor : nearestNeighbors) {
-                    cout << neighbor->id << " ";
-                }
-                cout << endl;
-
-                cout << "Ground truth neighbors for query " << query->id << ": ";
-                for (int gtId : groundTruthForQuery) {
-                    cout << gtId << " ";
-                }
-                cout << endl;
-
-                float recall = computeRecall(groundTruthForQuery, nearestNeighbors);
-                totalRecall += recall;
-                queryCount++;
-
-                cout << "Recall for query " << query->id << ": " << recall << endl;
-                cout << "--------------------------------------------------" << endl;
-            }
+            // Filtered queries start from the medoid of their label, unfiltered ones from the entry points closest to them
+            BatchSearcher searcher(store, graph, nodes, index.labels, num_threads);
+            searcher.medoids = index.medoids;
+            searcher.entry_points = index.entry_points;
 
-            float averageRecall = totalRecall / queryCount;
+            float averageRecall = searchQueries(searcher, query_store, queries, groundtruth, k, L);
             cout << "Average Recall: " << averageRecall << endl;
 
             auto end = chrono::high_resolution_clock::now();
@@ -496,13 +369,6 @@ int main(int argc, char* argv[]) {
             cout << "The search from the querries is complete!" << endl;
             cout << "Time took to complete the search: " << queries_duration.count() << " seconds" << endl;
             cout << endl;
-
-            // Cleanup: free memory
-            for (Node* node : nodes) 
-                delete node;
-
-            for (Node* node : queries)
-                delete node;
         }
     }
 
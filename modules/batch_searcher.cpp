@@ -0,0 +1,81 @@
+#include "../include/vamana.h"
+
+// Queries handed out to a thread at a time
+constexpr size_t QUERY_GRAIN = 4;
+
+// Nodes of the window that a walk over a timestamp window starts from, besides the entry point
+constexpr size_t RANGE_START_NODES = 32;
+
+
+BatchSearcher::BatchSearcher(const VectorStore& store, const DirectedGraph& graph, const vector<Node*>& nodes, unsigned int num_threads)
+    : BatchSearcher(store, graph, nodes, LabelIndex(nodes), num_threads) {}
+
+BatchSearcher::BatchSearcher(const VectorStore& store, const DirectedGraph& graph, const vector<Node*>& nodes, LabelIndex labels, unsigned int num_threads)
+    : labels(move(labels)), timestamps(nodes, this->labels), store(store), graph(graph), nodes(nodes), pool(max(1u, num_threads) - 1), scratch(pool.size() + 1) {
+    // Size the scratch memory now, so the first queries do not pay for it
+    for (SearchScratch& s : scratch) {
+        s.visited.reset(graph.size());
+    }
+}
+
+vector<uint32_t> BatchSearcher::search(const VectorStore& query_store, const vector<Query>& queries, unsigned int k, unsigned int L) {
+    vector<uint32_t> results(queries.size() * k, NO_NEIGHBOR);
+    plans.assign(queries.size(), QueryPlan{});
+    query_seconds.assign(queries.size(), 0.0);
+
+    auto start = chrono::high_resolution_clock::now();
+
+    pool.parallelForSlots(0, queries.size(), [&](size_t q, size_t slot) {
+        auto query_start = chrono::high_resolution_clock::now();
+
+        const Query& query = queries[q];
+        const float* x_q = query_store.row(query.id);
+        plans[q] = planQuery(timestamps, graph, query.label < medoids.size() ? 1 : 0, query, L);
+        vector<unsigned int> neighbors = runPlan(plans[q], query, x_q, k, L, slot);
+
+        copy(neighbors.begin(), neighbors.end(), results.begin() + q * k);
+
+        query_seconds[q] = chrono::duration<float>(chrono::high_resolution_clock::now() - query_start).count();
+    }, QUERY_GRAIN);
+
+    auto end = chrono::high_resolution_clock::now();
+    search_seconds = chrono::duration<double>(end - start).count();
+
+    return results;
+}
+
+vector<unsigned int> BatchSearcher::runPlan(const QueryPlan& plan, const Query& query, const float* x_q, unsigned int k, unsigned int L, size_t slot) {
+    const SortedTimestamps& candidates = *plan.candidates;
+    size_t window = plan.last - plan.first;
+
+    if (plan.kind == PLAN_SCAN) {
+        return BruteForceSearch(store, candidates.ids.data() + plan.first, window, x_q, k, scratch[slot]);
+    }
+
+    // The walks over the nodes of the label start from its medoid
+    if (plan.kind == PLAN_FILTERED_GRAPH) {
+        vector<unsigned int> starts = {medoids[query.label]};
+        if (query.type == 1) {
+            return FilteredGreedySearch(store, graph, labels, starts, x_q, k, L, query.label, scratch[slot]);
+        }
+        return RangeGreedySearch(store, graph, nodes, labels, starts, x_q, k, plan.list_size, query.label, query.label, query.l, query.r, scratch[slot]);
+    }
+
+    // The walks over the whole graph start from the entry points closest to the query,
+    // so they do not spend their first hops crossing the graph to reach it
+    vector<unsigned int> starts = entry_points.empty() ? vector<unsigned int>{0} : closestEntryPoints(store, entry_points, x_q, ENTRY_SEEDS);
+    if (query.type == 0) {
+        return GreedySearch(store, graph, starts, x_q, k, L, scratch[slot]);
+    }
+
+    // The whole graph is walked. Besides the entry points, the walk starts from candidates spread over
+    // the window, so it also reaches the parts of the window that the graph does not connect to them.
+    for (size_t i = 0; i < RANGE_START_NODES && window > 0; i++) {
+        starts.push_back(candidates.ids[plan.first + i * window / RANGE_START_NODES]);
+    }
+
+    float l = query.type == 1 ? -numeric_limits<float>::infinity() : query.l;
+    float r = query.type == 1 ? numeric_limits<float>::infinity() : query.r;
+    uint32_t result_label = plan.kind == PLAN_POST_FILTER ? query.label : NO_LABEL;
+    return RangeGreedySearch(store, graph, nodes, labels, starts, x_q, k, plan.list_size, NO_LABEL, result_label, l, r, scratch[slot]);
+}
@@ -0,0 +1,81 @@
+#include "../include/vamana.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+constexpr size_t BIN_HEADER_BYTES = sizeof(uint32_t);
+
+
+BinReader::BinReader(const string& file_path, size_t columns, bool mapped, size_t block_rows)
+    : row_columns(columns), block_rows(max<size_t>(block_rows, 1)) {
+    int fd = ::open(file_path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return;
+    }
+
+    struct stat info;
+    uint32_t N = 0;
+    if (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < BIN_HEADER_BYTES
+        || pread(fd, &N, BIN_HEADER_BYTES, 0) != static_cast<ssize_t>(BIN_HEADER_BYTES)) {
+        ::close(fd);
+        return;
+    }
+
+    // A file that ends early is read up to its last full row
+    size_t row_bytes = columns * sizeof(float);
+    size_t full_rows = row_bytes == 0 ? 0 : (info.st_size - BIN_HEADER_BYTES) / row_bytes;
+    rows = min<size_t>(N, full_rows);
+
+    if (mapped) {
+        mapping_size = info.st_size;
+        mapping = mmap(nullptr, mapping_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mapping == MAP_FAILED) {
+            mapping = nullptr;
+            rows = 0;
+            return;
+        }
+        // The rows are read once, front to back
+        madvise(mapping, mapping_size, MADV_SEQUENTIAL);
+    } else {
+        ::close(fd);
+        ifs.open(file_path, ios::binary);
+        if (!ifs.is_open()) {
+            rows = 0;
+            return;
+        }
+        ifs.seekg(BIN_HEADER_BYTES);
+        buffer.resize(min(rows, this->block_rows) * columns);
+    }
+
+    open = true;
+}
+
+BinReader::~BinReader() {
+    if (mapping) {
+        munmap(mapping, mapping_size);
+    }
+}
+
+size_t BinReader::next(const float*& block) {
+    size_t count = min(block_rows, rows - position);
+    if (count == 0) {
+        return 0;
+    }
+
+    if (mapping) {
+        // The header is 4 bytes, so every row of the mapping is still float aligned
+        block = reinterpret_cast<const float*>(static_cast<const char*>(mapping) + BIN_HEADER_BYTES) + position * row_columns;
+    } else {
+        if (!ifs.read(reinterpret_cast<char*>(buffer.data()), count * row_columns * sizeof(float))) {
+            rows = position;
+            return 0;
+        }
+        block = buffer.data();
+    }
+
+    position += count;
+    return count;
+}
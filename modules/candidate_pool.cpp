@@ -0,0 +1,50 @@
+#include "../include/vamana.h"
+
+
+void CandidatePool::reset(size_t capacity) {
+    this->capacity = capacity;
+    candidates.clear();
+    candidates.reserve(capacity + 1);
+    cursor = 0;
+}
+
+bool CandidatePool::insert(unsigned int id, float distance) {
+    // Ties are broken by id, so the order does not depend on the insertion order
+    auto position = upper_bound(candidates.begin(), candidates.end(), make_pair(distance, id),
+                                [](const pair<float, unsigned int>& value, const Candidate& c) {
+                                    return value.first < c.distance || (value.first == c.distance && value.second < c.id);
+                                });
+    size_t index = position - candidates.begin();
+    if (index >= capacity) {
+        return false;
+    }
+
+    candidates.insert(position, {distance, id, false});
+    if (candidates.size() > capacity) {
+        candidates.pop_back();
+    }
+
+    // A new candidate before the cursor is the next one to expand
+    if (index < cursor) {
+        cursor = index;
+    }
+    return true;
+}
+
+unsigned int CandidatePool::expandNext() {
+    Candidate& next = candidates[cursor];
+    next.expanded = true;
+
+    while (cursor < candidates.size() && candidates[cursor].expanded) {
+        cursor++;
+    }
+    return next.id;
+}
+
+vector<unsigned int> CandidatePool::closest(size_t k) const {
+    vector<unsigned int> ids;
+    for (size_t i = 0; i < candidates.size() && i < k; i++) {
+        ids.push_back(candidates[i].id);
+    }
+    return ids;
+}
@@ -0,0 +1,26 @@
+#include "../include/vamana.h"
+
+
+bool DirectedGraph::hasNeighbor(unsigned int id, unsigned int neighbor) const {
+    const uint32_t* begin = neighbors(id);
+    return find(begin, begin + degree(id), neighbor) != begin + degree(id);
+}
+
+bool DirectedGraph::addNeighbor(unsigned int id, unsigned int neighbor) {
+    uint32_t* slots = row(id);
+    if (slots[0] >= R) {
+        return false;
+    }
+
+    slots[1 + slots[0]] = neighbor;
+    slots[0]++;
+    return true;
+}
+
+void DirectedGraph::setNeighbors(unsigned int id, const vector<unsigned int>& ids) {
+    uint32_t* slots = row(id);
+    uint32_t degree = min(ids.size(), static_cast<size_t>(R));
+
+    copy(ids.begin(), ids.begin() + degree, slots + 1);
+    slots[0] = degree;
+}
@@ -0,0 +1,311 @@
+#include "../include/vamana.h"
+
+#include <cstring>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Layout of a disk index file, all integers little endian:
+//
+//   header     DiskIndexHeader, padded to one sector
+//   nodes      the records of the nodes, nodes_per_sector to a sector, or node_sectors sectors to a
+//              record when one does not fit. A record is dim floats, the degree and R uint32 ids.
+//   pq         subspaces + 1 uint32 offsets, subspaces x sub_dim x PQ_CENTROIDS float centroids
+//              and count x subspaces byte codes
+//   entry points num_entry_points uint32
+//
+// The nodes and the pq sections start on a sector. A record never crosses into the next sector, so
+// a node is one read of node_sectors sectors, and the nodes of a sector come in with the same read.
+
+constexpr char DISK_INDEX_MAGIC[8] = {'V', 'A', 'M', 'A', 'N', 'A', 'D', 'K'};
+constexpr uint32_t DISK_INDEX_VERSION = 1;
+
+struct DiskIndexHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t dim;
+    uint64_t count;
+    uint32_t R;
+    uint32_t node_bytes;
+    uint32_t nodes_per_sector;
+    uint32_t node_sectors;
+    uint32_t entry_point;
+    uint32_t num_entry_points;
+    uint32_t subspaces;
+    uint32_t sub_dim;
+    uint64_t nodes_offset;
+    uint64_t pq_offset;
+    uint64_t entry_points_offset;
+    uint64_t file_size;
+};
+
+static uint64_t alignSector(uint64_t offset) {
+    return (offset + DISK_SECTOR - 1) / DISK_SECTOR * DISK_SECTOR;
+}
+
+// Record sizes, offsets and file size of an index with the counts already filled in
+static void layoutDiskIndex(DiskIndexHeader& header) {
+    header.node_bytes = (header.dim + 1 + header.R) * sizeof(uint32_t);
+    header.nodes_per_sector = max<uint32_t>(1, DISK_SECTOR / header.node_bytes);
+    header.node_sectors = alignSector(header.node_bytes) / DISK_SECTOR;
+
+    uint64_t node_reads = (header.count + header.nodes_per_sector - 1) / header.nodes_per_sector;
+    header.nodes_offset = alignSector(sizeof(DiskIndexHeader));
+    header.pq_offset = header.nodes_offset + node_reads * header.node_sectors * DISK_SECTOR;
+    header.entry_points_offset = header.pq_offset + (header.subspaces + 1) * sizeof(uint32_t)
+                                 + header.subspaces * header.sub_dim * PQ_CENTROIDS * sizeof(float) + header.count * header.subspaces;
+    header.file_size = header.entry_points_offset + header.num_entry_points * sizeof(uint32_t);
+}
+
+// Whether the record sizes, offsets and file size of the header are the ones its counts give
+static bool matchesLayout(const DiskIndexHeader& header) {
+    DiskIndexHeader expected = header;
+    layoutDiskIndex(expected);
+    return header.node_bytes == expected.node_bytes && header.nodes_per_sector == expected.nodes_per_sector
+           && header.node_sectors == expected.node_sectors && header.nodes_offset == expected.nodes_offset
+           && header.pq_offset == expected.pq_offset && header.entry_points_offset == expected.entry_points_offset
+           && header.file_size == expected.file_size;
+}
+
+// Reads exactly `bytes` at `offset`, false on an error or a short read
+static bool readAt(int fd, uint64_t offset, void* data, size_t bytes) {
+    char* out = static_cast<char*>(data);
+    while (bytes > 0) {
+        ssize_t done = pread(fd, out, bytes, offset);
+        if (done <= 0) {
+            return false;
+        }
+        out += done;
+        offset += done;
+        bytes -= done;
+    }
+    return true;
+}
+
+
+void SaveDiskIndex(const string& file_path, const VectorStore& store, const DirectedGraph& graph, const ProductQuantizer& pq, unsigned int entry_point, const vector<unsigned int>& entry_points) {
+    ofstream ofs(file_path, ios::binary | ios::trunc);
+    assert(ofs.is_open());
+    assert(pq.dim == store.dim && pq.codes.size() == store.count * pq.subspaces);
+
+    DiskIndexHeader header = {};
+    copy(begin(DISK_INDEX_MAGIC), end(DISK_INDEX_MAGIC), header.magic);
+    header.version = DISK_INDEX_VERSION;
+    header.dim = store.dim;
+    header.count = store.count;
+    header.R = graph.R;
+    header.entry_point = entry_point;
+    header.num_entry_points = entry_points.size();
+    header.subspaces = pq.subspaces;
+    header.sub_dim = pq.sub_dim;
+    layoutDiskIndex(header);
+
+    vector<char> sector(DISK_SECTOR, 0);
+    memcpy(sector.data(), &header, sizeof(header));
+    ofs.write(sector.data(), sector.size());
+
+    // One read worth of records at a time, the unused bytes of every record and sector zero
+    vector<char> block(header.node_sectors * DISK_SECTOR);
+    for (uint64_t first = 0; first < header.count; first += header.nodes_per_sector) {
+        fill(block.begin(), block.end(), 0);
+        for (uint64_t id = first; id < min<uint64_t>(header.count, first + header.nodes_per_sector); id++) {
+            char* record = block.data() + (id - first) * header.node_bytes;
+            uint32_t degree = graph.degree(id);
+            memcpy(record, store.row(id), store.dim * sizeof(float));
+            memcpy(record + store.dim * sizeof(float), &degree, sizeof(degree));
+            memcpy(record + (store.dim + 1) * sizeof(float), graph.neighbors(id), degree * sizeof(uint32_t));
+        }
+        ofs.write(block.data(), block.size());
+    }
+
+    ofs.write(reinterpret_cast<const char*>(pq.offsets.data()), pq.offsets.size() * sizeof(uint32_t));
+    ofs.write(reinterpret_cast<const char*>(pq.centroids.data()), pq.centroids.size() * sizeof(float));
+    ofs.write(reinterpret_cast<const char*>(pq.codes.data()), pq.codes.size());
+    ofs.write(reinterpret_cast<const char*>(entry_points.data()), entry_points.size() * sizeof(uint32_t));
+    ofs.close();
+
+    cout << "Disk index saved to " << file_path << endl;
+}
+
+bool OpenDiskIndex(const string& file_path, DiskIndex& index, unsigned int io_threads) {
+    int fd = open(file_path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        cerr << "Error: Failed to open disk index " << file_path << endl;
+        return false;
+    }
+
+    DiskIndexHeader header = {};
+    struct stat info;
+    bool complete = fstat(fd, &info) == 0 && readAt(fd, 0, &header, sizeof(header));
+
+    string error;
+    if (!complete) {
+        error = "too small to be a disk index";
+    } else if (!equal(begin(DISK_INDEX_MAGIC), end(DISK_INDEX_MAGIC), header.magic)) {
+        error = "not a disk index file";
+    } else if (header.version != DISK_INDEX_VERSION) {
+        error = "disk index version " + to_string(header.version) + ", expected " + to_string(DISK_INDEX_VERSION);
+    } else if (header.dim == 0 || static_cast<uint64_t>(header.dim) + header.R >= (1u << 24) || header.subspaces == 0 || header.subspaces > header.dim
+               || header.entry_point >= max<uint64_t>(header.count, 1) || !matchesLayout(header)) {
+        error = "corrupted header";
+    } else if (header.file_size > static_cast<uint64_t>(info.st_size)) {
+        error = "truncated file";
+    }
+
+    ProductQuantizer pq;
+    vector<unsigned int> entry_points(error.empty() ? header.num_entry_points : 0);
+    if (error.empty()) {
+        pq.dim = header.dim;
+        pq.subspaces = header.subspaces;
+        pq.sub_dim = header.sub_dim;
+        pq.offsets.resize(header.subspaces + 1);
+        pq.centroids.resize(header.subspaces * header.sub_dim * PQ_CENTROIDS);
+        pq.codes.resize(header.count * header.subspaces);
+
+        uint64_t offset = header.pq_offset;
+        bool read = readAt(fd, offset, pq.offsets.data(), pq.offsets.size() * sizeof(uint32_t));
+        offset += pq.offsets.size() * sizeof(uint32_t);
+        read = read && readAt(fd, offset, pq.centroids.data(), pq.centroids.size() * sizeof(float));
+        offset += pq.centroids.size() * sizeof(float);
+        read = read && readAt(fd, offset, pq.codes.data(), pq.codes.size());
+        read = read && readAt(fd, header.entry_points_offset, entry_points.data(), entry_points.size() * sizeof(uint32_t));
+
+        // The subspaces cover the dimensions in order, none longer than sub_dim
+        bool subspaces = read && pq.offsets.front() == 0 && pq.offsets.back() == header.dim;
+        for (uint32_t m = 0; m < header.subspaces && subspaces; m++) {
+            subspaces = pq.offsets[m] < pq.offsets[m + 1] && pq.offsets[m + 1] - pq.offsets[m] <= header.sub_dim;
+        }
+        if (!read) {
+            error = "truncated file";
+        } else if (!subspaces) {
+            error = "corrupted codes";
+        } else if (any_of(entry_points.begin(), entry_points.end(), [&](uint32_t id) { return id >= header.count; })) {
+            error = "corrupted entry points";
+        }
+    }
+
+    if (!error.empty()) {
+        cerr << "Error: " << file_path << ": " << error << endl;
+        close(fd);
+        return false;
+    }
+
+    // The searches read records all over the file, so read ahead would only load sectors nobody asked for
+    posix_fadvise(fd, 0, 0, POSIX_FADV_RANDOM);
+
+    if (index.fd >= 0) {
+        close(index.fd);
+    }
+    index.fd = fd;
+    index.count = header.count;
+    index.dim = header.dim;
+    index.R = header.R;
+    index.node_bytes = header.node_bytes;
+    index.nodes_per_sector = header.nodes_per_sector;
+    index.node_sectors = header.node_sectors;
+    index.nodes_offset = header.nodes_offset;
+    index.entry_point = header.entry_point;
+    index.entry_points = move(entry_points);
+    index.pq = move(pq);
+    index.l2 = distanceKernel(bestDistanceKernel(), header.dim);
+    index.io = io_threads > 0 ? make_unique<ThreadPool>(io_threads) : nullptr;
+
+    cout << "Disk index " << file_path << ": " << header.count << " points, " << header.dim << " dimensions, R = " << header.R
+         << ", " << header.nodes_per_sector << " nodes per sector" << endl;
+    return true;
+}
+
+DiskIndex::~DiskIndex() {
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+
+vector<unsigned int> DiskSearch(const DiskIndex& index, const float* x_q, unsigned int k, unsigned int list_size, unsigned int beam_width, SearchScratch& scratch) {
+    if (!x_q || index.count == 0) {
+        return {};
+    }
+    beam_width = max(1u, beam_width);
+
+    VisitedSet& unique_nodes = scratch.visited;  // Nodes that have been added to L once
+    CandidatePool& L = scratch.pool;             // Search list, by the PQ distances
+    CandidatePool& results = scratch.results;    // Nodes read so far, by their exact distances
+    unique_nodes.reset(index.count);
+    L.reset(list_size);
+    results.reset(k);
+    scratch.hops = 0;
+    scratch.reads = 0;
+
+    index.pq.distanceTable(x_q, scratch.table);
+    const float* table = scratch.table.data();
+
+    vector<unsigned int> starts = index.entry_points.empty() ? vector<unsigned int>{index.entry_point} : index.entry_points;
+    for (unsigned int s : starts) {
+        if (unique_nodes.insert(s)) {
+            L.insert(s, index.pq.distance(table, s));
+        }
+    }
+
+    size_t read_bytes = index.node_sectors * DISK_SECTOR;
+    vector<unsigned int> beam;       // nodes of the hop
+    vector<uint64_t> offsets;        // distinct reads of the hop, nodes of one sector share theirs
+    vector<size_t> slot(beam_width);  // the read of every node of the beam
+    beam.reserve(beam_width);
+    offsets.reserve(beam_width);
+
+    while (L.hasUnexpanded()) {
+        beam.clear();
+        offsets.clear();
+        while (beam.size() < beam_width && L.hasUnexpanded()) {
+            unsigned int id = L.expandNext();
+            uint64_t offset = index.readOffset(id);
+            size_t read = find(offsets.begin(), offsets.end(), offset) - offsets.begin();
+            if (read == offsets.size()) {
+                offsets.push_back(offset);
+            }
+            slot[beam.size()] = read;
+            beam.push_back(id);
+        }
+
+        // All the reads of the hop are issued before any record is looked at
+        scratch.sectors.resize(offsets.size() * read_bytes);
+        atomic<bool> failed{false};
+        auto read = [&](size_t r) {
+            if (!readAt(index.fd, offsets[r], scratch.sectors.data() + r * read_bytes, read_bytes)) {
+                failed = true;
+            }
+        };
+        if (index.io && offsets.size() > 1) {
+            index.io->parallelFor(0, offsets.size(), read);
+        } else {
+            for (size_t r = 0; r < offsets.size(); r++) {
+                read(r);
+            }
+        }
+        if (failed) {
+            throw runtime_error("Failed to read the disk index");
+        }
+        scratch.reads += offsets.size();
+        scratch.hops++;
+
+        for (size_t b = 0; b < beam.size(); b++) {
+            const char* record = scratch.sectors.data() + slot[b] * read_bytes + index.recordOffset(beam[b]);
+            const float* coords = reinterpret_cast<const float*>(record);
+            results.insert(beam[b], index.l2(coords, x_q, index.dim));
+
+            // Add the out-neighbors to L by their PQ distances, a corrupted record adds none
+            uint32_t degree;
+            memcpy(&degree, record + index.dim * sizeof(float), sizeof(degree));
+            const uint32_t* neighbors = reinterpret_cast<const uint32_t*>(record + (index.dim + 1) * sizeof(float));
+            for (uint32_t i = 0; i < min(degree, index.R); i++) {
+                unsigned int neighbor = neighbors[i];
+                if (neighbor < index.count && unique_nodes.insert(neighbor)) {
+                    L.insert(neighbor, index.pq.distance(table, neighbor));
+                }
+            }
+        }
+    }
+
+    return results.closest(k);
+}
@@ -0,0 +1,265 @@
+#include "../include/vamana.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define VAMANA_X86 1
+#endif
+
+
+// Plain loop, used when the CPU has none of the vector extensions below
+float l2_scalar(const float* a, const float* b, size_t dim) {
+    float sum = 0.0;
+    for (size_t i = 0; i < dim; ++i) {
+        float diff = a[i] - b[i];
+        sum += diff * diff;
+    }
+    return sum;
+}
+
+#ifdef VAMANA_X86
+
+// Horizontal sum of the 8 lanes
+__attribute__((target("avx2,fma")))
+static inline float horizontal_sum(__m256 sum8) {
+    __m128 sum4 = _mm_add_ps(_mm256_castps256_ps128(sum8), _mm256_extractf128_ps(sum8, 1));
+    sum4 = _mm_add_ps(sum4, _mm_movehl_ps(sum4, sum4));
+    sum4 = _mm_add_ss(sum4, _mm_shuffle_ps(sum4, sum4, 1));
+    return _mm_cvtss_f32(sum4);
+}
+
+// Horizontal sum of the 16 lanes
+__attribute__((target("avx512f")))
+static inline float horizontal_sum(__m512 sum16) {
+    alignas(64) float lanes[16];
+    _mm512_store_ps(lanes, sum16);
+    float sum = 0.0;
+    for (float lane : lanes) {
+        sum += lane;
+    }
+    return sum;
+}
+
+__attribute__((target("sse2")))
+float l2_sse(const float* a, const float* b, size_t dim) {
+    __m128 sum0 = _mm_setzero_ps();
+    __m128 sum1 = _mm_setzero_ps();
+    size_t i = 0;
+
+    for (; i + 8 <= dim; i += 8) {
+        __m128 d0 = _mm_sub_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i));
+        __m128 d1 = _mm_sub_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4));
+        sum0 = _mm_add_ps(sum0, _mm_mul_ps(d0, d0));
+        sum1 = _mm_add_ps(sum1, _mm_mul_ps(d1, d1));
+    }
+    for (; i + 4 <= dim; i += 4) {
+        __m128 d = _mm_sub_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i));
+        sum0 = _mm_add_ps(sum0, _mm_mul_ps(d, d));
+    }
+
+    alignas(16) float lanes[4];
+    _mm_store_ps(lanes, _mm_add_ps(sum0, sum1));
+    float sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+
+    for (; i < dim; ++i) {
+        float diff = a[i] - b[i];
+        sum += diff * diff;
+    }
+    return sum;
+}
+
+__attribute__((target("avx2,fma")))
+float l2_avx2(const float* a, const float* b, size_t dim) {
+    __m256 sum0 = _mm256_setzero_ps();
+    __m256 sum1 = _mm256_setzero_ps();
+    size_t i = 0;
+
+    for (; i + 16 <= dim; i += 16) {
+        __m256 d0 = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+        __m256 d1 = _mm256_sub_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8));
+        sum0 = _mm256_fmadd_ps(d0, d0, sum0);
+        sum1 = _mm256_fmadd_ps(d1, d1, sum1);
+    }
+    for (; i + 8 <= dim; i += 8) {
+        __m256 d = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+        sum0 = _mm256_fmadd_ps(d, d, sum0);
+    }
+
+    float sum = horizontal_sum(_mm256_add_ps(sum0, sum1));
+
+    for (; i < dim; ++i) {
+        float diff = a[i] - b[i];
+        sum += diff * diff;
+    }
+    return sum;
+}
+
+__attribute__((target("avx512f")))
+float l2_avx512(const float* a, const float* b, size_t dim) {
+    __m512 sum0 = _mm512_setzero_ps();
+    __m512 sum1 = _mm512_setzero_ps();
+    size_t i = 0;
+
+    for (; i + 32 <= dim; i += 32) {
+        __m512 d0 = _mm512_sub_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i));
+        __m512 d1 = _mm512_sub_ps(_mm512_loadu_ps(a + i + 16), _mm512_loadu_ps(b + i + 16));
+        sum0 = _mm512_fmadd_ps(d0, d0, sum0);
+        sum1 = _mm512_fmadd_ps(d1, d1, sum1);
+    }
+    for (; i + 16 <= dim; i += 16) {
+        __m512 d = _mm512_sub_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i));
+        sum0 = _mm512_fmadd_ps(d, d, sum0);
+    }
+
+    // The tail is handled with a masked load instead of a scalar loop
+    if (i < dim) {
+        __mmask16 mask = static_cast<__mmask16>((1u << (dim - i)) - 1);
+        __m512 d = _mm512_sub_ps(_mm512_maskz_loadu_ps(mask, a + i), _mm512_maskz_loadu_ps(mask, b + i));
+        sum1 = _mm512_fmadd_ps(d, d, sum1);
+    }
+
+    return horizontal_sum(_mm512_add_ps(sum0, sum1));
+}
+
+// Kernels for one fixed dimension. DIM is a compile time constant, so the loops unroll
+// completely and the lanes left after the last full register are a fixed mask instead of a loop.
+// They read exactly DIM floats, so they work on plain vectors as well as on padded store rows.
+template <size_t DIM>
+__attribute__((target("avx2,fma")))
+float l2_avx2_fixed(const float* a, const float* b, size_t) {
+    __m256 sum[2] = {_mm256_setzero_ps(), _mm256_setzero_ps()};
+
+#pragma GCC unroll 128
+    for (size_t i = 0; i + 8 <= DIM; i += 8) {
+        __m256 d = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+        sum[(i / 8) % 2] = _mm256_fmadd_ps(d, d, sum[(i / 8) % 2]);
+    }
+    if constexpr (DIM % 8 != 0) {
+        constexpr size_t i = DIM / 8 * 8;
+        const __m256i mask = _mm256_cmpgt_epi32(_mm256_set1_epi32(DIM % 8), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+        __m256 d = _mm256_sub_ps(_mm256_maskload_ps(a + i, mask), _mm256_maskload_ps(b + i, mask));
+        sum[1] = _mm256_fmadd_ps(d, d, sum[1]);
+    }
+
+    return horizontal_sum(_mm256_add_ps(sum[0], sum[1]));
+}
+
+template <size_t DIM>
+__attribute__((target("avx512f")))
+float l2_avx512_fixed(const float* a, const float* b, size_t) {
+    __m512 sum[2] = {_mm512_setzero_ps(), _mm512_setzero_ps()};
+
+#pragma GCC unroll 64
+    for (size_t i = 0; i + 16 <= DIM; i += 16) {
+        __m512 d = _mm512_sub_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i));
+        sum[(i / 16) % 2] = _mm512_fmadd_ps(d, d, sum[(i / 16) % 2]);
+    }
+    if constexpr (DIM % 16 != 0) {
+        constexpr size_t i = DIM / 16 * 16;
+        constexpr __mmask16 mask = static_cast<__mmask16>((1u << (DIM % 16)) - 1);
+        __m512 d = _mm512_sub_ps(_mm512_maskz_loadu_ps(mask, a + i), _mm512_maskz_loadu_ps(mask, b + i));
+        sum[1] = _mm512_fmadd_ps(d, d, sum[1]);
+    }
+
+    return horizontal_sum(_mm512_add_ps(sum[0], sum[1]));
+}
+
+// The SSE and scalar kernels are not specialised, they fall back to the runtime dimension loop
+template <size_t DIM>
+DistanceFunction fixedKernel(DistanceKernel kernel) {
+    switch (kernel) {
+        case KERNEL_AVX2:
+            return l2_avx2_fixed<DIM>;
+        case KERNEL_AVX512:
+            return l2_avx512_fixed<DIM>;
+        default:
+            return distanceKernel(kernel);
+    }
+}
+
+#endif
+
+
+bool distanceKernelSupported(DistanceKernel kernel) {
+    switch (kernel) {
+        case KERNEL_SCALAR:
+            return true;
+#ifdef VAMANA_X86
+        case KERNEL_SSE:
+            return __builtin_cpu_supports("sse2");
+        case KERNEL_AVX2:
+            return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+        case KERNEL_AVX512:
+            return __builtin_cpu_supports("avx512f");
+#endif
+        default:
+            return false;
+    }
+}
+
+DistanceFunction distanceKernel(DistanceKernel kernel) {
+    if (!distanceKernelSupported(kernel)) {
+        return nullptr;
+    }
+
+    switch (kernel) {
+#ifdef VAMANA_X86
+        case KERNEL_SSE:
+            return l2_sse;
+        case KERNEL_AVX2:
+            return l2_avx2;
+        case KERNEL_AVX512:
+            return l2_avx512;
+#endif
+        default:
+            return l2_scalar;
+    }
+}
+
+DistanceFunction distanceKernel(DistanceKernel kernel, size_t dim) {
+    if (!distanceKernelSupported(kernel)) {
+        return nullptr;
+    }
+
+#ifdef VAMANA_X86
+    switch (dim) {
+        case 96:
+            return fixedKernel<96>(kernel);
+        case 100:
+            return fixedKernel<100>(kernel);
+        case 128:
+            return fixedKernel<128>(kernel);
+        case 768:
+            return fixedKernel<768>(kernel);
+    }
+#endif
+    return distanceKernel(kernel);
+}
+
+const char* distanceKernelName(DistanceKernel kernel) {
+    switch (kernel) {
+        case KERNEL_SSE:
+            return "sse";
+        case KERNEL_AVX2:
+            return "avx2+fma";
+        case KERNEL_AVX512:
+            return "avx512";
+        default:
+            return "scalar";
+    }
+}
+
+// The widest kernel that the CPU running the program supports
+DistanceKernel bestDistanceKernel() {
+    for (DistanceKernel kernel : {KERNEL_AVX512, KERNEL_AVX2, KERNEL_SSE}) {
+        if (distanceKernelSupported(kernel)) {
+            return kernel;
+        }
+    }
+    return KERNEL_SCALAR;
+}
+
+// Starts as the scalar kernel, so it is valid even before the dispatch below runs
+DistanceFunction l2_distance = l2_scalar;
+
+// Pick the kernel once, at startup
+static const bool distance_dispatched = (l2_distance = distanceKernel(bestDistanceKernel()), true);
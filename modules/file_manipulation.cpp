@@ -1,33 +1,6 @@
 #include "../include/vamana.h"
 
 
-/// @brief Reading binary data vectors. Raw data store as a (N x dim)
-/// @param file_path file path of binary data
-/// @param data returned 2D data vectors
-vector<vector<float>> ReadBin(const string &file_path, const int num_dimensions) {
-    cout << "Reading Data: " << file_path << endl;
-    ifstream ifs;
-    ifs.open(file_path, ios::binary);
-    assert(ifs.is_open());
-    uint32_t N;  // num of points
-    ifs.read((char *)&N, sizeof(uint32_t));
-    std::vector<std::vector<float>> data(N);
-    cout << "# of points: " << N << endl;
-    vector<float> buff(num_dimensions);
-    int counter = 0;
-    while (ifs.read((char *)buff.data(), num_dimensions * sizeof(float))) {
-        vector<float> row(num_dimensions);
-        for (int d = 0; d < num_dimensions; d++) {
-            row[d] = static_cast<float>(buff[d]);
-        }
-        data[counter++] = move(row);
-    }
-    ifs.close();
-    cout << "Finish Reading Data" << endl;
-
-    return data;
-}
-
 vector<vector<float>> ReadGroundTruth(const string& file_path) {
     cout << "Reading Ground Truth: " << file_path << endl;
     ifstream ifs(file_path, ios::binary);
@@ -74,82 +47,8 @@ vector<vector<float>> ReadGroundTruth(const string& file_path) {
     return data;
 }
 
-vector<vector<float>> ReadGraph(const string &file_path) {
-    cout << "Reading Data: " << file_path << endl;
-    ifstream ifs(file_path, ios::binary);
-    assert(ifs.is_open());
-
-    uint32_t N;  // number of points
-    ifs.read((char*)&N, sizeof(uint32_t));  // Read the number of points
-    cout << "# of points: " << N << endl;
-
-    vector<vector<float>> data(N);
-
-    // Loop through the file and read all data points
-    for (uint32_t i = 0; i < N; ++i) {
-        size_t num_dimensions;  // Dimensions for the current point
-        ifs.read((char*)&num_dimensions, sizeof(size_t));  // Read dimensions for this point
-
-        cout << "Point " << i << " dimensions: " << num_dimensions << endl;
-
-        vector<float> row(num_dimensions);  // Create a row with appropriate size
-        ifs.read(reinterpret_cast<char*>(row.data()), num_dimensions * sizeof(float));  // Read data into the row
-        data[i] = move(row);  // Store the row in the data array
-    }
-
-    ifs.close();
-    cout << "Finished Reading Data" << endl;
-
-    return data;
-}
-
-vector<Node*> CreateGraph(vector<vector<float>> vectors) {
-    int i = 0;
-    vector<Node*> nodes;
-    for (vector<float> vf : vectors) {
-        Node* newNode = new Node;
-
-        newNode->id = i;
-        i++;
-
-        newNode->filter = vf.at(0);
-        
-        vector<float> coords;
-        coords.insert(coords.end(), vf.begin() + 1, vf.begin() + 101);
-        newNode->coords = coords;
-
-        nodes.push_back(newNode);
-    }
-
-    int a = 0;
-    for (vector<float> vf : vectors) {
-        int check = 0;
-        for (Node* n : nodes) {
-            if (check != a) {
-                check++;
-                continue;
-            }
-            for (size_t j = 101; j < vf.size(); j++) {
-                Node* neighbor;
-                unsigned int findID = vf.at(j);
-                for (Node* n : nodes) {
-                    if (n->id == findID) {
-                        neighbor = n;
-                        break;
-                    }
-                }
-                n->out_neighbors.push_back(neighbor);
-            }
-            break;
-        }
-        a++;
-    }
-
-    return nodes;
-}
-
-/// @brief Save the vector of nodes (created by createVectorFromNodes) to a binary file
-/// @param vectors The 2D vector containing nodes (each row representing a node)
+/// @brief Save rows of different lengths to a binary file, in the layout that ReadGroundTruth reads
+/// @param vectors The 2D vector to save
 /// @param file_path The path to the binary file
 void SaveVectorToBinary(const vector<vector<float>>& vectors, const string& file_path) {
     ofstream ofs(file_path, ios::binary);
@@ -174,57 +73,88 @@ void SaveVectorToBinary(const vector<vector<float>>& vectors, const string& file
 }
 
 
-vector<Node*> createNodesFromVectors(const vector<vector<float>>& vectors) {
-    vector<Node*> nodes;
-
-    for (size_t i = 0; i < vectors.size(); ++i) {
-        Node* newNode = new Node;
-        newNode->id = i;  // Use index as the ID
-        newNode->filter = vectors[i].at(0);
-        newNode->coords.assign(vectors[i].begin() + 2, vectors[i].end());  // Copy coordinates into the Node
-        nodes.push_back(newNode);  // Add the Node to the list
-    }
+/// @brief Stream a data file of DATA_COLUMNS columns into the store, one block of rows at a time
+/// @param file_path file path of binary data
+/// @param store the store that gets the coordinates, allocated once for the whole file
+/// @param label_values gets the filter value of every label, in the order they first appear
+vector<Node*> ReadNodes(const string& file_path, VectorStore& store, vector<float>& label_values, bool mapped) {
+    cout << "Reading Data: " << file_path << endl;
+    BinReader reader(file_path, DATA_COLUMNS, mapped);
+    assert(reader.is_open());
+    cout << "# of points: " << reader.size() << endl;
 
-    return nodes;
-}
+    // The first 2 columns are the filter and the timestamp, the rest are the coordinates
+    store = VectorStore(reader.size(), DATA_COLUMNS - 2);
 
-vector<Node*> createQueriesFromVectors(const vector<vector<float>>& vectors) {
     vector<Node*> nodes;
-
-    for (size_t i = 0; i < vectors.size(); ++i) {
-        Node* newNode = new Node;
-        newNode->id = i;  // Use index as the ID
-        newNode->distance = vectors[i].at(0);
-        if (newNode->distance == 2 || newNode->distance == 3) {
-            delete newNode;
-            continue;
+    nodes.reserve(reader.size());
+
+    // The filters are turned into dense label ids, so the searches compare integers
+    unordered_map<float, uint32_t> labels;
+    label_values.clear();
+
+    const float* block;
+    while (size_t count = reader.next(block)) {
+        for (size_t i = 0; i < count; i++) {
+            const float* row = block + i * DATA_COLUMNS;
+            unsigned int id = nodes.size();
+            copy(row + 2, row + DATA_COLUMNS, store.row(id));
+            auto [label, added] = labels.emplace(row[0], label_values.size());
+            if (added) {
+                label_values.push_back(row[0]);
+            }
+            nodes.push_back(new Node{id, label->second, row[1]});
         }
-        newNode->filter = vectors[i].at(1);
-        newNode->coords.assign(vectors[i].begin() + 4, vectors[i].end());  // Copy coordinates into the Node
-        nodes.push_back(newNode);  // Add the Node to the list
     }
 
+    // Keep only the rows that were read, if the file was cut short
+    store.count = nodes.size();
+    cout << "# of labels: " << label_values.size() << endl;
+    cout << "Finish Reading Data" << endl;
+
     return nodes;
 }
 
-vector<vector<float>> createVectorFromNodes(const vector<Node*>& nodes) {
-    vector<vector<float>> vectors;
+/// @brief Stream a query file of QUERY_COLUMNS columns into the store, one block of rows at a time
+/// @param file_path file path of binary queries
+/// @param store the store that gets the coordinates, allocated once for the whole file
+/// @param label_values the filter value of every label, as ReadNodes returned them
+vector<Query> ReadQueries(const string& file_path, VectorStore& store, const vector<float>& label_values, bool mapped) {
+    cout << "Reading Data: " << file_path << endl;
+    BinReader reader(file_path, QUERY_COLUMNS, mapped);
+    assert(reader.is_open());
+    cout << "# of points: " << reader.size() << endl;
 
-    for (Node* n : nodes) {
-        vector<float> node;
+    // The first 4 columns are the query type, the filter and the timestamp range
+    store = VectorStore(reader.size(), QUERY_COLUMNS - 4);
 
-        node.push_back(n->filter);
+    vector<Query> queries;
+    queries.reserve(reader.size());
 
-        node.insert(node.end(), n->coords.begin(), n->coords.end());
+    unordered_map<float, uint32_t> labels;
+    for (uint32_t label = 0; label < label_values.size(); label++) {
+        labels.emplace(label_values[label], label);
+    }
 
-        vector<float> neighbor_ids;
-        for (Node* neighbor : n->out_neighbors) {
-            neighbor_ids.push_back(static_cast<float>(neighbor->id));
+    const float* block;
+    while (size_t count = reader.next(block)) {
+        for (size_t i = 0; i < count; i++) {
+            const float* row = block + i * QUERY_COLUMNS;
+            Query query;
+            query.id = queries.size();  // Use the row in the query store as the ID
+            query.type = static_cast<int>(row[0]);
+            auto label = labels.find(row[1]);
+            query.label = label == labels.end() ? NO_LABEL : label->second;
+            query.l = row[2];
+            query.r = row[3];
+            copy(row + 4, row + QUERY_COLUMNS, store.row(query.id));
+            queries.push_back(query);
         }
-        node.insert(node.end(), neighbor_ids.begin(), neighbor_ids.end());
-
-        vectors.push_back(node);
     }
 
-    return vectors;
+    // Keep only the rows that were read, if the file was cut short
+    store.count = queries.size();
+    cout << "Finish Reading Data" << endl;
+
+    return queries;
 }
@@ -2,80 +2,82 @@
 #include "../include/vamana.h"
 
 
-vector<Node*> FilteredGreedySearch(const vector<Node*>& start_nodes, const Node* x_q, unsigned int k, unsigned int list_size, const unordered_set<float>& query_filter) {
-    if (start_nodes.empty()) {
-        return {}; // Επιστροφή κενής λίστας αν δεν υπάρχουν αρχικοί κόμβοι
-    }
+// Αναζήτηση μόνο μέσα από τους κόμβους που περνούν το φίλτρο. Αφήνει τους `list_size` πλησιέστερους
+// στο scratch.pool. distance(id) είναι η απόσταση του κόμβου id από το ερώτημα.
+template <class Distance>
+static void filteredWalk(const DirectedGraph& graph, const LabelIndex& labels, const vector<unsigned int>& start_nodes, unsigned int list_size, const LabelFilter& filter, SearchScratch& scratch, Distance distance) {
+    VisitedSet& unique_nodes = scratch.visited;  // Κόμβοι που έχουν μπει μία φορά στη λίστα
+    CandidatePool& L = scratch.pool;             // Λίστα αναζήτησης, ταξινομημένη κατά απόσταση
+    unique_nodes.reset(graph.size());
+    L.reset(list_size);
 
-    unordered_set<Node*> V; // Σύνολο επισκεφθέντων κόμβων
-    vector<Node*> L;        // Λίστα αναζήτησης
-    
     // Προσθήκη των αρχικών κόμβων που ικανοποιούν το φίλτρο
-    for (Node* s : start_nodes) {
-        if (query_filter.find(s->filter) != query_filter.end()) {
-            L.push_back(s);
+    for (unsigned int s : start_nodes) {
+        if (labels.matches(s, filter) && unique_nodes.insert(s)) {
+            L.insert(s, distance(s));
         }
     }
 
-    // Χάρτης για αποθήκευση αποστάσεων
-    unordered_map<Node*, float> distances;
-
     // Βρόχος αναζήτησης
-    while (any_of(L.begin(), L.end(), [&](Node* p) { return V.find(p) == V.end(); })) {
-        Node* p_star = nullptr;
-        float min_distance = numeric_limits<double>::max();
+    while (L.hasUnexpanded()) {
+        // Επίσκεψη του πλησιέστερου μη επισκεφθέντος κόμβου
+        unsigned int p_star = L.expandNext();
 
-        // Εύρεση του πλησιέστερου μη επισκεφθέντος κόμβου
-        for (Node* p : L) {
-            if (V.find(p) == V.end()) {
-                if (distances.find(p) == distances.end()) {
-                    distances[p] = euclidean(p, x_q); // Υπολογισμός απόστασης
-                }
-                float distance = distances[p];
-                if (distance < min_distance) {
-                    min_distance = distance;
-                    p_star = p;
-                }
+        // Φιλτράρισμα γειτόνων με βάση τις ετικέτες, μία λέξη του bitset ανά λέξη του φίλτρου
+        const uint32_t* neighbors = graph.neighbors(p_star);
+        for (uint32_t i = 0; i < graph.degree(p_star); i++) {
+            unsigned int neighbor = neighbors[i];
+            if (labels.matches(neighbor, filter) && unique_nodes.insert(neighbor)) {
+                L.insert(neighbor, distance(neighbor));
             }
         }
+    }
+}
 
-        if (p_star) {
-            V.insert(p_star); // Σήμανση του κόμβου ως επισκεφθέντος
+vector<unsigned int> FilteredGreedySearch(const VectorStore& store, const DirectedGraph& graph, const LabelIndex& labels, const vector<unsigned int>& start_nodes, const float* x_q, unsigned int k, unsigned int list_size, const LabelFilter& filter, SearchScratch& scratch) {
+    if (start_nodes.empty() || !x_q) {
+        return {}; // Επιστροφή κενής λίστας αν δεν υπάρχουν αρχικοί κόμβοι
+    }
 
-            // Φιλτράρισμα γειτόνων με βάση τις ετικέτες
-            for (Node* neighbor : p_star->out_neighbors) {
-                if (V.find(neighbor) == V.end() &&
-                    query_filter.find(neighbor->filter) != query_filter.end()) {
-                    L.push_back(neighbor);
-                }
-            }
+    filteredWalk(graph, labels, start_nodes, list_size, filter, scratch, [&](unsigned int id) {
+        return euclidean(store, store.row(id), x_q);
+    });
 
+    // Διατήρηση μόνο των k πλησιέστερων κόμβων
+    return scratch.pool.closest(k);
+}
 
-            // Διατήρηση του μεγέθους της λίστας στο όριο list_size
-            if (L.size() > list_size) {
-                nth_element(L.begin(), L.begin() + list_size, L.end(), [&](Node* a, Node* b) {
-                    return euclidean(a, x_q) < euclidean(b, x_q);
-                });
-                L.resize(list_size);
-            }
-        } else {
-            break; // Τερματισμός αν δεν υπάρχουν επιλέξιμοι κόμβοι
-        }
+vector<unsigned int> FilteredGreedySearch(const VectorStore& store, const DirectedGraph& graph, const LabelIndex& labels, const vector<unsigned int>& start_nodes, const float* x_q, unsigned int k, unsigned int list_size, const LabelFilter& filter) {
+    // Επαναχρησιμοποιείται από όλες τις αναζητήσεις του νήματος
+    static thread_local SearchScratch scratch;
+    return FilteredGreedySearch(store, graph, labels, start_nodes, x_q, k, list_size, filter, scratch);
+}
+
+vector<unsigned int> FilteredGreedySearch(const VectorStore& store, const ProductQuantizer& pq, const DirectedGraph& graph, const LabelIndex& labels, const vector<unsigned int>& start_nodes, const float* x_q, unsigned int k, unsigned int list_size, const LabelFilter& filter, SearchScratch& scratch) {
+    if (start_nodes.empty() || !x_q) {
+        return {};
     }
 
-    // Χρήση unordered_set για αφαίρεση διπλοτύπων
-    unordered_set<Node*> unique_nodes(L.begin(), L.end());
+    // Ο πίνακας αποστάσεων υπολογίζεται μία φορά ανά ερώτημα
+    pq.distanceTable(x_q, scratch.table);
+    const float* table = scratch.table.data();
+    filteredWalk(graph, labels, start_nodes, list_size, filter, scratch, [&](unsigned int id) {
+        return pq.distance(table, id);
+    });
 
-    // Μετατροπή πίσω σε vector
-    L.assign(unique_nodes.begin(), unique_nodes.end());
+    // Επαναταξινόμηση της λίστας με τις ακριβείς αποστάσεις
+    return rerankExact(store, scratch.pool, x_q, k, scratch.results);
+}
 
-    // Διατήρηση μόνο των k πλησιέστερων κόμβων
-    if (L.size() > k) {
-        nth_element(L.begin(), L.begin() + k, L.end(), [&](Node* a, Node* b) {
-            return euclidean(a, x_q) < euclidean(b, x_q);
-        });
-        L.resize(k);
+vector<unsigned int> FilteredGreedySearch(const ScalarQuantizedStore& codes, const DirectedGraph& graph, const LabelIndex& labels, const vector<unsigned int>& start_nodes, const float* x_q, unsigned int k, unsigned int list_size, const LabelFilter& filter, SearchScratch& scratch, const VectorStore* exact) {
+    if (start_nodes.empty() || !x_q) {
+        return {};
     }
 
-    return L;
+    filteredWalk(graph, labels, start_nodes, list_size, filter, scratch, [&](unsigned int id) {
+        return codes.distance(x_q, id);
+    });
+
+    // Επαναταξινόμηση με τις ακριβείς αποστάσεις, αν υπάρχουν
+    return exact ? rerankExact(*exact, scratch.pool, x_q, k, scratch.results) : scratch.pool.closest(k);
 }
@@ -1,68 +1,75 @@
 #include "../include/vamana.h"
 
 
-void FilteredRobustPrune(Node* node, vector<Node*> possible_neighbours, float a, int max_neighbours) {
+void FilteredRobustPrune(const VectorStore& store, DirectedGraph& graph, const LabelIndex& labels, unsigned int p, vector<unsigned int> possible_neighbours, float a, int max_neighbours) {
     // Use an unordered_set to track unique node IDs
-    std::unordered_set<int> unique_ids;
+    std::unordered_set<unsigned int> unique_ids;
 
     // Add the IDs of the initial possible neighbors
-    for (Node* n_ptr : possible_neighbours) {
-        unique_ids.insert(n_ptr->id);
+    for (unsigned int n : possible_neighbours) {
+        unique_ids.insert(n);
     }
 
     // Add the existing neighbors to the possible neighbors, avoiding duplicates
-    for (Node* n_ptr : node->out_neighbors) {
-        if (unique_ids.find(n_ptr->id) == unique_ids.end()) {
-            possible_neighbours.push_back(n_ptr);
-            unique_ids.insert(n_ptr->id); // Mark as added
+    const uint32_t* neighbors = graph.neighbors(p);
+    for (uint32_t i = 0; i < graph.degree(p); i++) {
+        if (unique_ids.find(neighbors[i]) == unique_ids.end()) {
+            possible_neighbours.push_back(neighbors[i]);
+            unique_ids.insert(neighbors[i]); // Mark as added
         }
     }
 
     for (auto it = possible_neighbours.begin(); it != possible_neighbours.end(); ) {
-        if ((*it)->id == node->id) {
+        if (*it == p) {
             it = possible_neighbours.erase(it);  // Erase and move the iterator to the next element
         } else {
             ++it;  // Only increment the iterator if no element was erased
         }
     }
 
-    // Clear node's neighbors
-    node->out_neighbors.clear();
-
-    // Calculate distances to possible neighbors
-    for (Node* n : possible_neighbours) {
-        n->distance = euclidean(node, n);
+    // Calculate distances to possible neighbors as (distance, id) pairs
+    vector<pair<float, unsigned int>> candidates;
+    candidates.reserve(possible_neighbours.size());
+    for (unsigned int n : possible_neighbours) {
+        candidates.emplace_back(euclidean(store, store.row(p), store.row(n)), n);
     }
 
-    // Sort possible neighbors by distance
-    sort(possible_neighbours.begin(), possible_neighbours.end(), compare_distance);
+    // Sort possible neighbors by distance, then by id
+    sort(candidates.begin(), candidates.end());
+
+    size_t limit = min(static_cast<size_t>(max_neighbours), static_cast<size_t>(graph.R));
+    vector<unsigned int> out_neighbors;
 
     // Select closest neighbors with pruning
     // Iterate through the possible neighbors until empty or reach maxinum neighbors
-    while (!possible_neighbours.empty()) {
-        Node* closest = possible_neighbours.front();
+    while (!candidates.empty() && out_neighbors.size() < limit) {
+        unsigned int closest = candidates.front().second;
 
         // Add the node to the neighbours of the node and remove it from the possible ones
-        node->out_neighbors.push_back(closest);
-        possible_neighbours.erase(possible_neighbours.begin());
+        out_neighbors.push_back(closest);
+        candidates.erase(candidates.begin());
 
-        if (node->out_neighbors.size() == static_cast<size_t>(max_neighbours)) {
+        if (out_neighbors.size() == limit) {
             break;
         }
 
         // Pruning method
-        auto it = possible_neighbours.begin();
-        while (it != possible_neighbours.end()) {
-            if (node->filter != closest->filter && (*it)->filter != closest->filter) {
+        auto it = candidates.begin();
+        while (it != candidates.end()) {
+            // The closest node only prunes the nodes it shares a label with, or all of them if it shares one with p,
+            // and never a node that has a label in common with p which the closest node does not have
+            if ((!labels.shares(p, closest) && !labels.shares(it->second, closest)) || !labels.covers(p, it->second, closest)) {
                 ++it;
                 continue;
             }
-            float pruning = a * euclidean(closest, *it); 
-            if (pruning <= (*it)->distance) {
-                it = possible_neighbours.erase(it);
+            float pruning = a * euclidean(store, store.row(closest), store.row(it->second)); 
+            if (pruning <= it->first) {
+                it = candidates.erase(it);
             } else {
                 ++it;
             }
         }
     }
-}
\ No newline at end of file
+
+    graph.setNeighbors(p, out_neighbors);
+}
@@ -27,74 +27,64 @@ void fisherYatesShuffle(vector<Node*>& databasePoints) {
 }
 
 //Filtered Vamana
-DirectedGraph FilteredVamana(vector<Node*>& databasePoints,int k, unsigned int L, unsigned int R, float alpha, unsigned int tau) {
+DirectedGraph FilteredVamana(const VectorStore& store, vector<Node*>& databasePoints,int k, unsigned int L, unsigned int R, float alpha, unsigned int tau) {
+    return FilteredVamana(store, databasePoints, LabelIndex(databasePoints), k, L, R, alpha, tau);
+}
+
+DirectedGraph FilteredVamana(const VectorStore& store, vector<Node*>& databasePoints, const LabelIndex& labels, int k, unsigned int L, unsigned int R, float alpha, unsigned int tau) {
     //Initialize Graph
-    DirectedGraph G;
+    DirectedGraph G(store.count, R);
     
-    //find medoids for every filter
-    unordered_map<float, unsigned int> medoids = findmedoid(databasePoints, tau);
-
-    // Create initial structures
-    for (Node* point : databasePoints) {
-        G.adjacency_list[point]= unordered_set<Node*>();
-    }
+    //find medoids for every label
+    vector<unsigned int> medoids = findmedoid(labels, tau);
 
     // **Add random edges between vertices** 
+    // Shuffle a copy, databasePoints has to stay indexed by id
+    vector<Node*> shuffled = databasePoints;
     for (Node* point : databasePoints) {
-        fisherYatesShuffle(databasePoints);
+        fisherYatesShuffle(shuffled);
 
         // Add up to R random neighbors to the adjacency list
-        for (size_t i = 0; i < min(R, (unsigned int)databasePoints.size()); ++i) {
-            if (databasePoints[i] != point && G.adjacency_list[point].size() < R) { // Avoid self-loops
-                G.adjacency_list[point].insert(databasePoints[i]);
+        for (size_t i = 0; i < min(R, (unsigned int)shuffled.size()); ++i) {
+            if (shuffled[i] != point) { // Avoid self-loops
+                G.addNeighbor(point->id, shuffled[i]->id);
             }
         }
     }
 
     // Iterate over the points
-    for (Node* point : databasePoints) {
+    for (Node* point : shuffled) {
         //Define S_{F_x} as the start nodes for filtering
-        vector<Node*> S_Fx; //Using the medoid as st(f)
-
-        // Add medoids corresponding to the filter of the point
-        float filter = point->filter;
-        if (medoids.find(filter) != medoids.end()) {
-            unsigned int medoid_id = medoids[filter];
-            auto it = find_if(databasePoints.begin(), databasePoints.end(),[&](Node* n) { return n->id == medoid_id; });
-            if (it != databasePoints.end()) {
-                S_Fx.push_back(*it);  
-            }
-        }
+        vector<unsigned int> S_Fx; //Using the medoid as st(f)
 
-        //FilteredGreedySearch
-        unordered_set<float> query_filter = {point->filter};
-        vector<Node*> V_Fx = FilteredGreedySearch(S_Fx, point, 0, L, query_filter);
-        
-        // Add the out-neighbors to the node's `out_neighbors`
-        for (Node* neighbor : V_Fx) {
-            point->out_neighbors.push_back(neighbor);
+        // Add the medoid of every label of the point
+        const uint32_t* first = labels.labelsBegin(point->id);
+        const uint32_t* last = labels.labelsEnd(point->id);
+        for (const uint32_t* label = first; label != last; label++) {
+            S_Fx.push_back(medoids[*label]);
         }
 
-        //FilteredRobustPrune
-        FilteredRobustPrune(point, V_Fx, alpha, R);
+        //FilteredGreedySearch through the points that share any label with the point,
+        //the whole search list of L nodes is the candidate set of the prune
+        LabelFilter F_x(vector<uint32_t>(first, last), MATCH_ANY);
+        vector<unsigned int> V_Fx = FilteredGreedySearch(store, G, labels, S_Fx, store.row(point->id), L, L, F_x);
 
-        // Add these neighbors to the graph
-        for (Node* neighbor : V_Fx) {
-            G.adjacency_list[point].insert(neighbor);
-        }
+        //FilteredRobustPrune, the existing out-neighbors of the point are candidates as well
+        FilteredRobustPrune(store, G, labels, point->id, V_Fx, alpha, R);
 
         //Update neighbors for each out-neighbor
-        for (Node* neighbor : G.adjacency_list[point]) {//Here i use the DirectedGraph struct(instead of node->out_neighbors)
-            G.adjacency_list[neighbor].insert(point);
+        vector<unsigned int> out_neighbors(G.neighbors(point->id), G.neighbors(point->id) + G.degree(point->id));
+        for (unsigned int neighbor : out_neighbors) {
+            if (G.hasNeighbor(neighbor, point->id)) {
+                continue;
+            }
 
             // Check if the out-degree > R
-            if (G.adjacency_list[neighbor].size() > R) {
-                vector<Node*> neighborList(G.adjacency_list[neighbor].begin(), G.adjacency_list[neighbor].end());
-                FilteredRobustPrune(neighbor, neighborList, alpha, R);
-                G.adjacency_list[neighbor] = unordered_set<Node*>(neighborList.begin(), neighborList.end());
+            if (!G.addNeighbor(neighbor, point->id)) {
+                FilteredRobustPrune(store, G, labels, neighbor, {point->id}, alpha, R);
             }
         }
     }
 
     return G;
-}
\ No newline at end of file
+}
@@ -1,47 +1,34 @@
 #include "../include/vamana.h"
 
-// FindMedoid implementation
-unordered_map<float,  unsigned int> findmedoid(const vector<Node*>& P, unsigned int tau) {
-    unordered_map<float,  unsigned int> M; // Map of filters to medoids
-    unordered_map< unsigned int, unsigned int> T; // Counter for visits to each node
-    unordered_set<float> all_filters;
-
-    // Initialize T with zeros for all points
-    for (const auto& node : P) {
-        T[node->id] = 0;
-        all_filters.insert(node->filter); 
-    }
+// FindMedoid implementation, one pass over the members of every label
+vector<unsigned int> findmedoid(const LabelIndex& labels, unsigned int tau) {
+    vector<unsigned int> M(labels.size()); // Medoid of every label
+    vector<unsigned int> T(labels.nodeCount(), 0); // Counter for visits to each node
 
     // Random engine for sampling
     random_device rd;
     mt19937 gen(rd());
 
+    vector<unsigned int> R_f;
 
+    // Process each label
+    for (uint32_t f = 0; f < labels.size(); f++) {
+        // Points matching label f, the slice of the label in the index
+        const uint32_t* P_f = labels.begin(f);
+        size_t count = labels.count(f);
 
-    // Process each filter
-    for (const auto& f : all_filters) {
-        vector<unsigned int> P_f; // Points matching filter f
-
-        // Collect all points matching the current filter
-        for (const auto& node : P) {
-            if (fabs(node->filter - f) < EPSILON) { 
-                P_f.push_back(node->id);
-            }
-        }
-
-        if (P_f.empty()) {
-            cerr << "Warning: No points found for filter: " << f << endl;
-            continue; // Skip if no points match the filter
+        if (count == 0) {
+            cerr << "Warning: No points found for label: " << f << endl;
+            continue; // Skip if no points match the label
         }
 
-        // Randomly sample τ points from P_f
-        vector<unsigned int> R_f;
-        if (P_f.size() <= tau) {
-            R_f = P_f; // If P_f has fewer than τ points, use them all
-        } else {
-            // Randomly select τ points
-            shuffle(P_f.begin(), P_f.end(), gen);
-            R_f.assign(P_f.begin(), P_f.begin() + tau);
+        // Randomly sample τ points from P_f, at least one, reservoir sampling keeps the slice untouched
+        R_f.assign(P_f, P_f + min<size_t>(count, max(tau, 1u)));
+        for (size_t i = R_f.size(); i < count; i++) {
+            size_t j = uniform_int_distribution<size_t>(0, i)(gen);
+            if (j < R_f.size()) {
+                R_f[j] = P_f[i];
+            }
         }
 
         // Find the point with the minimum count in T
@@ -57,4 +44,4 @@ unordered_map<float,  unsigned int> findmedoid(const vector<Node*>& P, unsigned
     }
 
     return M;
-}
\ No newline at end of file
+}
@@ -1,63 +1,179 @@
 #include "../include/vamana.h"
 
-// GreedySearch αλγόριθμος
-vector<Node*> GreedySearch(Node* s, const Node* x_q, unsigned int k, unsigned int list_size) {
-    if (!s) {
-        return {}; // Return an empty result if the starting node is null
-    }
+// GreedySearch αλγόριθμος, από τους κόμβους starts[0 .. start_count). Leaves the closest `list_size`
+// nodes found in scratch.pool. distance(id) is the distance of node id to the query, on whatever
+// vectors the search runs on.
+template <class Distance>
+static void walk(const DirectedGraph& graph, const unsigned int* starts, size_t start_count, unsigned int list_size, SearchScratch& scratch, Distance distance) {
+    VisitedSet& unique_nodes = scratch.visited;  // Nodes that have been added to L once
+    CandidatePool& L = scratch.pool;             // Search list, the closest `list_size` nodes found so far
+    unique_nodes.reset(graph.size());
+    L.reset(list_size);
+    scratch.hops = 0;
+    scratch.distances = 0;
 
-    unordered_set<Node*> V;  // Visited nodes
-    unordered_set<Node*> unique_nodes; // Ensure unique nodes in the result
-    vector<Node*> L = {s};   // Start with the initial node in the search list
+    // Start with the initial nodes in the search list
+    for (size_t i = 0; i < start_count; i++) {
+        if (starts[i] < graph.size() && unique_nodes.insert(starts[i])) {
+            L.insert(starts[i], distance(starts[i]));
+            scratch.distances++;
+        }
+    }
 
-    // Priority queue for efficiently finding the closest unvisited node
-    using NodeDistPair = pair<double, Node*>;
-    priority_queue<NodeDistPair, vector<NodeDistPair>, greater<>> pq;
+    while (L.hasUnexpanded()) {
+        // Visit the closest unvisited node
+        unsigned int p_star = L.expandNext();
+        scratch.hops++;
 
-    // Prepopulate the priority queue with the starting node
-    pq.emplace(euclidean(s, x_q), s);
+        // Add out-neighbors of `p_star` to `L`, each one only once
+        const uint32_t* neighbors = graph.neighbors(p_star);
+        for (uint32_t i = 0; i < graph.degree(p_star); i++) {
+            unsigned int neighbor = neighbors[i];
+            if (unique_nodes.insert(neighbor)) {
+                L.insert(neighbor, distance(neighbor));
+                scratch.distances++;
+            }
+        }
+    }
+}
 
-    while (any_of(L.begin(), L.end(), [&](Node* p) { return V.find(p) == V.end(); })) {
-        // Find the closest unvisited node
-        auto top = pq.top();
-        Node* p_star = top.second;
-        pq.pop();
+// Same as walk, expanding the beam_width closest unexpanded nodes per hop. The unvisited neighbors of
+// the whole beam are collected before any of their distances. With prefetch_ahead = 0 prefetch(id)
+// is called on each as it is collected, else on the neighbor prefetch_ahead entries ahead of the
+// distance being computed, so only a few lines are in flight at a time.
+template <class Distance, class Prefetch>
+static void beamWalk(const DirectedGraph& graph, const unsigned int* starts, size_t start_count, unsigned int list_size, unsigned int beam_width, unsigned int prefetch_ahead, SearchScratch& scratch, Distance distance, Prefetch prefetch) {
+    VisitedSet& unique_nodes = scratch.visited;
+    CandidatePool& L = scratch.pool;
+    vector<unsigned int>& pending = scratch.pending;
+    unique_nodes.reset(graph.size());
+    L.reset(list_size);
+    scratch.hops = 0;
+    scratch.distances = 0;
 
-        // Skip if already visited
-        if (V.find(p_star) != V.end()) {
-            continue;
+    for (size_t i = 0; i < start_count; i++) {
+        if (starts[i] < graph.size() && unique_nodes.insert(starts[i])) {
+            L.insert(starts[i], distance(starts[i]));
+            scratch.distances++;
         }
+    }
 
-        // Mark the node as visited
-        V.insert(p_star);
+    while (L.hasUnexpanded()) {
+        pending.clear();
+        for (unsigned int w = 0; w < beam_width && L.hasUnexpanded(); w++) {
+            unsigned int p_star = L.expandNext();
+            const uint32_t* neighbors = graph.neighbors(p_star);
+            for (uint32_t i = 0; i < graph.degree(p_star); i++) {
+                if (unique_nodes.insert(neighbors[i])) {
+                    pending.push_back(neighbors[i]);
+                    if (prefetch_ahead == 0) {
+                        prefetch(neighbors[i]);
+                    }
+                }
+            }
+        }
+        scratch.hops++;
 
-        // Add out-neighbors of `p_star` to `L` if not visited
-        for (Node* neighbor : p_star->out_neighbors) {
-            if (V.find(neighbor) == V.end() && unique_nodes.find(neighbor) == unique_nodes.end()) {
-                L.push_back(neighbor);
-                unique_nodes.insert(neighbor); // Mark as unique
-                pq.emplace(euclidean(neighbor, x_q), neighbor); // Add to priority queue
+        size_t ahead = prefetch_ahead;
+        for (size_t i = 0; i < min(ahead, pending.size()); i++) {
+            prefetch(pending[i]);
+        }
+        for (size_t i = 0; i < pending.size(); i++) {
+            if (ahead > 0 && i + ahead < pending.size()) {
+                prefetch(pending[i + ahead]);
             }
+            L.insert(pending[i], distance(pending[i]));
         }
+        scratch.distances += pending.size();
+    }
+}
+
+static vector<unsigned int> greedySearch(const VectorStore& store, const DirectedGraph& graph, const unsigned int* starts, size_t start_count, const float* x_q, unsigned int k, unsigned int list_size, SearchScratch& scratch) {
+    walk(graph, starts, start_count, list_size, scratch, [&](unsigned int id) {
+        return euclidean(store, store.row(id), x_q);
+    });
+    return scratch.pool.closest(k); // Return the `k` closest unique points from `L`
+}
+
+vector<unsigned int> GreedySearch(const VectorStore& store, const DirectedGraph& graph, unsigned int s, const float* x_q, unsigned int k, unsigned int list_size, SearchScratch& scratch) {
+    if (s >= graph.size() || !x_q) {
+        return {}; // Return an empty result if the starting node is not in the graph
+    }
+    return greedySearch(store, graph, &s, 1, x_q, k, list_size, scratch);
+}
 
-        // If L exceeds the allowed size, retain only the closest `list_size` points
-        if (L.size() > list_size) {
-            nth_element(L.begin(), L.begin() + list_size, L.end(),
-                        [&](Node* a, Node* b) {
-                            return euclidean(a, x_q) < euclidean(b, x_q);
-                        });
-            L.resize(list_size);
+vector<unsigned int> GreedySearch(const VectorStore& store, const DirectedGraph& graph, unsigned int s, const float* x_q, unsigned int k, unsigned int list_size) {
+    // Reused by every search of this thread, so no query allocates it
+    static thread_local SearchScratch scratch;
+    return GreedySearch(store, graph, s, x_q, k, list_size, scratch);
+}
+
+vector<unsigned int> GreedySearch(const VectorStore& store, const DirectedGraph& graph, const vector<unsigned int>& start_nodes, const float* x_q, unsigned int k, unsigned int list_size, SearchScratch& scratch, unsigned int beam_width, unsigned int prefetch_ahead) {
+    if (!x_q) {
+        return {};
+    }
+    if (beam_width <= 1 && prefetch_ahead == 0) {
+        return greedySearch(store, graph, start_nodes.data(), start_nodes.size(), x_q, k, list_size, scratch);
+    }
+
+    // Every line of the coordinates, and the line of the adjacency row with the degree and the first
+    // neighbors, which the walk reads if it expands the node later
+    size_t row_bytes = store.dim * sizeof(float);
+    beamWalk(graph, start_nodes.data(), start_nodes.size(), list_size, max(1u, beam_width), prefetch_ahead, scratch, [&](unsigned int id) {
+        return euclidean(store, store.row(id), x_q);
+    }, [&](unsigned int id) {
+        const char* coords = reinterpret_cast<const char*>(store.row(id));
+        for (size_t line = 0; line < row_bytes; line += 64) {
+            __builtin_prefetch(coords + line);
         }
+        __builtin_prefetch(graph.row(id));
+    });
+    return scratch.pool.closest(k);
+}
+
+// The entry points are few, a few dozen at most, so they are scanned with the kernel of the store
+// and the closest are picked with a partial sort
+vector<unsigned int> closestEntryPoints(const VectorStore& store, const vector<unsigned int>& entry_points, const float* x_q, unsigned int count) {
+    vector<pair<float, unsigned int>> distances;
+    distances.reserve(entry_points.size());
+    for (unsigned int id : entry_points) {
+        distances.emplace_back(euclidean(store, store.row(id), x_q), id);
     }
 
-    // Extract the closest `k` nodes from L
-    if (L.size() > k) {
-        nth_element(L.begin(), L.begin() + k, L.end(),
-                    [&](Node* a, Node* b) {
-                        return euclidean(a, x_q) < euclidean(b, x_q);
-                    });
-        L.resize(k);
+    count = min<size_t>(count, distances.size());
+    partial_sort(distances.begin(), distances.begin() + count, distances.end());
+
+    vector<unsigned int> closest(count);
+    for (unsigned int i = 0; i < count; i++) {
+        closest[i] = distances[i].second;
     }
+    return closest;
+}
+
+vector<unsigned int> GreedySearch(const VectorStore& store, const ProductQuantizer& pq, const DirectedGraph& graph, const vector<unsigned int>& start_nodes, const float* x_q, unsigned int k, unsigned int list_size, SearchScratch& scratch) {
+    if (!x_q) {
+        return {};
+    }
+
+    // One table per query, every distance of the walk is then `subspaces` lookups
+    pq.distanceTable(x_q, scratch.table);
+    const float* table = scratch.table.data();
+    walk(graph, start_nodes.data(), start_nodes.size(), list_size, scratch, [&](unsigned int id) {
+        return pq.distance(table, id);
+    });
+
+    // Only the search list is read at full precision
+    return rerankExact(store, scratch.pool, x_q, k, scratch.results);
+}
+
+vector<unsigned int> GreedySearch(const ScalarQuantizedStore& codes, const DirectedGraph& graph, const vector<unsigned int>& start_nodes, const float* x_q, unsigned int k, unsigned int list_size, SearchScratch& scratch, const VectorStore* exact) {
+    if (!x_q) {
+        return {};
+    }
+
+    walk(graph, start_nodes.data(), start_nodes.size(), list_size, scratch, [&](unsigned int id) {
+        return codes.distance(x_q, id);
+    });
 
-    return L; // Return the `k` closest unique points from `L`
+    return exact ? rerankExact(*exact, scratch.pool, x_q, k, scratch.results) : scratch.pool.closest(k);
 }
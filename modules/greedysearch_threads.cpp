@@ -1,65 +1,56 @@
 #include "../include/vamana.h"
 
-mutex distance_mutex; // Definition here
+void calculate_distances_parallel(const VectorStore& store, const float* x_q, const vector<unsigned int>& nodes, unordered_map<unsigned int, double>& distances) {
+    // Computed in parallel into separate slots, then stored in the map by this thread alone
+    vector<double> computed(nodes.size());
+    ThreadPool::instance().parallelFor(0, nodes.size(), [&](size_t j) {
+        computed[j] = euclidean(store, store.row(nodes[j]), x_q);
+    }, DISTANCE_GRAIN);
 
-void calculate_distances_parallel(const Node* x_q, const vector<Node*>& nodes, unordered_map<Node*, double>& distances) {
-   vector<thread> threads;
-    size_t num_threads =thread::hardware_concurrency();
-    size_t chunk_size = nodes.size() / num_threads;
-
-    for (size_t i = 0; i < num_threads; ++i) {
-        threads.emplace_back([&, i]() {
-            size_t start = i * chunk_size;
-            size_t end = (i == num_threads - 1) ? nodes.size() : (i + 1) * chunk_size;
-
-            for (size_t j = start; j < end; ++j) {
-                double dist = euclidean(nodes[j], x_q);
-               lock_guard<mutex> lock(distance_mutex);
-                distances[nodes[j]] = dist;
-            }
-        });
-    }
-
-    for (auto& thread : threads) {
-        thread.join();
+    for (size_t j = 0; j < nodes.size(); ++j) {
+        distances[nodes[j]] = computed[j];
     }
 }
 
 // Parallel GreedySearch
-vector<Node*> GreedySearchaaaa(Node* s, const Node* x_q, unsigned int k, unsigned int list_size) {
-    if (!s) return {};
+vector<unsigned int> GreedySearchaaaa(const VectorStore& store, const DirectedGraph& graph, unsigned int s, const float* x_q, unsigned int k, unsigned int list_size) {
+    if (s >= graph.size() || !x_q) return {};
 
-    unordered_set<Node*> V;
-    vector<Node*> L = {s};
-    unordered_map<Node*, double> distances;
+    static thread_local VisitedSet V;
+    V.reset(graph.size());
+    vector<unsigned int> L = {s};
+    unordered_map<unsigned int, double> distances;
 
-    calculate_distances_parallel(x_q, L, distances);
+    calculate_distances_parallel(store, x_q, L, distances);
 
-    while (any_of(L.begin(), L.end(), [&](Node* p){ return V.find(p) == V.end(); })) {
-        Node* p_star = nullptr;
+    while (any_of(L.begin(), L.end(), [&](unsigned int p){ return !V.contains(p); })) {
+        unsigned int p_star = 0;
+        bool found = false;
         double min_distance = numeric_limits<double>::max();
 
-        for (Node* p : L) {
-            if (V.find(p) == V.end()) {
+        for (unsigned int p : L) {
+            if (!V.contains(p)) {
                 double distance = distances[p];
-                if (distance < min_distance) {
+                if (!found || distance < min_distance) {
                     min_distance = distance;
                     p_star = p;
+                    found = true;
                 }
             }
         }
 
-        if (p_star) {
+        if (found) {
             V.insert(p_star);
-            for (Node* neighbor : p_star->out_neighbors) {
-                if (V.find(neighbor) == V.end()) {
+            for (uint32_t i = 0; i < graph.degree(p_star); i++) {
+                unsigned int neighbor = graph.neighbors(p_star)[i];
+                if (!V.contains(neighbor)) {
                     L.push_back(neighbor);
                 }
             }
 
             if (L.size() > list_size) {
-                calculate_distances_parallel(x_q, L, distances);
-                nth_element(L.begin(), L.begin() + list_size, L.end(), [&](Node* a, Node* b) {
+                calculate_distances_parallel(store, x_q, L, distances);
+                nth_element(L.begin(), L.begin() + list_size, L.end(), [&](unsigned int a, unsigned int b) {
                     return distances[a] < distances[b];
                 });
                 L.resize(list_size);
@@ -69,11 +60,11 @@ vector<Node*> GreedySearchaaaa(Node* s, const Node* x_q, unsigned int k, unsigne
         }
     }
 
-    unordered_set<Node*> unique_nodes(L.begin(), L.end());
-    L.assign(unique_nodes.begin(), unique_nodes.end());
+    V.reset(graph.size());
+    L.erase(remove_if(L.begin(), L.end(), [&](unsigned int p) { return !V.insert(p); }), L.end());
 
     if (L.size() > k) {
-        nth_element(L.begin(), L.begin() + k, L.end(), [&](Node* a, Node* b) {
+        nth_element(L.begin(), L.begin() + k, L.end(), [&](unsigned int a, unsigned int b) {
             return distances[a] < distances[b];
         });
         L.resize(k);
@@ -0,0 +1,332 @@
+#include "../include/vamana.h"
+
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Layout of an index file, all integers little endian:
+//
+//   header     IndexHeader, padded to one section
+//   vectors    count x stride floats, the rows of the VectorStore with their zero padding
+//   graph      count x (R + 1) uint32, the rows of the DirectedGraph, degree first
+//   labels     count + 1 uint32, where the label ids of node i start in node labels
+//   node labels num_node_labels uint32, the sorted label ids of every node, one after the other
+//   label offsets num_label_ids + 1 uint32, where the members of label f start in members
+//   members    num_node_labels uint32, the nodes of every label in ascending id order
+//   of node    count uint32, the label of every node, only when no node has more than one
+//   bits       count x label_words uint64, the label bitset of every node, when it has one
+//   timestamps count floats, the timestamp of every node
+//   values     num_labels floats, the filter value of every label id
+//   medoids    num_medoids uint32, the entry point of every label id
+//   entry points num_entry_points uint32, spread over the whole dataset
+//
+// Every section starts on a 64-byte boundary of the file, and the mapping starts on a page,
+// so the vectors can be read in place with the aligned loads of the distance kernels. The label
+// sections are those of a built LabelIndex, so an opened index searches them in place too.
+
+constexpr char INDEX_MAGIC[8] = {'V', 'A', 'M', 'A', 'N', 'A', 'I', 'X'};
+constexpr uint32_t INDEX_VERSION = 6;
+constexpr size_t SECTION_ALIGNMENT = 64;
+
+struct IndexHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t dim;
+    uint64_t count;
+    uint32_t stride;
+    uint32_t R;
+    uint32_t entry_point;
+    uint32_t num_labels;
+    uint32_t num_medoids;
+    uint32_t num_entry_points;
+    uint32_t num_label_ids;
+    uint32_t label_words;
+    uint32_t single_label;
+    uint64_t num_node_labels;
+    uint64_t vectors_offset;
+    uint64_t graph_offset;
+    uint64_t labels_offset;
+    uint64_t node_labels_offset;
+    uint64_t label_offsets_offset;
+    uint64_t members_offset;
+    uint64_t of_node_offset;
+    uint64_t bits_offset;
+    uint64_t timestamps_offset;
+    uint64_t values_offset;
+    uint64_t medoids_offset;
+    uint64_t entry_points_offset;
+    uint64_t file_size;
+};
+
+static uint64_t alignSection(uint64_t offset) {
+    return (offset + SECTION_ALIGNMENT - 1) / SECTION_ALIGNMENT * SECTION_ALIGNMENT;
+}
+
+// Offsets and file size of an index with the counts already filled in
+static void layoutSections(IndexHeader& header) {
+    header.vectors_offset = alignSection(sizeof(IndexHeader));
+    header.graph_offset = alignSection(header.vectors_offset + header.count * header.stride * sizeof(float));
+    header.labels_offset = alignSection(header.graph_offset + header.count * (header.R + 1) * sizeof(uint32_t));
+    header.node_labels_offset = alignSection(header.labels_offset + (header.count + 1) * sizeof(uint32_t));
+    header.label_offsets_offset = alignSection(header.node_labels_offset + header.num_node_labels * sizeof(uint32_t));
+    header.members_offset = alignSection(header.label_offsets_offset + (header.num_label_ids + 1) * sizeof(uint32_t));
+    header.of_node_offset = alignSection(header.members_offset + header.num_node_labels * sizeof(uint32_t));
+    header.bits_offset = alignSection(header.of_node_offset + (header.single_label ? header.count : 0) * sizeof(uint32_t));
+    header.timestamps_offset = alignSection(header.bits_offset + header.count * header.label_words * sizeof(uint64_t));
+    header.values_offset = alignSection(header.timestamps_offset + header.count * sizeof(float));
+    header.medoids_offset = alignSection(header.values_offset + header.num_labels * sizeof(float));
+    header.entry_points_offset = alignSection(header.medoids_offset + header.num_medoids * sizeof(uint32_t));
+    header.file_size = header.entry_points_offset + header.num_entry_points * sizeof(uint32_t);
+}
+
+static void writeAt(ofstream& ofs, uint64_t offset, const void* data, size_t bytes) {
+    ofs.seekp(offset);
+    ofs.write(static_cast<const char*>(data), bytes);
+}
+
+
+void SaveIndex(const string& file_path, const VectorStore& store, const DirectedGraph& graph, const vector<Node*>& nodes, const LabelIndex& labels, const vector<float>& label_values, unsigned int entry_point, const vector<unsigned int>& medoids, const vector<unsigned int>& entry_points) {
+    ofstream ofs(file_path, ios::binary | ios::trunc);
+    assert(ofs.is_open());
+
+    IndexHeader header = {};
+    copy(begin(INDEX_MAGIC), end(INDEX_MAGIC), header.magic);
+    header.version = INDEX_VERSION;
+    header.dim = store.dim;
+    header.count = store.count;
+    header.stride = store.stride;
+    header.R = graph.R;
+    header.entry_point = entry_point;
+    header.num_labels = label_values.size();
+    header.num_medoids = medoids.size();
+    header.num_entry_points = entry_points.size();
+    header.num_label_ids = labels.size();
+    header.label_words = labels.words;
+    header.single_label = labels.ofNode() != nullptr;
+    header.num_node_labels = labels.labelCount();
+    layoutSections(header);
+
+    writeAt(ofs, 0, &header, sizeof(header));
+
+    // The store and the graph are already in the file layout, so they are written as one block each
+    writeAt(ofs, header.vectors_offset, store.data, header.count * header.stride * sizeof(float));
+    writeAt(ofs, header.graph_offset, graph.row(0), header.count * (header.R + 1) * sizeof(uint32_t));
+
+    // Nodes past the end of the label index have no labels
+    size_t labeled = labels.nodeCount();
+    assert(labeled <= header.count);
+    vector<uint32_t> offsets(labels.nodeOffsets(), labels.nodeOffsets() + (labeled == 0 ? 0 : labeled + 1));
+    offsets.resize(header.count + 1, header.num_node_labels);
+    vector<uint32_t> label_offsets(labels.labelOffsets(), labels.labelOffsets() + (labels.size() == 0 ? 0 : labels.size() + 1));
+    label_offsets.resize(header.num_label_ids + 1, 0);
+
+    vector<float> timestamps(header.count, 0.0);
+    for (const Node* node : nodes) {
+        timestamps[node->id] = node->timestamp;
+    }
+    writeAt(ofs, header.labels_offset, offsets.data(), offsets.size() * sizeof(uint32_t));
+    writeAt(ofs, header.node_labels_offset, labels.nodeLabels(), header.num_node_labels * sizeof(uint32_t));
+    writeAt(ofs, header.label_offsets_offset, label_offsets.data(), label_offsets.size() * sizeof(uint32_t));
+    writeAt(ofs, header.members_offset, labels.memberIds(), header.num_node_labels * sizeof(uint32_t));
+    if (header.single_label) {
+        vector<uint32_t> of_node(labels.ofNode(), labels.ofNode() + labeled);
+        of_node.resize(header.count, NO_LABEL);
+        writeAt(ofs, header.of_node_offset, of_node.data(), of_node.size() * sizeof(uint32_t));
+    }
+    if (header.label_words > 0) {
+        vector<uint64_t> bits(labels.bitRows(), labels.bitRows() + labeled * header.label_words);
+        bits.resize(header.count * header.label_words, 0);
+        writeAt(ofs, header.bits_offset, bits.data(), bits.size() * sizeof(uint64_t));
+    }
+    writeAt(ofs, header.timestamps_offset, timestamps.data(), timestamps.size() * sizeof(float));
+    writeAt(ofs, header.values_offset, label_values.data(), label_values.size() * sizeof(float));
+    writeAt(ofs, header.medoids_offset, medoids.data(), medoids.size() * sizeof(uint32_t));
+    writeAt(ofs, header.entry_points_offset, entry_points.data(), entry_points.size() * sizeof(uint32_t));
+
+    ofs.close();
+
+    // Pad the file to its full size, in case the last sections are empty
+    if (truncate(file_path.c_str(), header.file_size) != 0) {
+        cerr << "Error: Failed to resize " << file_path << endl;
+    }
+
+    cout << "Index saved to " << file_path << endl;
+}
+
+// The checks of every open: the ends of the label offsets, and the medoids and entry points, which
+// are copied anyway. Proportional to the number of labels, not of the points.
+static string checkEnds(const IndexHeader& header, const char* base) {
+    auto isNode = [&](uint32_t id) { return id < header.count; };
+
+    const uint32_t* offsets = reinterpret_cast<const uint32_t*>(base + header.labels_offset);
+    const uint32_t* label_offsets = reinterpret_cast<const uint32_t*>(base + header.label_offsets_offset);
+    if (offsets[0] != 0 || offsets[header.count] != header.num_node_labels
+        || label_offsets[0] != 0 || label_offsets[header.num_label_ids] != header.num_node_labels) {
+        return "corrupted labels";
+    }
+
+    const uint32_t* medoids = reinterpret_cast<const uint32_t*>(base + header.medoids_offset);
+    if (!all_of(medoids, medoids + header.num_medoids, isNode)) {
+        return "corrupted medoids";
+    }
+
+    const uint32_t* entry_points = reinterpret_cast<const uint32_t*>(base + header.entry_points_offset);
+    if (!all_of(entry_points, entry_points + header.num_entry_points, isNode)) {
+        return "corrupted entry points";
+    }
+    return "";
+}
+
+// Every id the searches follow must stay inside the file, so a corrupted or hostile file is
+// refused here instead of read out of bounds later. One pass over the graph and the label sections.
+static string checkSections(const IndexHeader& header, const char* base) {
+    string error = checkEnds(header, base);
+    if (!error.empty()) {
+        return error;
+    }
+
+    auto isNode = [&](uint32_t id) { return id < header.count; };
+    auto isSorted = [](const uint32_t* first, const uint32_t* last) { return is_sorted(first, last); };
+
+    const uint32_t* row = reinterpret_cast<const uint32_t*>(base + header.graph_offset);
+    for (uint64_t i = 0; i < header.count; i++, row += header.R + 1) {
+        if (row[0] > header.R || !all_of(row + 1, row + 1 + row[0], isNode)) {
+            return "corrupted graph";
+        }
+    }
+
+    const uint32_t* offsets = reinterpret_cast<const uint32_t*>(base + header.labels_offset);
+    const uint32_t* labels = reinterpret_cast<const uint32_t*>(base + header.node_labels_offset);
+    const uint32_t* label_offsets = reinterpret_cast<const uint32_t*>(base + header.label_offsets_offset);
+    const uint32_t* members = reinterpret_cast<const uint32_t*>(base + header.members_offset);
+    if (!isSorted(offsets, offsets + header.count + 1) || !isSorted(label_offsets, label_offsets + header.num_label_ids + 1)
+        || any_of(labels, labels + header.num_node_labels, [&](uint32_t label) { return label >= header.num_label_ids; })
+        || !all_of(members, members + header.num_node_labels, isNode)) {
+        return "corrupted labels";
+    }
+    return "";
+}
+
+vector<Node*> OpenIndex(const string& file_path, IndexFile& index, bool verify) {
+    int fd = open(file_path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        cerr << "Error: Failed to open index " << file_path << endl;
+        return {};
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(IndexHeader)) {
+        cerr << "Error: " << file_path << " is too small to be an index" << endl;
+        close(fd);
+        return {};
+    }
+
+    // A read-only mapping, so a search can never write to the file. The pages are read on first use,
+    // and the searches jump around the whole graph, so read ahead would only load pages nobody asked for.
+    size_t size = info.st_size;
+    void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        cerr << "Error: Failed to map index " << file_path << endl;
+        return {};
+    }
+    madvise(mapping, size, MADV_RANDOM);
+
+    // Only the header and the ends of the sections are checked, so opening does not read the whole file
+    IndexHeader header;
+    memcpy(&header, mapping, sizeof(header));
+
+    IndexHeader expected = header;
+    layoutSections(expected);
+
+    string error;
+    if (!equal(begin(INDEX_MAGIC), end(INDEX_MAGIC), header.magic)) {
+        error = "not an index file";
+    } else if (header.version != INDEX_VERSION) {
+        error = "index version " + to_string(header.version) + ", expected " + to_string(INDEX_VERSION);
+    } else if (header.stride < header.dim || header.stride % (SECTION_ALIGNMENT / sizeof(float)) != 0 || header.entry_point >= max<uint64_t>(header.count, 1)
+               || header.vectors_offset != expected.vectors_offset || header.graph_offset != expected.graph_offset
+               || header.num_label_ids > header.num_labels || header.single_label > 1
+               || (header.label_words != 0 && (header.label_words != (header.num_label_ids + 63) / 64 || header.label_words > LABEL_BITSET_WORDS))
+               || header.labels_offset != expected.labels_offset || header.node_labels_offset != expected.node_labels_offset
+               || header.label_offsets_offset != expected.label_offsets_offset || header.members_offset != expected.members_offset
+               || header.of_node_offset != expected.of_node_offset || header.bits_offset != expected.bits_offset
+               || header.timestamps_offset != expected.timestamps_offset
+               || header.values_offset != expected.values_offset || header.medoids_offset != expected.medoids_offset
+               || header.entry_points_offset != expected.entry_points_offset
+               || header.file_size != expected.file_size) {
+        error = "corrupted header";
+    } else if (header.file_size > size) {
+        error = "truncated file";
+    } else if (header.count > numeric_limits<uint32_t>::max()) {
+        error = "more points than 32-bit ids can number";
+    } else {
+        error = verify ? checkSections(header, static_cast<const char*>(mapping)) : checkEnds(header, static_cast<const char*>(mapping));
+    }
+
+    if (!error.empty()) {
+        cerr << "Error: " << file_path << ": " << error << endl;
+        munmap(mapping, size);
+        return {};
+    }
+
+    if (index.mapping) {
+        munmap(index.mapping, index.mapping_size);
+    }
+
+    const char* base = static_cast<const char*>(mapping);
+    const uint32_t* offsets = reinterpret_cast<const uint32_t*>(base + header.labels_offset);
+    index.mapping = mapping;
+    index.mapping_size = size;
+
+    // The store and the graph take writable pointers, but a write to the mapping faults
+    index.store = VectorStore(const_cast<float*>(reinterpret_cast<const float*>(base + header.vectors_offset)), header.count, header.dim, header.stride);
+    index.graph = DirectedGraph(const_cast<uint32_t*>(reinterpret_cast<const uint32_t*>(base + header.graph_offset)), header.count, header.R);
+    index.entry_point = header.entry_point;
+
+    const float* values = reinterpret_cast<const float*>(base + header.values_offset);
+    index.label_values.assign(values, values + header.num_labels);
+    const uint32_t* medoids = reinterpret_cast<const uint32_t*>(base + header.medoids_offset);
+    index.medoids.assign(medoids, medoids + header.num_medoids);
+    const uint32_t* entry_points = reinterpret_cast<const uint32_t*>(base + header.entry_points_offset);
+    index.entry_points.assign(entry_points, entry_points + header.num_entry_points);
+
+    LabelIndex::Mapped labels;
+    labels.node_offsets = offsets;
+    labels.node_labels = reinterpret_cast<const uint32_t*>(base + header.node_labels_offset);
+    labels.offsets = reinterpret_cast<const uint32_t*>(base + header.label_offsets_offset);
+    labels.members = reinterpret_cast<const uint32_t*>(base + header.members_offset);
+    labels.of_node = header.single_label ? reinterpret_cast<const uint32_t*>(base + header.of_node_offset) : nullptr;
+    labels.bits = reinterpret_cast<const uint64_t*>(base + header.bits_offset);
+    labels.node_count = header.count;
+    labels.label_count = header.num_label_ids;
+    index.labels = LabelIndex(labels, header.label_words);
+
+    // The nodes are the only part that is built, in one block, from the first label and the timestamp
+    // of every node. An offset past the labels, which only verify refuses, gives no label.
+    const float* timestamps = reinterpret_cast<const float*>(base + header.timestamps_offset);
+    index.nodes.resize(header.count);
+    vector<Node*> nodes(header.count);
+    for (uint64_t i = 0; i < header.count; i++) {
+        uint32_t label = NO_LABEL;
+        if (labels.of_node) {
+            label = labels.of_node[i];
+        } else if (offsets[i] < min<uint64_t>(offsets[i + 1], header.num_node_labels)) {
+            label = labels.node_labels[offsets[i]];
+        }
+        index.nodes[i] = Node{static_cast<unsigned int>(i), label, timestamps[i]};
+        nodes[i] = &index.nodes[i];
+    }
+
+    cout << "Index " << file_path << ": " << header.count << " points, " << header.dim << " dimensions, R = " << header.R << endl;
+
+    return nodes;
+}
+
+IndexFile::~IndexFile() {
+    if (mapping) {
+        munmap(mapping, mapping_size);
+    }
+}
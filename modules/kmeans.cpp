@@ -0,0 +1,173 @@
+#include "../include/vamana.h"
+
+// Points a thread takes at a time in the assignment step, each against every centroid
+constexpr size_t ASSIGN_GRAIN = 256;
+
+// The closest centroid to `point` and its squared distance, ties to the smaller centroid
+static pair<float, unsigned int> closestCentroid(const VectorStore& centroids, const float* point) {
+    pair<float, unsigned int> best = {numeric_limits<float>::max(), 0};
+    for (unsigned int c = 0; c < centroids.count; c++) {
+        float distance = centroids.l2(centroids.row(c), point, centroids.dim);
+        if (distance < best.first) {
+            best = {distance, c};
+        }
+    }
+    return best;
+}
+
+vector<size_t> kMeansPlusPlusSeeds(const VectorStore& store, const vector<Node*>& nodes, size_t count, size_t first, unsigned int seed, ThreadPool& pool) {
+    vector<size_t> seeds;
+    if (nodes.empty() || count == 0) {
+        return seeds;
+    }
+
+    mt19937 gen(seed);
+    seeds.push_back(first);
+
+    // Squared distance of every node to its closest seed, updated with one parallel pass per seed
+    vector<float> closest(nodes.size(), numeric_limits<float>::max());
+    while (seeds.size() < min(count, nodes.size())) {
+        const float* last = store.row(nodes[seeds.back()]->id);
+        pool.parallelFor(0, nodes.size(), [&](size_t i) {
+            closest[i] = min(closest[i], euclidean(store, store.row(nodes[i]->id), last));
+        }, DISTANCE_GRAIN);
+
+        double total = 0.0;
+        for (float distance : closest) {
+            total += distance;
+        }
+        if (total <= 0.0) {
+            break;  // every node is on a seed already
+        }
+
+        double target = uniform_real_distribution<double>(0.0, total)(gen);
+        size_t chosen = 0;
+        for (double seen = closest[0]; seen <= target && chosen + 1 < nodes.size(); seen += closest[++chosen]) {
+        }
+        // The last nodes can be at distance zero, never pick one that is already a seed
+        while (closest[chosen] == 0.0f) {
+            chosen--;
+        }
+        seeds.push_back(chosen);
+    }
+
+    return seeds;
+}
+
+// Lloyd's algorithm, or mini-batch k-means when batch_size > 0. The centroids live in a padded
+// store of their own, so every distance goes through the same SIMD kernel as the searches. Every
+// step is deterministic for a seed, whatever the number of threads: the assignments only depend
+// on the distances, and each centroid is summed by one thread over its members in order.
+KMeansResult kMeans(const VectorStore& store, const vector<Node*>& nodes, unsigned int k, unsigned int max_iterations, unsigned int seed, size_t batch_size, ThreadPool& pool) {
+    if (k == 0 || k > nodes.size()) {
+        throw invalid_argument("Invalid number of clusters");
+    }
+
+    mt19937 gen(seed);
+    size_t n = nodes.size();
+
+    KMeansResult result;
+    result.centroids = VectorStore(k, store.dim);
+    result.assignment.assign(n, 0);
+
+    // k-means++ seeding from a random node. Duplicate points can leave fewer distinct seeds
+    // than clusters, then the rest start on random nodes.
+    size_t first = uniform_int_distribution<size_t>(0, n - 1)(gen);
+    vector<size_t> seeds = kMeansPlusPlusSeeds(store, nodes, k, first, gen(), pool);
+    while (seeds.size() < k) {
+        seeds.push_back(uniform_int_distribution<size_t>(0, n - 1)(gen));
+    }
+    for (unsigned int c = 0; c < k; c++) {
+        const float* coords = store.row(nodes[seeds[c]]->id);
+        copy(coords, coords + store.dim, result.centroids.row(c));
+    }
+
+    vector<float> distances(n, 0.0f);
+    auto assign = [&](size_t i) {
+        pair<float, unsigned int> closest = closestCentroid(result.centroids, store.row(nodes[i]->id));
+        distances[i] = closest.first;
+        result.assignment[i] = closest.second;
+    };
+
+    if (batch_size > 0) {
+        // Mini-batch: every batch of random points moves the centroid of each point towards it,
+        // by 1 / (points the centroid has taken so far)
+        vector<size_t> counts(k, 0);
+        vector<size_t> batch(min(batch_size, n));
+        for (result.iterations = 0; result.iterations < max_iterations; result.iterations++) {
+            for (size_t& position : batch) {
+                position = uniform_int_distribution<size_t>(0, n - 1)(gen);
+            }
+            pool.parallelFor(0, batch.size(), [&](size_t b) { assign(batch[b]); }, ASSIGN_GRAIN);
+
+            for (size_t position : batch) {
+                unsigned int c = result.assignment[position];
+                float rate = 1.0f / ++counts[c];
+                float* centroid = result.centroids.row(c);
+                const float* coords = store.row(nodes[position]->id);
+                for (size_t d = 0; d < store.dim; d++) {
+                    centroid[d] += rate * (coords[d] - centroid[d]);
+                }
+            }
+        }
+        pool.parallelFor(0, n, assign, ASSIGN_GRAIN);
+    } else {
+        vector<unsigned int> previous;
+        vector<size_t> offsets(k + 1);
+        vector<size_t> members(n);
+        for (result.iterations = 0; result.iterations < max_iterations; result.iterations++) {
+            pool.parallelFor(0, n, assign, ASSIGN_GRAIN);
+            if (result.assignment == previous) {
+                break;
+            }
+            previous = result.assignment;
+
+            // The members of every cluster, in the order of the nodes
+            fill(offsets.begin(), offsets.end(), 0);
+            for (unsigned int c : result.assignment) {
+                offsets[c + 1]++;
+            }
+            partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+            vector<size_t> next(offsets.begin(), offsets.end() - 1);
+            for (size_t i = 0; i < n; i++) {
+                members[next[result.assignment[i]]++] = i;
+            }
+
+            // An empty cluster takes the node that is farthest from its centroid, the one the
+            // centroids explain worst
+            for (unsigned int c = 0; c < k; c++) {
+                if (offsets[c] == offsets[c + 1]) {
+                    size_t farthest = max_element(distances.begin(), distances.end()) - distances.begin();
+                    distances[farthest] = 0.0f;
+                    const float* coords = store.row(nodes[farthest]->id);
+                    copy(coords, coords + store.dim, result.centroids.row(c));
+                }
+            }
+
+            pool.parallelFor(0, k, [&](size_t c) {
+                if (offsets[c] == offsets[c + 1]) {
+                    return;
+                }
+                vector<double> sum(store.dim, 0.0);
+                for (size_t m = offsets[c]; m < offsets[c + 1]; m++) {
+                    const float* coords = store.row(nodes[members[m]]->id);
+                    for (size_t d = 0; d < store.dim; d++) {
+                        sum[d] += coords[d];
+                    }
+                }
+                float* centroid = result.centroids.row(c);
+                for (size_t d = 0; d < store.dim; d++) {
+                    centroid[d] = sum[d] / (offsets[c + 1] - offsets[c]);
+                }
+            });
+        }
+        if (result.iterations == max_iterations) {
+            pool.parallelFor(0, n, assign, ASSIGN_GRAIN);
+        }
+    }
+
+    for (float distance : distances) {
+        result.inertia += distance;
+    }
+    return result;
+}
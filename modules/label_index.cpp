@@ -0,0 +1,179 @@
+#include "../include/vamana.h"
+
+
+LabelFilter::LabelFilter(uint32_t label) : LabelFilter(label == NO_LABEL ? vector<uint32_t>{} : vector<uint32_t>{label}, MATCH_ANY) {}
+
+LabelFilter::LabelFilter(vector<uint32_t> filter_labels, FilterMode mode) : mode(mode), labels(move(filter_labels)) {
+    sort(labels.begin(), labels.end());
+    labels.erase(unique(labels.begin(), labels.end()), labels.end());
+    if (labels.size() == 1) {
+        single = labels[0];
+    }
+
+    for (uint32_t label : labels) {
+        uint32_t word = label / 64;
+        if (words.empty() || words.back().first != word) {
+            words.emplace_back(word, 0);
+        }
+        words.back().second |= uint64_t(1) << (label % 64);
+    }
+}
+
+// Builds the members of every label, and the label array or the bitsets, from the labels of every node
+static void buildMembers(LabelIndex& index) {
+    size_t count = index.nodeCount();
+    uint32_t num_labels = 0;
+    for (uint32_t label : index.node_labels) {
+        num_labels = max(num_labels, label + 1);
+    }
+
+    bool single = true;
+    for (uint32_t id = 0; id < count && single; id++) {
+        single = index.labelsEnd(id) - index.labelsBegin(id) <= 1;
+    }
+
+    // Count the members of every label, then turn the counts into offsets
+    index.offsets.assign(num_labels + 1, 0);
+    for (uint32_t label : index.node_labels) {
+        index.offsets[label + 1]++;
+    }
+    partial_sum(index.offsets.begin(), index.offsets.end(), index.offsets.begin());
+
+    // One pass in id order fills every slice in ascending id order
+    index.members.resize(index.node_labels.size());
+    vector<uint32_t> next(index.offsets.begin(), index.offsets.end() - 1);
+    for (uint32_t id = 0; id < count; id++) {
+        for (const uint32_t* label = index.labelsBegin(id); label != index.labelsEnd(id); label++) {
+            index.members[next[*label]++] = id;
+        }
+    }
+
+    if (single) {
+        index.of_node.assign(count, NO_LABEL);
+        for (uint32_t id = 0; id < count; id++) {
+            if (index.labelsBegin(id) != index.labelsEnd(id)) {
+                index.of_node[id] = *index.labelsBegin(id);
+            }
+        }
+    }
+
+    index.words = (num_labels + 63) / 64;
+    if (index.words > LABEL_BITSET_WORDS) {
+        index.words = 0;
+    }
+    index.bits.assign(count * index.words, 0);
+    for (uint32_t id = 0; id < count && index.words > 0; id++) {
+        for (const uint32_t* label = index.labelsBegin(id); label != index.labelsEnd(id); label++) {
+            index.bits[id * index.words + *label / 64] |= uint64_t(1) << (*label % 64);
+        }
+    }
+}
+
+LabelIndex::LabelIndex(const vector<Node*>& nodes) {
+    unsigned int count = 0;
+    for (const Node* node : nodes) {
+        count = max(count, node->id + 1);
+    }
+
+    // Ids that no node has get no labels
+    vector<uint32_t> labels(count, NO_LABEL);
+    for (const Node* node : nodes) {
+        labels[node->id] = node->label;
+    }
+
+    node_offsets.reserve(count + 1);
+    node_labels.reserve(count);
+    node_offsets.push_back(0);
+    for (uint32_t label : labels) {
+        if (label != NO_LABEL) {
+            node_labels.push_back(label);
+        }
+        node_offsets.push_back(node_labels.size());
+    }
+
+    buildMembers(*this);
+}
+
+LabelIndex::LabelIndex(const vector<vector<uint32_t>>& labels) {
+    node_offsets.reserve(labels.size() + 1);
+    node_offsets.push_back(0);
+    for (const vector<uint32_t>& of_node : labels) {
+        size_t first = node_labels.size();
+        node_labels.insert(node_labels.end(), of_node.begin(), of_node.end());
+        sort(node_labels.begin() + first, node_labels.end());
+        node_labels.erase(unique(node_labels.begin() + first, node_labels.end()), node_labels.end());
+        node_offsets.push_back(node_labels.size());
+    }
+
+    buildMembers(*this);
+}
+
+bool LabelIndex::matchLists(unsigned int id, const LabelFilter& filter) const {
+    const uint32_t* first = labelsBegin(id);
+    const uint32_t* last = labelsEnd(id);
+    if (filter.mode == MATCH_ALL) {
+        return includes(first, last, filter.labels.begin(), filter.labels.end());
+    }
+
+    // Both lists are sorted, so one merge finds a common label
+    auto label = filter.labels.begin();
+    while (first != last && label != filter.labels.end()) {
+        if (*first == *label) {
+            return true;
+        }
+        if (*first < *label) {
+            first++;
+        } else {
+            label++;
+        }
+    }
+    return false;
+}
+
+bool LabelIndex::covers(unsigned int a, unsigned int b, unsigned int c) const {
+    if (words > 0) {
+        const uint64_t* row_a = bitRows() + a * words;
+        const uint64_t* row_b = bitRows() + b * words;
+        const uint64_t* row_c = bitRows() + c * words;
+        for (size_t word = 0; word < words; word++) {
+            if (row_a[word] & row_b[word] & ~row_c[word]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    for (const uint32_t* label = labelsBegin(a); label != labelsEnd(a); label++) {
+        if (binary_search(labelsBegin(b), labelsEnd(b), *label) && !binary_search(labelsBegin(c), labelsEnd(c), *label)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool LabelIndex::shares(unsigned int a, unsigned int b) const {
+    if (words > 0) {
+        const uint64_t* row_a = bitRows() + a * words;
+        const uint64_t* row_b = bitRows() + b * words;
+        for (size_t word = 0; word < words; word++) {
+            if (row_a[word] & row_b[word]) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    const uint32_t* first_a = labelsBegin(a);
+    const uint32_t* first_b = labelsBegin(b);
+    while (first_a != labelsEnd(a) && first_b != labelsEnd(b)) {
+        if (*first_a == *first_b) {
+            return true;
+        }
+        if (*first_a < *first_b) {
+            first_a++;
+        } else {
+            first_b++;
+        }
+    }
+    return false;
+}
@@ -1,99 +1,52 @@
 #include "../include/vamana.h"
 
 // Find the centroid of a cluster
-Node* findCentroid(const vector<Node*>& cluster) {
+vector<float> findCentroid(const VectorStore& store, const vector<Node*>& cluster) {
     if (cluster.empty()) {
         throw invalid_argument("Cluster is empty, cannot find centroid");
     }
 
-    size_t dimensions = cluster[0]->coords.size(); // Number of dimensions
-    Node* centroid = new Node; // Centroid node initialization
-    centroid->coords.resize(dimensions, 0.0);
+    size_t dimensions = store.dim; // Number of dimensions
+    vector<float> centroid(dimensions, 0.0); // Centroid initialization
 
     // Sum up the coordinates of each node
     for (const Node* point : cluster) {
+        const float* coords = store.row(point->id);
         for (size_t i = 0; i < dimensions; ++i) {
-            centroid->coords[i] += point->coords[i];
+            centroid[i] += coords[i];
         }
     }
 
     // Divide each coordinate sum by the number of points to get the centroid
-    for (float& value : centroid->coords) {
+    for (float& value : centroid) {
         value /= cluster.size();
     }
 
     return centroid;
 }
 
-// K-means clustering
-vector<vector<Node*>> kMeansClustering(const vector<Node*>& nodes, int k, int maxIterations) {
+// K-means clustering, the nodes of every cluster
+vector<vector<Node*>> kMeansClustering(const VectorStore& store, const vector<Node*>& nodes, int k, int maxIterations, unsigned int seed, ThreadPool& pool) {
     if (k <= 0 || k > (int)nodes.size()) {
         throw invalid_argument("Invalid number of clusters");
     }
 
-    vector<Node*> centroids;
-    vector<vector<Node*>> clusters(k); // Vector of clusters, one for each centroid
-
-    // Initialize random centroids
-    srand(static_cast<unsigned>(time(0)));
-    for (int i = 0; i < k; ++i) {
-        centroids.push_back(new Node(*nodes[rand() % nodes.size()])); // Create new nodes for centroids
-    }
-
-    // K-means iterations
-    for (int iter = 0; iter < maxIterations; ++iter) {
-        // Clear clusters for the current iteration
-        for (auto& cluster : clusters) {
-            cluster.clear();
-        }
-
-        // Assign each node to the nearest centroid
-        for (const Node* node : nodes) {
-            int closestCluster = 0;
-            float minDist = euclidean(node, centroids[0]); // Distance to the first centroid
-            for (int j = 1; j < k; ++j) {
-                float dist = euclidean(node, centroids[j]);
-                if (dist < minDist) { // If a nearer centroid is found
-                    minDist = dist;
-                    closestCluster = j;
-                }
-            }
-            clusters[closestCluster].push_back(const_cast<Node*>(node));
-        }
-
-        // Recalculate centroids
-        bool centroidsChanged = false;
-        for (int i = 0; i < k; ++i) {
-            if (clusters[i].empty()) continue; // Skip empty clusters
-
-            Node* newCentroid = findCentroid(clusters[i]);
-            if (euclidean(newCentroid, centroids[i]) > 1e-4) { // Check if the centroid has changed significantly
-                centroidsChanged = true;
-            }
-
-            delete centroids[i]; // Clean up old centroid
-            centroids[i] = newCentroid;
-        }
-
-        // If centroids don't change, break early
-        if (!centroidsChanged) break;
-    }
+    KMeansResult result = kMeans(store, nodes, k, maxIterations, seed, 0, pool);
 
-    // Clean up allocated memory for centroids
-    for (Node* centroid : centroids) {
-        delete centroid;
+    vector<vector<Node*>> clusters(k); // Vector of clusters, one for each centroid
+    for (size_t i = 0; i < nodes.size(); i++) {
+        clusters[result.assignment[i]].push_back(nodes[i]);
     }
-
     return clusters;
 }
 
 // Find approximate medoid based on clustering
-int approximateMedoid(const vector<Node*>& nodes, int k) {
+int approximateMedoid(const VectorStore& store, const vector<Node*>& nodes, int k) {
     if (nodes.empty()) {
         throw invalid_argument("Nodes are empty, cannot find medoid");
     }
 
-    auto clusters = kMeansClustering(nodes, k);
+    auto clusters = kMeansClustering(store, nodes, k);
 
     // Find the cluster with the most nodes
     int largestClusterIndex = 0;
@@ -108,19 +61,137 @@ int approximateMedoid(const vector<Node*>& nodes, int k) {
     }
 
     // Find centroid of the largest cluster
-    Node* centroid = findCentroid(clusters[largestClusterIndex]);
+    vector<float> centroid = findCentroid(store, clusters[largestClusterIndex]);
 
     // Find the node within the largest cluster closest to the centroid
     int medoidIndex = -1;
     float minDist = numeric_limits<float>::max();
     for (const Node* node : clusters[largestClusterIndex]) {
-        float dist = euclidean(node, centroid);
+        float dist = euclidean(store, store.row(node->id), centroid.data());
         if (dist < minDist) {
             minDist = dist;
             medoidIndex = node->id;
         }
     }
 
-    delete centroid;
     return medoidIndex;
 }
+
+// Mean of the nodes. Every thread sums its share of the rows in doubles, so a large dataset
+// loses no precision, and the partial sums are added at the end.
+vector<float> datasetCentroid(const VectorStore& store, const vector<Node*>& nodes, ThreadPool& pool) {
+    if (nodes.empty()) {
+        throw invalid_argument("Nodes are empty, cannot find centroid");
+    }
+
+    vector<vector<double>> sums(pool.size() + 1, vector<double>(store.dim, 0.0));
+    pool.parallelForSlots(0, nodes.size(), [&](size_t i, size_t slot) {
+        const float* coords = store.row(nodes[i]->id);
+        vector<double>& sum = sums[slot];
+        for (size_t d = 0; d < store.dim; d++) {
+            sum[d] += coords[d];
+        }
+    }, DISTANCE_GRAIN);
+
+    vector<float> centroid(store.dim);
+    for (size_t d = 0; d < store.dim; d++) {
+        double total = 0.0;
+        for (const vector<double>& sum : sums) {
+            total += sum[d];
+        }
+        centroid[d] = total / nodes.size();
+    }
+    return centroid;
+}
+
+// The node closest to `point`, ties to the smaller id so the answer does not depend on the threads
+static unsigned int nearestNode(const VectorStore& store, const vector<Node*>& nodes, const float* point, ThreadPool& pool) {
+    vector<pair<float, unsigned int>> best(pool.size() + 1, {numeric_limits<float>::max(), numeric_limits<unsigned int>::max()});
+    pool.parallelForSlots(0, nodes.size(), [&](size_t i, size_t slot) {
+        pair<float, unsigned int> candidate = {euclidean(store, store.row(nodes[i]->id), point), nodes[i]->id};
+        best[slot] = min(best[slot], candidate);
+    }, DISTANCE_GRAIN);
+    return min_element(best.begin(), best.end())->second;
+}
+
+// The node closest to the centroid of the whole dataset, two passes over the store
+unsigned int datasetMedoid(const VectorStore& store, const vector<Node*>& nodes, ThreadPool& pool) {
+    vector<float> centroid = datasetCentroid(store, nodes, pool);
+
+    // The centroid is not a row of the store, so it is copied into a padded row for the kernel
+    VectorStore point(1, store.dim);
+    copy(centroid.begin(), centroid.end(), point.row(0));
+    return nearestNode(store, nodes, point.row(0), pool);
+}
+
+// `count` distinct random positions of [0, n), all of them if count >= n
+static vector<size_t> samplePositions(size_t n, size_t count, mt19937& gen) {
+    vector<size_t> positions(n);
+    iota(positions.begin(), positions.end(), 0);
+    count = min(count, n);
+    for (size_t i = 0; i < count; i++) {
+        swap(positions[i], positions[uniform_int_distribution<size_t>(i, n - 1)(gen)]);
+    }
+    positions.resize(count);
+    return positions;
+}
+
+// Every candidate gets the mean of its distances to the same random sample of the nodes. The
+// sample mean of one candidate is off from its mean over all the nodes by at most 1.96 standard
+// errors 95% of the time, where the standard error shrinks with the finite population correction
+// and is zero once the sample is the whole dataset. O(candidates x samples) distances.
+MedoidEstimate sampledMedoid(const VectorStore& store, const vector<Node*>& nodes, size_t candidates, size_t samples, unsigned int seed, ThreadPool& pool) {
+    if (nodes.empty()) {
+        throw invalid_argument("Nodes are empty, cannot find medoid");
+    }
+
+    mt19937 gen(seed);
+    vector<size_t> candidate_positions = samplePositions(nodes.size(), max<size_t>(candidates, 1), gen);
+    vector<size_t> sample_positions = samplePositions(nodes.size(), max<size_t>(samples, 1), gen);
+
+    vector<double> sum(candidate_positions.size(), 0.0);
+    vector<double> sum_squares(candidate_positions.size(), 0.0);
+    pool.parallelFor(0, candidate_positions.size(), [&](size_t c) {
+        const float* coords = store.row(nodes[candidate_positions[c]]->id);
+        for (size_t position : sample_positions) {
+            double distance = sqrt(euclidean(store, coords, store.row(nodes[position]->id)));
+            sum[c] += distance;
+            sum_squares[c] += distance * distance;
+        }
+    });
+
+    size_t best = 0;
+    for (size_t c = 1; c < candidate_positions.size(); c++) {
+        if (sum[c] < sum[best]) {
+            best = c;
+        }
+    }
+
+    double n = nodes.size();
+    double s = sample_positions.size();
+    double mean = sum[best] / s;
+    double variance = s > 1 ? max(0.0, (sum_squares[best] - s * mean * mean) / (s - 1)) : 0.0;
+    double correction = n > 1 ? (n - s) / (n - 1) : 0.0;
+
+    MedoidEstimate estimate;
+    estimate.id = nodes[candidate_positions[best]]->id;
+    estimate.mean_distance = mean;
+    estimate.error = 1.96 * sqrt(variance / s * correction);
+    return estimate;
+}
+
+// k-means++ seeding from the dataset medoid, so the entry points spread over the clusters of the
+// data instead of piling up in the densest one. One parallel pass over the store per entry point.
+vector<unsigned int> diverseEntryPoints(const VectorStore& store, const vector<Node*>& nodes, unsigned int count, unsigned int seed, ThreadPool& pool) {
+    vector<unsigned int> entry_points;
+    if (nodes.empty() || count == 0) {
+        return entry_points;
+    }
+
+    unsigned int medoid = datasetMedoid(store, nodes, pool);
+    size_t first = find_if(nodes.begin(), nodes.end(), [&](const Node* node) { return node->id == medoid; }) - nodes.begin();
+    for (size_t position : kMeansPlusPlusSeeds(store, nodes, count, first, seed, pool)) {
+        entry_points.push_back(nodes[position]->id);
+    }
+    return entry_points;
+}
@@ -0,0 +1,92 @@
+#include "../include/vamana.h"
+
+// Lloyd iterations of the k-means of every subspace
+constexpr unsigned int PQ_TRAIN_ITERATIONS = 25;
+
+
+ProductQuantizer::ProductQuantizer(const VectorStore& store, const vector<Node*>& nodes, unsigned int subspaces, size_t train_size, unsigned int seed, ThreadPool& pool)
+    : dim(store.dim), subspaces(subspaces), offsets(subspaces + 1) {
+    if (subspaces == 0 || subspaces > store.dim || nodes.empty()) {
+        throw invalid_argument("Invalid number of subspaces");
+    }
+
+    // Runs of dim / subspaces dimensions, the first dim % subspaces of them one longer
+    for (unsigned int m = 0; m <= subspaces; m++) {
+        offsets[m] = m * dim / subspaces;
+    }
+    for (unsigned int m = 0; m < subspaces; m++) {
+        sub_dim = max<size_t>(sub_dim, offsets[m + 1] - offsets[m]);
+    }
+    centroids.assign(subspaces * PQ_CENTROIDS * sub_dim, 0.0f);
+
+    // The codebooks are trained on a random sample of the nodes
+    mt19937 gen(seed);
+    vector<Node*> sample = nodes;
+    shuffle(sample.begin(), sample.end(), gen);
+    sample.resize(min(train_size, sample.size()));
+
+    vector<Node> points(sample.size());
+    vector<Node*> pointers(sample.size());
+    for (size_t i = 0; i < sample.size(); i++) {
+        points[i].id = i;
+        pointers[i] = &points[i];
+    }
+
+    for (unsigned int m = 0; m < subspaces; m++) {
+        size_t width = offsets[m + 1] - offsets[m];
+        VectorStore sub(sample.size(), width);
+        for (size_t i = 0; i < sample.size(); i++) {
+            const float* coords = store.row(sample[i]->id) + offsets[m];
+            copy(coords, coords + width, sub.row(i));
+        }
+
+        // A sample smaller than the codebook keeps the unused centroids at zero
+        unsigned int k = min<size_t>(PQ_CENTROIDS, sample.size());
+        KMeansResult result = kMeans(sub, pointers, k, PQ_TRAIN_ITERATIONS, gen(), 0, pool);
+        for (unsigned int c = 0; c < k; c++) {
+            for (size_t d = 0; d < width; d++) {
+                column(m, d)[c] = result.centroids.row(c)[d];
+            }
+        }
+    }
+
+    // Every node of the store gets its code, nodes that are not in `nodes` keep code 0
+    codes.assign(store.count * subspaces, 0);
+    pool.parallelFor(0, nodes.size(), [&](size_t i) {
+        encode(store.row(nodes[i]->id), code(nodes[i]->id));
+    }, DISTANCE_GRAIN);
+}
+
+void ProductQuantizer::encode(const float* x, uint8_t* code) const {
+    static thread_local vector<float> table;
+    distanceTable(x, table);
+    for (unsigned int m = 0; m < subspaces; m++) {
+        const float* distances = table.data() + m * PQ_CENTROIDS;
+        code[m] = min_element(distances, distances + PQ_CENTROIDS) - distances;
+    }
+}
+
+// The centroids are stored a dimension at a time, so every dimension of the query is compared
+// with the 256 centroids of its subspace in one loop over contiguous floats that the compiler vectorizes
+void ProductQuantizer::distanceTable(const float* x_q, vector<float>& table) const {
+    table.assign(subspaces * PQ_CENTROIDS, 0.0f);
+    for (unsigned int m = 0; m < subspaces; m++) {
+        float* distances = table.data() + m * PQ_CENTROIDS;
+        for (size_t d = offsets[m]; d < offsets[m + 1]; d++) {
+            const float* values = column(m, d - offsets[m]);
+            float x = x_q[d];
+            for (unsigned int c = 0; c < PQ_CENTROIDS; c++) {
+                float diff = x - values[c];
+                distances[c] += diff * diff;
+            }
+        }
+    }
+}
+
+vector<unsigned int> rerankExact(const VectorStore& store, const CandidatePool& candidates, const float* x_q, unsigned int k, CandidatePool& reranked) {
+    reranked.reset(k);
+    for (const Candidate& candidate : candidates.candidates) {
+        reranked.insert(candidate.id, euclidean(store, store.row(candidate.id), x_q));
+    }
+    return reranked.closest(k);
+}
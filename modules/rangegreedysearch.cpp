@@ -0,0 +1,69 @@
+#include "../include/vamana.h"
+
+
+vector<unsigned int> BruteForceSearch(const VectorStore& store, const unsigned int* ids, size_t count, const float* x_q, unsigned int k, SearchScratch& scratch) {
+    CandidatePool& results = scratch.results;
+    results.reset(k);
+
+    for (size_t i = 0; i < count; i++) {
+        results.insert(ids[i], euclidean(store, store.row(ids[i]), x_q));
+    }
+
+    return results.closest(k);
+}
+
+vector<unsigned int> RangeGreedySearch(const VectorStore& store, const DirectedGraph& graph, const vector<Node*>& nodes, const LabelIndex& labels, const vector<unsigned int>& start_nodes, const float* x_q, unsigned int k, unsigned int list_size, uint32_t walk_label, uint32_t result_label, float l, float r, SearchScratch& scratch) {
+    if (start_nodes.empty() || !x_q) {
+        return {};
+    }
+
+    VisitedSet& unique_nodes = scratch.visited;  // Nodes that have been added to L once
+    CandidatePool& L = scratch.pool;             // Search list, over every walked node
+    CandidatePool& results = scratch.results;    // The closest k nodes inside the window
+    unique_nodes.reset(graph.size());
+    L.reset(list_size);
+    results.reset(k);
+
+    auto walkable = [&](unsigned int id) {
+        return walk_label == NO_LABEL || labels.has(id, walk_label);
+    };
+
+    // Every node whose distance is computed is a result if it is inside the window and has the label
+    auto visit = [&](unsigned int id) {
+        float distance = euclidean(store, store.row(id), x_q);
+        L.insert(id, distance);
+        if (nodes[id]->timestamp >= l && nodes[id]->timestamp <= r
+            && (result_label == NO_LABEL || labels.has(id, result_label))) {
+            results.insert(id, distance);
+        }
+    };
+
+    for (unsigned int s : start_nodes) {
+        if (walkable(s) && unique_nodes.insert(s)) {
+            visit(s);
+        }
+    }
+
+    while (L.hasUnexpanded()) {
+        unsigned int p_star = L.expandNext();
+
+        // Nodes that are not results are still walked through, they lead to the ones that are
+        const uint32_t* neighbors = graph.neighbors(p_star);
+        for (uint32_t i = 0; i < graph.degree(p_star); i++) {
+            unsigned int neighbor = neighbors[i];
+            if (walkable(neighbor) && unique_nodes.insert(neighbor)) {
+                visit(neighbor);
+            }
+        }
+    }
+
+    return results.closest(k);
+}
+
+unsigned int rangeListSize(unsigned int list_size, size_t window, size_t walked) {
+    if (window == 0 || window >= walked) {
+        return list_size;
+    }
+    double growth = min<double>(RANGE_LIST_GROWTH, static_cast<double>(walked) / window);
+    return static_cast<unsigned int>(list_size * growth);
+}
@@ -1,90 +1,96 @@
 #include "../include/vamana.h"
 
 
-// This is the euklideian method to calculate the distance of 2 nodes
-float euclidean(const Node* a, const Node* b) {
-    float sum = 0.0;
-    for (size_t i = 0; i < a->coords.size(); ++i) {
-        float diff = a->coords[i] - b->coords[i];
-        sum += diff * diff;
-    }
-    return sum;
+// Distance of 2 nodes, looked up by id in the vector store
+float euclidean(const VectorStore& store, const Node* a, const Node* b) {
+    return euclidean(store, store.row(a->id), store.row(b->id));
 }
 
 
-// Compare function for 2 nodes based to their distance to another common node
-bool compare_distance(Node* node1, Node* node2) {
-    if (node1->distance == node2->distance) {
-        return node1->id < node2->id; // Secondary criterion: sort by ID
+// Compare function for 2 (distance, id) pairs, the distances being to a common node
+bool compare_distance(const pair<float, unsigned int>& a, const pair<float, unsigned int>& b) {
+    if (a.first == b.first) {
+        return a.second < b.second; // Secondary criterion: sort by ID
     }
-    return node1->distance < node2->distance;
+    return a.first < b.first;
 }
 
-void RobustPrune(Node* node, vector<Node*> possible_neighbours, float a, int max_neighbours) {
+// The prune of RobustPruneNeighbors, with distance(x, y) the distance between nodes x and y
+template <class Distance>
+static vector<unsigned int> pruneNeighbors(const DirectedGraph& graph, unsigned int p, vector<unsigned int> possible_neighbours, float a, int max_neighbours, Distance distance) {
     // Add existing neighbors to possible neighbors
-    for (Node* n_ptr : node->out_neighbors) {
-        possible_neighbours.push_back(n_ptr);
+    const uint32_t* neighbors = graph.neighbors(p);
+    for (uint32_t i = 0; i < graph.degree(p); i++) {
+        possible_neighbours.push_back(neighbors[i]);
     }
 
     // Remove self-loops
     for (auto it = possible_neighbours.begin(); it != possible_neighbours.end();) {
-        if ((*it)->id == node->id) {
+        if (*it == p) {
             it = possible_neighbours.erase(it);
         } else {
             ++it;
         }
     }
 
-    // Clear node's neighbors
-    node->out_neighbors.clear();
-
-    mutex dist_mutex; // Mutex for thread-safe access to distances
+    // (distance, id) pairs of the possible neighbors
+    vector<pair<float, unsigned int>> candidates(possible_neighbours.size());
 
-    // Parallel computation of distances
-    vector<thread> threads;
-    size_t num_threads = thread::hardware_concurrency();
-    size_t chunk_size = possible_neighbours.size() / num_threads;
+    // Each index writes only its own slot, so the distances need no lock
+    ThreadPool::instance().parallelFor(0, possible_neighbours.size(), [&](size_t i) {
+        unsigned int n = possible_neighbours[i];
+        candidates[i] = {distance(p, n), n};
+    }, DISTANCE_GRAIN);
 
-    for (size_t t = 0; t < num_threads; ++t) {
-        threads.emplace_back([&, t]() {
-            size_t start = t * chunk_size;
-            size_t end = (t == num_threads - 1) ? possible_neighbours.size() : start + chunk_size;
-
-            for (size_t i = start; i < end; ++i) {
-                Node* n = possible_neighbours[i];
-                lock_guard<mutex> lock(dist_mutex);
-                n->distance = euclidean(node, n);
-            }
-        });
-    }
-    for (auto& thread : threads) {
-        thread.join();
-    }
+    // Sort possible neighbors by distance, then by id
+    sort(candidates.begin(), candidates.end());
 
-    // Sort possible neighbors by distance
-    sort(possible_neighbours.begin(), possible_neighbours.end(), compare_distance);
+    size_t limit = min(static_cast<size_t>(max_neighbours), static_cast<size_t>(graph.R));
+    vector<unsigned int> out_neighbors;
 
     // Select closest neighbors with pruning
-    while (!possible_neighbours.empty()) {
-        Node* closest = possible_neighbours.front();
+    while (!candidates.empty() && out_neighbors.size() < limit) {
+        unsigned int closest = candidates.front().second;
 
         // Add the closest node to the neighbors of the node
-        node->out_neighbors.push_back(closest);
-        possible_neighbours.erase(possible_neighbours.begin());
+        out_neighbors.push_back(closest);
+        candidates.erase(candidates.begin());
 
-        if (node->out_neighbors.size() == static_cast<size_t>(max_neighbours)) {
+        if (out_neighbors.size() == limit) {
             break;
         }
 
         // Pruning method
-        auto it = possible_neighbours.begin();
-        while (it != possible_neighbours.end()) {
-            float pruning = a * euclidean(closest, *it);
-            if (pruning <= (*it)->distance) {
-                it = possible_neighbours.erase(it);
+        auto it = candidates.begin();
+        while (it != candidates.end()) {
+            float pruning = a * distance(closest, it->second);
+            if (pruning <= it->first) {
+                it = candidates.erase(it);
             } else {
                 ++it;
             }
         }
     }
-}
\ No newline at end of file
+
+    return out_neighbors;
+}
+
+vector<unsigned int> RobustPruneNeighbors(const VectorStore& store, const DirectedGraph& graph, unsigned int p, vector<unsigned int> possible_neighbours, float a, int max_neighbours) {
+    return pruneNeighbors(graph, p, move(possible_neighbours), a, max_neighbours, [&](unsigned int x, unsigned int y) {
+        return euclidean(store, store.row(x), store.row(y));
+    });
+}
+
+void RobustPrune(const VectorStore& store, DirectedGraph& graph, unsigned int p, vector<unsigned int> possible_neighbours, float a, int max_neighbours) {
+    graph.setNeighbors(p, RobustPruneNeighbors(store, graph, p, move(possible_neighbours), a, max_neighbours));
+}
+
+vector<unsigned int> RobustPruneNeighbors(const ScalarQuantizedStore& codes, const DirectedGraph& graph, unsigned int p, vector<unsigned int> possible_neighbours, float a, int max_neighbours) {
+    return pruneNeighbors(graph, p, move(possible_neighbours), a, max_neighbours, [&](unsigned int x, unsigned int y) {
+        return codes.distance(x, y);
+    });
+}
+
+void RobustPrune(const ScalarQuantizedStore& codes, DirectedGraph& graph, unsigned int p, vector<unsigned int> possible_neighbours, float a, int max_neighbours) {
+    graph.setNeighbors(p, RobustPruneNeighbors(codes, graph, p, move(possible_neighbours), a, max_neighbours));
+}
@@ -1,72 +1,59 @@
 #include "../include/vamana.h"
-#include <thread>
-#include <mutex>
 
-void RobustPrune_Threads(Node* node, vector<Node*> possible_neighbours, float a, int max_neighbours) {
+void RobustPrune_Threads(const VectorStore& store, DirectedGraph& graph, unsigned int p, vector<unsigned int> possible_neighbours, float a, int max_neighbours) {
     // Add existing neighbors to possible neighbors
-    for (Node* n_ptr : node->out_neighbors) {
-        possible_neighbours.push_back(n_ptr);
+    const uint32_t* neighbors = graph.neighbors(p);
+    for (uint32_t i = 0; i < graph.degree(p); i++) {
+        possible_neighbours.push_back(neighbors[i]);
     }
 
     // Remove self-loops
     for (auto it = possible_neighbours.begin(); it != possible_neighbours.end();) {
-        if ((*it)->id == node->id) {
+        if (*it == p) {
             it = possible_neighbours.erase(it);
         } else {
             ++it;
         }
     }
 
-    // Clear node's neighbors
-    node->out_neighbors.clear();
+    // (distance, id) pairs of the possible neighbors
+    vector<pair<float, unsigned int>> candidates(possible_neighbours.size());
 
-    mutex dist_mutex; // Mutex for thread-safe access to distances
+    // Each index writes only its own slot, so the distances need no lock
+    ThreadPool::instance().parallelFor(0, possible_neighbours.size(), [&](size_t i) {
+        unsigned int n = possible_neighbours[i];
+        candidates[i] = {euclidean(store, store.row(p), store.row(n)), n};
+    }, DISTANCE_GRAIN);
 
-    // Parallel computation of distances
-    vector<thread> threads;
-    size_t num_threads = thread::hardware_concurrency();
-    size_t chunk_size = possible_neighbours.size() / num_threads;
+    // Sort possible neighbors by distance, then by id
+    sort(candidates.begin(), candidates.end());
 
-    for (size_t t = 0; t < num_threads; ++t) {
-        threads.emplace_back([&, t]() {
-            size_t start = t * chunk_size;
-            size_t end = (t == num_threads - 1) ? possible_neighbours.size() : start + chunk_size;
-
-            for (size_t i = start; i < end; ++i) {
-                Node* n = possible_neighbours[i];
-                lock_guard<mutex> lock(dist_mutex);
-                n->distance = euclidean(node, n);
-            }
-        });
-    }
-    for (auto& thread : threads) {
-        thread.join();
-    }
-
-    // Sort possible neighbors by distance
-    sort(possible_neighbours.begin(), possible_neighbours.end(), compare_distance);
+    size_t limit = min(static_cast<size_t>(max_neighbours), static_cast<size_t>(graph.R));
+    vector<unsigned int> out_neighbors;
 
     // Select closest neighbors with pruning
-    while (!possible_neighbours.empty()) {
-        Node* closest = possible_neighbours.front();
+    while (!candidates.empty() && out_neighbors.size() < limit) {
+        unsigned int closest = candidates.front().second;
 
         // Add the closest node to the neighbors of the node
-        node->out_neighbors.push_back(closest);
-        possible_neighbours.erase(possible_neighbours.begin());
+        out_neighbors.push_back(closest);
+        candidates.erase(candidates.begin());
 
-        if (node->out_neighbors.size() == static_cast<size_t>(max_neighbours)) {
+        if (out_neighbors.size() == limit) {
             break;
         }
 
         // Pruning method
-        auto it = possible_neighbours.begin();
-        while (it != possible_neighbours.end()) {
-            float pruning = a * euclidean(closest, *it);
-            if (pruning <= (*it)->distance) {
-                it = possible_neighbours.erase(it);
+        auto it = candidates.begin();
+        while (it != candidates.end()) {
+            float pruning = a * euclidean(store, store.row(closest), store.row(it->second));
+            if (pruning <= it->first) {
+                it = candidates.erase(it);
             } else {
                 ++it;
             }
         }
     }
+
+    graph.setNeighbors(p, out_neighbors);
 }
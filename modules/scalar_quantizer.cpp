@@ -0,0 +1,325 @@
+#include "../include/vamana.h"
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define VAMANA_X86 1
+#endif
+
+// Bytes of a row of codes are padded to whole cache lines
+constexpr size_t ROW_ALIGNMENT = 64;
+
+
+// IEEE half precision, rounded to the nearest even like the F16C conversion
+static uint16_t floatToHalf(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint16_t sign = (bits >> 16) & 0x8000;
+    uint32_t biased = (bits >> 23) & 0xff;
+    uint32_t mantissa = bits & 0x7fffff;
+
+    if (biased == 0xff) {
+        return sign | 0x7c00 | (mantissa ? 0x200 : 0);  // infinity or NaN
+    }
+    int32_t exponent = static_cast<int32_t>(biased) - 127 + 15;
+    if (exponent >= 31) {
+        return sign | 0x7c00;  // too large, infinity
+    }
+
+    uint32_t half, rest, halfway;
+    if (exponent <= 0) {
+        // Subnormal half, or zero below the smallest one
+        if (exponent < -10) {
+            return sign;
+        }
+        mantissa |= 0x800000;
+        uint32_t shift = 14 - exponent;
+        half = mantissa >> shift;
+        rest = mantissa & ((1u << shift) - 1);
+        halfway = 1u << (shift - 1);
+    } else {
+        half = (exponent << 10) | (mantissa >> 13);
+        rest = mantissa & 0x1fff;
+        halfway = 0x1000;
+    }
+    // A carry out of the mantissa moves to the next exponent, which is still the right value
+    if (rest > halfway || (rest == halfway && (half & 1))) {
+        half++;
+    }
+    return sign | half;
+}
+
+static float halfToFloat(uint16_t half) {
+    uint32_t sign = static_cast<uint32_t>(half & 0x8000) << 16;
+    uint32_t exponent = (half >> 10) & 0x1f;
+    uint32_t mantissa = half & 0x3ff;
+    uint32_t bits;
+
+    if (exponent == 0 && mantissa == 0) {
+        bits = sign;
+    } else if (exponent == 0) {
+        // Subnormal, normalised for the float
+        exponent = 127 - 15 + 1;
+        while (!(mantissa & 0x400)) {
+            mantissa <<= 1;
+            exponent--;
+        }
+        bits = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+    } else if (exponent == 31) {
+        bits = sign | 0x7f800000 | (mantissa << 13);
+    } else {
+        bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+    }
+
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+
+// Plain loops, for the CPUs without AVX2, FMA and F16C
+static float fp16ToQueryScalar(const float* x_q, const uint8_t* row, const float*, const float*, size_t begin, size_t dim) {
+    const uint16_t* halves = reinterpret_cast<const uint16_t*>(row);
+    float sum = 0.0f;
+    for (size_t d = begin; d < dim; d++) {
+        float diff = x_q[d] - halfToFloat(halves[d]);
+        sum += diff * diff;
+    }
+    return sum;
+}
+
+static float fp16BetweenScalar(const uint8_t* a, const uint8_t* b, const float*, size_t begin, size_t dim) {
+    const uint16_t* x = reinterpret_cast<const uint16_t*>(a);
+    const uint16_t* y = reinterpret_cast<const uint16_t*>(b);
+    float sum = 0.0f;
+    for (size_t d = begin; d < dim; d++) {
+        float diff = halfToFloat(x[d]) - halfToFloat(y[d]);
+        sum += diff * diff;
+    }
+    return sum;
+}
+
+static float sq8ToQueryScalar(const float* x_q, const uint8_t* row, const float* scale, const float* offset, size_t begin, size_t dim) {
+    float sum = 0.0f;
+    for (size_t d = begin; d < dim; d++) {
+        float diff = x_q[d] - (offset[d] + scale[d] * row[d]);
+        sum += diff * diff;
+    }
+    return sum;
+}
+
+static float sq8BetweenScalar(const uint8_t* a, const uint8_t* b, const float* scale, size_t begin, size_t dim) {
+    float sum = 0.0f;
+    for (size_t d = begin; d < dim; d++) {
+        float diff = scale[d] * (static_cast<int>(a[d]) - static_cast<int>(b[d]));
+        sum += diff * diff;
+    }
+    return sum;
+}
+
+static float fp16ToQuery(const float* x_q, const uint8_t* row, const float* scale, const float* offset, size_t dim) {
+    return fp16ToQueryScalar(x_q, row, scale, offset, 0, dim);
+}
+
+static float fp16Between(const uint8_t* a, const uint8_t* b, const float* scale, size_t dim) {
+    return fp16BetweenScalar(a, b, scale, 0, dim);
+}
+
+static float sq8ToQuery(const float* x_q, const uint8_t* row, const float* scale, const float* offset, size_t dim) {
+    return sq8ToQueryScalar(x_q, row, scale, offset, 0, dim);
+}
+
+static float sq8Between(const uint8_t* a, const uint8_t* b, const float* scale, size_t dim) {
+    return sq8BetweenScalar(a, b, scale, 0, dim);
+}
+
+#ifdef VAMANA_X86
+
+__attribute__((target("avx2,fma")))
+static inline float horizontalSum(__m256 sum8) {
+    __m128 sum4 = _mm_add_ps(_mm256_castps256_ps128(sum8), _mm256_extractf128_ps(sum8, 1));
+    sum4 = _mm_add_ps(sum4, _mm_movehl_ps(sum4, sum4));
+    sum4 = _mm_add_ss(sum4, _mm_shuffle_ps(sum4, sum4, 1));
+    return _mm_cvtss_f32(sum4);
+}
+
+// The lanes of the last dim % 8 dimensions, the others are loaded as zeros
+__attribute__((target("avx2,fma")))
+static inline __m256i tailMask(size_t remaining) {
+    return _mm256_cmpgt_epi32(_mm256_set1_epi32(static_cast<int>(remaining)), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+}
+
+// The kernels take the last dim % 8 dimensions as one more masked step instead of the plain loops:
+// those are compiled without AVX, and running them with the upper halves of the registers dirty
+// costs a transition on every call, more than the rest of the distance.
+
+// 8 halves at a time, widened to floats by F16C
+__attribute__((target("avx2,fma,f16c")))
+static float fp16ToQueryAvx2(const float* x_q, const uint8_t* row, const float*, const float*, size_t dim) {
+    const uint16_t* halves = reinterpret_cast<const uint16_t*>(row);
+    __m256 sum = _mm256_setzero_ps();
+    size_t d = 0;
+    for (; d + 8 <= dim; d += 8) {
+        __m256 x = _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(halves + d)));
+        __m256 diff = _mm256_sub_ps(_mm256_loadu_ps(x_q + d), x);
+        sum = _mm256_fmadd_ps(diff, diff, sum);
+    }
+    if (d < dim) {
+        __m256i mask = tailMask(dim - d);
+        uint16_t rest[8] = {};
+        memcpy(rest, halves + d, (dim - d) * sizeof(uint16_t));
+        __m256 diff = _mm256_sub_ps(_mm256_maskload_ps(x_q + d, mask), _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(rest))));
+        sum = _mm256_fmadd_ps(diff, diff, sum);
+    }
+    return horizontalSum(sum);
+}
+
+__attribute__((target("avx2,fma,f16c")))
+static float fp16BetweenAvx2(const uint8_t* a, const uint8_t* b, const float*, size_t dim) {
+    const uint16_t* x = reinterpret_cast<const uint16_t*>(a);
+    const uint16_t* y = reinterpret_cast<const uint16_t*>(b);
+    __m256 sum = _mm256_setzero_ps();
+    size_t d = 0;
+    for (; d + 8 <= dim; d += 8) {
+        __m256 diff = _mm256_sub_ps(_mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(x + d))),
+                                    _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(y + d))));
+        sum = _mm256_fmadd_ps(diff, diff, sum);
+    }
+    if (d < dim) {
+        uint16_t rest_x[8] = {}, rest_y[8] = {};
+        memcpy(rest_x, x + d, (dim - d) * sizeof(uint16_t));
+        memcpy(rest_y, y + d, (dim - d) * sizeof(uint16_t));
+        __m256 diff = _mm256_sub_ps(_mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(rest_x))),
+                                    _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(rest_y))));
+        sum = _mm256_fmadd_ps(diff, diff, sum);
+    }
+    return horizontalSum(sum);
+}
+
+// 8 bytes at a time, widened to floats and mapped back to the range of their dimension.
+// Masked lanes have a zero scale and offset, so they decode to the zero of the query.
+__attribute__((target("avx2,fma")))
+static float sq8ToQueryAvx2(const float* x_q, const uint8_t* row, const float* scale, const float* offset, size_t dim) {
+    __m256 sum = _mm256_setzero_ps();
+    size_t d = 0;
+    for (; d + 8 <= dim; d += 8) {
+        __m256 codes = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(row + d))));
+        __m256 x = _mm256_fmadd_ps(_mm256_loadu_ps(scale + d), codes, _mm256_loadu_ps(offset + d));
+        __m256 diff = _mm256_sub_ps(_mm256_loadu_ps(x_q + d), x);
+        sum = _mm256_fmadd_ps(diff, diff, sum);
+    }
+    if (d < dim) {
+        __m256i mask = tailMask(dim - d);
+        uint8_t rest[8] = {};
+        memcpy(rest, row + d, dim - d);
+        __m256 codes = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(rest))));
+        __m256 x = _mm256_fmadd_ps(_mm256_maskload_ps(scale + d, mask), codes, _mm256_maskload_ps(offset + d, mask));
+        __m256 diff = _mm256_sub_ps(_mm256_maskload_ps(x_q + d, mask), x);
+        sum = _mm256_fmadd_ps(diff, diff, sum);
+    }
+    return horizontalSum(sum);
+}
+
+// The offsets cancel out, so two codes only differ by the integer difference times the scale
+__attribute__((target("avx2,fma")))
+static float sq8BetweenAvx2(const uint8_t* a, const uint8_t* b, const float* scale, size_t dim) {
+    __m256 sum = _mm256_setzero_ps();
+    size_t d = 0;
+    for (; d + 8 <= dim; d += 8) {
+        __m256i x = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(a + d)));
+        __m256i y = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(b + d)));
+        __m256 diff = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_sub_epi32(x, y)), _mm256_loadu_ps(scale + d));
+        sum = _mm256_fmadd_ps(diff, diff, sum);
+    }
+    if (d < dim) {
+        uint8_t rest_a[8] = {}, rest_b[8] = {};
+        memcpy(rest_a, a + d, dim - d);
+        memcpy(rest_b, b + d, dim - d);
+        __m256i x = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(rest_a)));
+        __m256i y = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(rest_b)));
+        __m256 diff = _mm256_cvtepi32_ps(_mm256_sub_epi32(x, y));
+        diff = _mm256_mul_ps(diff, _mm256_maskload_ps(scale + d, tailMask(dim - d)));
+        sum = _mm256_fmadd_ps(diff, diff, sum);
+    }
+    return horizontalSum(sum);
+}
+
+#endif
+
+static bool simdSupported(ScalarPrecision precision) {
+#ifdef VAMANA_X86
+    bool avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    return precision == PRECISION_FP16 ? avx2 && __builtin_cpu_supports("f16c") : avx2;
+#else
+    (void)precision;
+    return false;
+#endif
+}
+
+
+ScalarQuantizedStore::ScalarQuantizedStore(const VectorStore& store, ScalarPrecision precision, bool simd)
+    : precision(precision), count(store.count), dim(store.dim) {
+    size_t bytes_per_value = precision == PRECISION_FP16 ? sizeof(uint16_t) : sizeof(uint8_t);
+    row_bytes = (dim * bytes_per_value + ROW_ALIGNMENT - 1) / ROW_ALIGNMENT * ROW_ALIGNMENT;
+    codes.assign(count * row_bytes, 0);
+
+    simd = simd && simdSupported(precision);
+    if (precision == PRECISION_FP16) {
+        to_query = fp16ToQuery;
+        between = fp16Between;
+#ifdef VAMANA_X86
+        if (simd) {
+            to_query = fp16ToQueryAvx2;
+            between = fp16BetweenAvx2;
+        }
+#endif
+        for (size_t i = 0; i < count; i++) {
+            uint16_t* halves = reinterpret_cast<uint16_t*>(codes.data() + i * row_bytes);
+            for (size_t d = 0; d < dim; d++) {
+                halves[d] = floatToHalf(store.row(i)[d]);
+            }
+        }
+        return;
+    }
+
+    to_query = sq8ToQuery;
+    between = sq8Between;
+#ifdef VAMANA_X86
+    if (simd) {
+        to_query = sq8ToQueryAvx2;
+        between = sq8BetweenAvx2;
+    }
+#endif
+
+    // Every dimension gets its own range, the 256 codes spread evenly from its minimum to its maximum
+    vector<float> low(dim, numeric_limits<float>::max());
+    vector<float> high(dim, numeric_limits<float>::lowest());
+    for (size_t i = 0; i < count; i++) {
+        for (size_t d = 0; d < dim; d++) {
+            low[d] = min(low[d], store.row(i)[d]);
+            high[d] = max(high[d], store.row(i)[d]);
+        }
+    }
+    offset.assign(dim, 0.0f);
+    scale.assign(dim, 0.0f);
+    for (size_t d = 0; d < dim && count > 0; d++) {
+        offset[d] = low[d];
+        scale[d] = (high[d] - low[d]) / 255.0f;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        uint8_t* row = codes.data() + i * row_bytes;
+        for (size_t d = 0; d < dim; d++) {
+            float code = scale[d] > 0.0f ? round((store.row(i)[d] - offset[d]) / scale[d]) : 0.0f;
+            row[d] = static_cast<uint8_t>(min(255.0f, max(0.0f, code)));
+        }
+    }
+}
+
+void ScalarQuantizedStore::decode(unsigned int id, float* x) const {
+    const uint8_t* r = row(id);
+    for (size_t d = 0; d < dim; d++) {
+        x[d] = precision == PRECISION_FP16 ? halfToFloat(reinterpret_cast<const uint16_t*>(r)[d]) : offset[d] + scale[d] * r[d];
+    }
+}
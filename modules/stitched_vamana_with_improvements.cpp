@@ -1,19 +1,23 @@
 #include "../include/vamana.h"
 
-void StitchedVamana_WithImprovement(vector<Node*>& nodes, float a, int L_small, int R_small, int R_stitched) {
-    // Find all the unique filters
-    unordered_set<float> uniqueFilters;
-    unordered_map<float, vector<Node*>> commonFilter;
+DirectedGraph StitchedVamana_WithImprovement(const VectorStore& store, vector<Node*>& nodes, float a, int L_small, int R_small, int R_stitched) {
+    // One graph for all the labels, wide enough for both the small and the stitched degree
+    DirectedGraph graph(store.count, max(R_small, R_stitched));
 
-    for (Node* n : nodes) {
-        uniqueFilters.insert(n->filter);
-        commonFilter[n->filter].push_back(n);
+    // Organize nodes by their label
+    LabelIndex labels(nodes);
+    vector<vector<Node*>> commonFilter(labels.size());
+    for (uint32_t label = 0; label < labels.size(); label++) {
+        for (const uint32_t* id = labels.begin(label); id != labels.end(label); id++) {
+            commonFilter[label].push_back(nodes[*id]);
+        }
     }
 
-    cout << "Unique filters: " << uniqueFilters.size() << endl;
+    cout << "Unique filters: " << labels.size() << endl;
 
      // Randomly interconnect filters by adding random edges between filters
-    vector<float> filters(uniqueFilters.begin(), uniqueFilters.end());
+    vector<uint32_t> filters(labels.size());
+    iota(filters.begin(), filters.end(), 0);
 
      // Shuffle filters
     for (size_t i = 0; i < filters.size(); ++i) {
@@ -33,28 +37,34 @@ void StitchedVamana_WithImprovement(vector<Node*>& nodes, float a, int L_small,
                 Node* node1 = filterGroup1[rand() % filterGroup1.size()];
                 Node* node2 = filterGroup2[rand() % filterGroup2.size()];
 
-                node1->out_neighbors.push_back(node2);
-                node2->out_neighbors.push_back(node1);
+                graph.addNeighbor(node1->id, node2->id);
+                graph.addNeighbor(node2->id, node1->id);
             }
         }
     }
 
     cout << "Added random edges between filters\n";
 
-    for (float filter : uniqueFilters) {
-        VamanaIndexingAlgorithm(commonFilter[filter], 20, L_small, R_small, a, commonFilter[filter].size(), 1, 3500);
+    for (vector<Node*>& group : commonFilter) {
+        VamanaIndexingAlgorithm(store, graph, group, 20, L_small, R_small, a, group.size(), 1, 3500);
     }
 
     // cout << "All Good Vamana\n";
 
     for (Node* n : nodes) {
-        FilteredRobustPrune(n, n->out_neighbors, a, R_stitched);
+        FilteredRobustPrune(store, graph, labels, n->id, {}, a, R_stitched);
         // Filter out neighbors with different filters after pruning
-        n->out_neighbors.erase(
-            std::remove_if(n->out_neighbors.begin(), n->out_neighbors.end(),
-                        [n](Node* neighbor) { return neighbor->filter != n->filter; }),
-            n->out_neighbors.end());
+        vector<unsigned int> same_filter;
+        for (uint32_t i = 0; i < graph.degree(n->id); i++) {
+            unsigned int neighbor = graph.neighbors(n->id)[i];
+            if (labels.shares(n->id, neighbor)) {
+                same_filter.push_back(neighbor);
+            }
+        }
+        graph.setNeighbors(n->id, same_filter);
     }
 
     // cout << "finish\n";
-}
\ No newline at end of file
+
+    return graph;
+}
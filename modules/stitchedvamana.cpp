@@ -1,24 +1,85 @@
 #include "../include/vamana.h"
 
 
-void StitchedVamana(std::vector<Node*>& nodes, float a, int L_small, int R_small, int R_stiched) {
-    // Find all the unique filters
-    unordered_set<float> uniqueFilters;
-    for (Node* n : nodes) {
-        uniqueFilters.insert(n->filter);
-    }
+DirectedGraph StitchedVamana(const VectorStore& store, std::vector<Node*>& nodes, float a, int L_small, int R_small, int R_stiched, unsigned int num_threads) {
+    return StitchedVamana(store, nodes, LabelIndex(nodes), a, L_small, R_small, R_stiched, num_threads);
+}
 
-    // Organize nodes by their filter
-    unordered_map<float, vector<Node*>> commonFilter;
-    for (Node* n : nodes) {
-        commonFilter[n->filter].push_back(n);
+// Builds the graph of one label over its members, on the threads of `pool`
+static void buildLabel(const VectorStore& store, DirectedGraph& graph, vector<Node*>& nodes, const LabelIndex& labels, uint32_t label, float a, int L_small, int R_small, ThreadPool& pool) {
+    vector<Node*> members;
+    members.reserve(labels.count(label));
+    for (const uint32_t* id = labels.begin(label); id != labels.end(label); id++) {
+        members.push_back(nodes[*id]);
     }
+    VamanaIndexingAlgorithm(store, graph, members, 100, L_small, R_small, a, members.size(), 1, 3500, pool);
+}
 
-    for (float filter : uniqueFilters) {
-            VamanaIndexingAlgorithm(commonFilter[filter], 100, L_small, R_small, a, commonFilter[filter].size(), 1, 3500);
-    }
+DirectedGraph StitchedVamana(const VectorStore& store, std::vector<Node*>& nodes, const LabelIndex& labels, float a, int L_small, int R_small, int R_stiched, unsigned int num_threads) {
+    // One graph for all the labels, wide enough for both the small and the stitched degree
+    DirectedGraph graph(store.count, max(R_small, R_stiched));
+    num_threads = max(1u, num_threads);
+
+    // One pool for the whole build, the calling thread is the last worker
+    ThreadPool pool(num_threads - 1);
+
+    // Largest labels first, so the long builds do not start last
+    vector<uint32_t> order(labels.size());
+    iota(order.begin(), order.end(), 0);
+    sort(order.begin(), order.end(), [&](uint32_t x, uint32_t y) {
+        return labels.count(x) > labels.count(y) || (labels.count(x) == labels.count(y) && x < y);
+    });
+
+    // The neighbors that nodes with several labels get from every label, kept until the stitching
+    unordered_map<unsigned int, vector<unsigned int>> earlier;
+
+    if (!labels.ofNode()) {
+        // Labels share nodes, so their builds would write the same rows. One label at a time, each on all threads.
+        // Every build starts on empty rows for its members, so the walks, the prunes and the reverse edges
+        // of a label only ever see the edges of that label, and the rows of nodes with several labels are
+        // saved before the next label that has them clears them.
+        for (uint32_t label : order) {
+            for (const uint32_t* id = labels.begin(label); id != labels.end(label); id++) {
+                graph.setNeighbors(*id, {});
+            }
 
-    for (Node* n : nodes) {
-            FilteredRobustPrune(n, n->out_neighbors, a, R_stiched);
+            buildLabel(store, graph, nodes, labels, label, a, L_small, R_small, pool);
+
+            for (const uint32_t* id = labels.begin(label); id != labels.end(label); id++) {
+                if (labels.labelsEnd(*id) - labels.labelsBegin(*id) > 1) {
+                    vector<unsigned int>& kept = earlier[*id];
+                    kept.insert(kept.end(), graph.neighbors(*id), graph.neighbors(*id) + graph.degree(*id));
+                }
+            }
+        }
+
+        // Two labels can give a node the same neighbor
+        for (auto& [id, kept] : earlier) {
+            sort(kept.begin(), kept.end());
+            kept.erase(unique(kept.begin(), kept.end()), kept.end());
+        }
+    } else {
+        // Every label writes only the rows of its own members, so the labels are built at the same time.
+        // A label with more than a thread's share of the nodes is built on its own with all the threads,
+        // the rest are built one per thread.
+        size_t large = 0;
+        while (large < order.size() && labels.count(order[large]) * num_threads > labels.nodeCount()) {
+            buildLabel(store, graph, nodes, labels, order[large], a, L_small, R_small, pool);
+            large++;
+        }
+
+        // A pool without workers starts no threads, so every small label runs on the thread that picks it
+        ThreadPool serial(0);
+        pool.parallelFor(large, order.size(), [&](size_t i) {
+            buildLabel(store, graph, nodes, labels, order[i], a, L_small, R_small, serial);
+        });
     }
-}
\ No newline at end of file
+
+    // Every prune only writes the row of its own node
+    pool.parallelFor(0, nodes.size(), [&](size_t i) {
+            auto it = earlier.find(nodes[i]->id);
+            FilteredRobustPrune(store, graph, labels, nodes[i]->id, it == earlier.end() ? vector<unsigned int>{} : it->second, a, R_stiched);
+    }, 64);
+
+    return graph;
+}
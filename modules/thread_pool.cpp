@@ -0,0 +1,147 @@
+#include "../include/vamana.h"
+
+
+ThreadPool::ThreadPool(size_t num_threads) {
+    for (size_t i = 0; i < num_threads; i++) {
+        queues.push_back(make_unique<TaskQueue>());
+    }
+    for (size_t i = 0; i < num_threads; i++) {
+        workers.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        lock_guard<mutex> lock(sleep_lock);
+        stopping = true;
+    }
+    wake.notify_all();
+
+    for (thread& worker : workers) {
+        worker.join();
+    }
+}
+
+ThreadPool& ThreadPool::instance() {
+    static ThreadPool pool(max(1u, thread::hardware_concurrency()));
+    return pool;
+}
+
+void ThreadPool::submit(function<void()> task) {
+    if (workers.empty()) {
+        task();
+        return;
+    }
+
+    {
+        lock_guard<mutex> lock(sleep_lock);
+        pending++;
+    }
+
+    TaskQueue& queue = *queues[next_queue++ % queues.size()];
+    {
+        lock_guard<mutex> lock(queue.lock);
+        queue.tasks.push_back(move(task));
+    }
+    wake.notify_one();
+}
+
+bool ThreadPool::takeTask(size_t index, function<void()>& task) {
+    // Newest task of the worker's own queue first
+    {
+        TaskQueue& own = *queues[index];
+        lock_guard<mutex> lock(own.lock);
+        if (!own.tasks.empty()) {
+            task = move(own.tasks.back());
+            own.tasks.pop_back();
+            pending--;
+            return true;
+        }
+    }
+
+    // Then steal the oldest task of another queue
+    for (size_t i = 1; i < queues.size(); i++) {
+        TaskQueue& other = *queues[(index + i) % queues.size()];
+        lock_guard<mutex> lock(other.lock);
+        if (!other.tasks.empty()) {
+            task = move(other.tasks.front());
+            other.tasks.pop_front();
+            pending--;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void ThreadPool::workerLoop(size_t index) {
+    function<void()> task;
+    while (true) {
+        if (takeTask(index, task)) {
+            task();
+            task = nullptr;
+            continue;
+        }
+
+        unique_lock<mutex> lock(sleep_lock);
+        wake.wait(lock, [&] { return stopping || pending > 0; });
+        if (stopping && pending == 0) {
+            return;
+        }
+    }
+}
+
+void ThreadPool::parallelFor(size_t begin, size_t end, const function<void(size_t)>& body, size_t grain) {
+    parallelForSlots(begin, end, [&body](size_t i, size_t) { body(i); }, grain);
+}
+
+void ThreadPool::parallelForSlots(size_t begin, size_t end, const function<void(size_t, size_t)>& body, size_t grain) {
+    if (begin >= end) {
+        return;
+    }
+
+    grain = max<size_t>(grain, 1);
+    size_t chunks = (end - begin + grain - 1) / grain;
+
+    // A single chunk is not worth waking a worker for
+    if (chunks == 1 || workers.empty()) {
+        for (size_t i = begin; i < end; i++) {
+            body(i, 0);
+        }
+        return;
+    }
+
+    // Shared with the helper tasks, since a helper can start after the loop is over.
+    // Such a helper finds no chunk left, so it never touches `body`.
+    struct Loop {
+        atomic<size_t> next{0};
+        atomic<size_t> done{0};
+        atomic<size_t> slots{0};
+    };
+    shared_ptr<Loop> loop = make_shared<Loop>();
+
+    auto run = [loop, begin, end, grain, chunks, &body]() {
+        size_t slot = loop->slots.fetch_add(1);
+        size_t chunk;
+        while ((chunk = loop->next.fetch_add(1)) < chunks) {
+            size_t first = begin + chunk * grain;
+            size_t last = min(end, first + grain);
+            for (size_t i = first; i < last; i++) {
+                body(i, slot);
+            }
+            loop->done.fetch_add(1, memory_order_release);
+        }
+    };
+
+    size_t helpers = min(workers.size(), chunks - 1);
+    for (size_t i = 0; i < helpers; i++) {
+        submit(run);
+    }
+
+    run();
+
+    // Every chunk has been taken, wait for the ones still running on other threads
+    while (loop->done.load(memory_order_acquire) < chunks) {
+        this_thread::yield();
+    }
+}
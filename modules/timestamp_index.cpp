@@ -0,0 +1,33 @@
+#include "../include/vamana.h"
+
+
+pair<size_t, size_t> SortedTimestamps::window(float l, float r) const {
+    size_t first = lower_bound(timestamps.begin(), timestamps.end(), l) - timestamps.begin();
+    size_t last = upper_bound(timestamps.begin(), timestamps.end(), r) - timestamps.begin();
+    return {first, max(first, last)};
+}
+
+// Sorts the ids by timestamp and keeps the timestamps next to them for the binary searches
+static void sortByTimestamp(SortedTimestamps& sorted, const vector<Node*>& nodes) {
+    sort(sorted.ids.begin(), sorted.ids.end(), [&](unsigned int a, unsigned int b) {
+        return nodes[a]->timestamp < nodes[b]->timestamp || (nodes[a]->timestamp == nodes[b]->timestamp && a < b);
+    });
+
+    sorted.timestamps.resize(sorted.ids.size());
+    for (size_t i = 0; i < sorted.ids.size(); i++) {
+        sorted.timestamps[i] = nodes[sorted.ids[i]]->timestamp;
+    }
+}
+
+TimestampIndex::TimestampIndex(const vector<Node*>& nodes, const LabelIndex& labels) : by_label(labels.size()) {
+    all.ids.reserve(nodes.size());
+    for (const Node* node : nodes) {
+        all.ids.push_back(node->id);
+    }
+    sortByTimestamp(all, nodes);
+
+    for (uint32_t label = 0; label < labels.size(); label++) {
+        by_label[label].ids.assign(labels.begin(label), labels.end(label));
+        sortByTimestamp(by_label[label], nodes);
+    }
+}
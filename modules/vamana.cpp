@@ -1,9 +1,7 @@
 #include "../include/vamana.h"
 
 //random R-regulated directed graph
-void initializeRandomGraph(vector<Node*>& nodes, unsigned int R) {
-    srand(static_cast<unsigned int>(time(nullptr)));
-
+void initializeRandomGraph(DirectedGraph& graph, vector<Node*>& nodes, unsigned int R) {
     if (R >= nodes.size()) {
         //cerr << "Error: R must be less than the number of nodes." << endl;
         return;
@@ -14,81 +12,79 @@ void initializeRandomGraph(vector<Node*>& nodes, unsigned int R) {
         
         while (neighbors.size() < R) {
             unsigned int random_index = rand() % nodes.size();
-            if (random_index != node->id && neighbors.find(random_index) == neighbors.end()) {
-                node->out_neighbors.push_back(nodes[random_index]);
+            if (nodes[random_index]->id != node->id && neighbors.find(random_index) == neighbors.end()) {
+                graph.addNeighbor(node->id, nodes[random_index]->id);
                 neighbors.insert(random_index);
             }
         }
     }
 }
 
-void VamanaIndexingAlgorithm(vector<Node*>& nodes, int k, int L, int R, float a, int n, int medoidCase, int subsetSize) {
-    //Step 1: Initialize a random R directed graph
-    initializeRandomGraph(nodes, R);
-
-    //Step 2: Find the medoid s of the dataset 
-    Node* s = nullptr;
-
-    if (n == 0)
-        return;     //empty
+// The search list of point p, GreedySearch from s towards the vector of p
+static vector<unsigned int> searchFor(const VectorStore& store, const DirectedGraph& graph, unsigned int s, unsigned int p, int L) {
+    return GreedySearch(store, graph, s, store.row(p), 1, L);
+}
 
-    if (medoidCase== 0) {
-        // Case 0: Select a random point
-        s = nodes[rand() % n];
-    } else if (medoidCase == 1) {
-        // Case 1: Select a random subset and compute medoid
-        vector<Node*> subset;
-        for (int i = 0; i < subsetSize && i < n; i++) {
-            subset.push_back(nodes[rand() % n]);
-        }
+// On the quantized rows the query is the decoded row of p, so the walk compares it with the
+// other rows through the same kernel as the searches
+static vector<unsigned int> searchFor(const ScalarQuantizedStore& codes, const DirectedGraph& graph, unsigned int s, unsigned int p, int L) {
+    static thread_local vector<float> x_p;
+    static thread_local SearchScratch scratch;
+    x_p.resize(codes.dim);
+    codes.decode(p, x_p.data());
+    return GreedySearch(codes, graph, vector<unsigned int>{s}, x_p.data(), 1, L, scratch);
+}
 
-        // Compute medoid for the subset
-        double min_dist = numeric_limits<double>::max();
-        int medoidIndex = 0;
-        for (int i = 0; i < (int)subset.size(); i++) {
-            double total_dist = 0;
-            for (int j = 0; j < (int)subset.size(); j++) {
-                if (i != j) {
-                    total_dist += euclidean(subset[i], subset[j]);
+// Locks of the parallel build: node `id` is guarded by stripe id % LOCK_STRIPES
+constexpr size_t LOCK_STRIPES = 4096;
+
+// Inserts the points of the permutation in batches that double in size, up to 2% of the points.
+// In the first phase every point of a batch runs GreedySearch and RobustPrune against the graph
+// as it was before the batch, so that phase only reads the graph. Then every point writes its own
+// out-neighbors, and last the reverse edges are added under the lock of the node that gets them,
+// since many points of the batch can add an edge to the same node.
+template <class Store>
+static void parallelInsert(const Store& store, DirectedGraph& graph, vector<Node*>& nodes, const vector<int>& permutation, unsigned int s, int L, int R, float a, ThreadPool& pool) {
+    vector<mutex> locks(LOCK_STRIPES);
+    size_t max_batch = max<size_t>(1, permutation.size() / 50);
+    vector<vector<unsigned int>> pruned;
+
+    for (size_t begin = 0, batch = 1; begin < permutation.size(); begin += batch, batch = min(batch * 2, max_batch)) {
+        size_t end = min(permutation.size(), begin + batch);
+        pruned.assign(end - begin, {});
+
+        pool.parallelFor(begin, end, [&](size_t i) {
+            unsigned int p = nodes[permutation[i]]->id;
+            vector<unsigned int> V_p = searchFor(store, graph, s, p, L);
+            pruned[i - begin] = RobustPruneNeighbors(store, graph, p, V_p, a, R);
+        });
+
+        pool.parallelFor(begin, end, [&](size_t i) {
+            graph.setNeighbors(nodes[permutation[i]]->id, pruned[i - begin]);
+        });
+
+        pool.parallelFor(begin, end, [&](size_t i) {
+            unsigned int p = nodes[permutation[i]]->id;
+            for (unsigned int neighbor : pruned[i - begin]) {
+                lock_guard<mutex> lock(locks[neighbor % LOCK_STRIPES]);
+                if (graph.hasNeighbor(neighbor, p)) {
+                    continue;
                 }
-            }
-            if (total_dist < min_dist) {
-                min_dist = total_dist;
-                medoidIndex = i;
-            }
-        }
-        s = subset[medoidIndex];
-    } else {
-        // Case 2: Use the original full dataset medoid calculation
-        int medoidIndex = 0;
-        double min_dist = numeric_limits<double>::max();
-        for (int i = 0; i < n; i++) {
-            double total_dist = 0;
-            for (int j = 0; j < n; j++) {
-                if (i != j) {
-                    total_dist += euclidean(nodes[i], nodes[j]);
+
+                if (graph.degree(neighbor) + 1 > static_cast<size_t>(R)) {
+                    RobustPrune(store, graph, neighbor, {p}, a, R);
+                } else {
+                    graph.addNeighbor(neighbor, p);
                 }
             }
-            if (total_dist < min_dist) {
-                min_dist = total_dist;
-                medoidIndex = i;
-            }
-        }
-        s = nodes[medoidIndex];
+        });
     }
+}
 
-    // cout << "The medoid point found: " << endl;
-    // cout << "[ ";
-
-    // for (unsigned int i = 0; i < s->coords.size(); i++) {
-    //     if (i == s->coords.size() - 1) {
-    //         cout << s->coords.at(i);
-    //         break;
-    //     }
-    //     cout << s->coords.at(i) << ", ";
-    // }
-    // cout << "]" << endl;
-
+// Steps 3 and 4 of the build: inserts the first n nodes in a random order, on the vectors of the store.
+// A pool without workers inserts them one at a time.
+template <class Store>
+static void insertNodes(const Store& store, DirectedGraph& graph, vector<Node*>& nodes, int n, unsigned int s, int L, int R, float a, ThreadPool& pool) {
     //Step 3: Iterate through the dataset in a random order
     vector<int> permutation(n);         //list of all indices
 
@@ -101,29 +97,80 @@ void VamanaIndexingAlgorithm(vector<Node*>& nodes, int k, int L, int R, float a,
         int j = rand() % (i + 1);//random num from 0 to i
         swap(permutation[i], permutation[j]);
     }
+
+    if (pool.size() > 0) {
+        parallelInsert(store, graph, nodes, permutation, s, L, R, a, pool);
+        return;
+    }
     
     for (int i : permutation) {
         Node* p = nodes[i];
         
         //Run GreedySearch to find the visited set V_p
-        vector<Node*> V_p = GreedySearch(s, p, 1, L);
+        vector<unsigned int> V_p = searchFor(store, graph, s, p->id, L);
 
         //Run RobustPrune on p with V_p, a, and R
-        FilteredRobustPrune(p, V_p, a, R);
+        RobustPrune(store, graph, p->id, V_p, a, R);
 
         //Add reverse edges 
-        for (Node* neighbor : p->out_neighbors) {
+        vector<unsigned int> out_neighbors(graph.neighbors(p->id), graph.neighbors(p->id) + graph.degree(p->id));
+        for (unsigned int neighbor : out_neighbors) {
+            if (graph.hasNeighbor(neighbor, p->id)) {
+                continue;
+            }
 
             // If neighbor exceeds max degree R, apply RobustPrune
-            if (neighbor->out_neighbors.size() + 1 > static_cast<size_t>(R)) {
+            if (graph.degree(neighbor) + 1 > static_cast<size_t>(R)) {
             //Call RobustPrune with the current neighbors plus the new neighbor candidate p
-                neighbor->out_neighbors.push_back(p);  //Temporarily add p
-                FilteredRobustPrune(neighbor, neighbor->out_neighbors, a, R);
+                RobustPrune(store, graph, neighbor, {p->id}, a, R);
             } else {
             //Safe to add p directly without exceeding R
-                neighbor->out_neighbors.push_back(p);
+                graph.addNeighbor(neighbor, p->id);
             }
 
         }
     }
-}
\ No newline at end of file
+}
+
+void VamanaIndexingAlgorithm(const VectorStore& store, DirectedGraph& graph, vector<Node*>& nodes, int k, int L, int R, float a, int n, int medoidCase, int subsetSize, unsigned int num_threads) {
+    // One pool for the whole build, the calling thread is the last worker
+    ThreadPool pool(max(1u, num_threads) - 1);
+    VamanaIndexingAlgorithm(store, graph, nodes, k, L, R, a, n, medoidCase, subsetSize, pool);
+}
+
+void VamanaIndexingAlgorithm(const VectorStore& store, DirectedGraph& graph, vector<Node*>& nodes, int k, int L, int R, float a, int n, int medoidCase, int subsetSize, ThreadPool& pool) {
+    //Step 1: Initialize a random R directed graph
+    initializeRandomGraph(graph, nodes, R);
+
+    //Step 2: Find the medoid s of the dataset 
+    unsigned int s = 0;
+
+    if (n == 0)
+        return;     //empty
+
+    // The dataset is the first n nodes
+    vector<Node*> points(nodes.begin(), nodes.begin() + n);
+
+    if (medoidCase== 0) {
+        // Case 0: Select a random point
+        s = nodes[rand() % n]->id;
+    } else if (medoidCase == 1) {
+        // Case 1: The medoid of subsetSize random candidates, measured against subsetSize random points
+        s = sampledMedoid(store, points, subsetSize, subsetSize, rand(), pool).id;
+    } else {
+        // Case 2: The point closest to the centroid, which stands in for the exact medoid
+        // of the dataset without its n^2 distances
+        s = datasetMedoid(store, points, pool);
+    }
+
+    insertNodes(store, graph, nodes, n, s, L, R, a, pool);
+}
+
+void VamanaIndexingAlgorithm(const ScalarQuantizedStore& codes, DirectedGraph& graph, vector<Node*>& nodes, int L, int R, float a, unsigned int s, unsigned int num_threads) {
+    initializeRandomGraph(graph, nodes, R);
+    if (nodes.empty()) {
+        return;
+    }
+    ThreadPool pool(max(1u, num_threads) - 1);
+    insertNodes(codes, graph, nodes, nodes.size(), s, L, R, a, pool);
+}
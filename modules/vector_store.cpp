@@ -0,0 +1,62 @@
+#include "../include/vamana.h"
+
+// Number of floats in one 64-byte cache line
+constexpr size_t FLOATS_PER_LINE = 64 / sizeof(float);
+
+
+VectorStore::VectorStore(size_t count, size_t dim) : count(count), dim(dim) {
+    // Pad every row to a whole number of cache lines
+    stride = (dim + FLOATS_PER_LINE - 1) / FLOATS_PER_LINE * FLOATS_PER_LINE;
+    l2 = distanceKernel(bestDistanceKernel(), dim);
+
+    size_t bytes = count * stride * sizeof(float);
+    if (bytes == 0) {
+        return;
+    }
+
+    data = static_cast<float*>(aligned_alloc(64, bytes));
+    if (!data) {
+        throw bad_alloc();
+    }
+
+    // Zero everything so the padding never changes a distance
+    fill(data, data + count * stride, 0.0f);
+}
+
+VectorStore::VectorStore(const vector<vector<float>>& rows) : VectorStore(rows.size(), rows.empty() ? 0 : rows[0].size()) {
+    for (size_t i = 0; i < rows.size(); i++) {
+        copy(rows[i].begin(), rows[i].begin() + dim, row(i));
+    }
+}
+
+VectorStore::VectorStore(float* data, size_t count, size_t dim, size_t stride)
+    : data(data), count(count), dim(dim), stride(stride), l2(distanceKernel(bestDistanceKernel(), dim)), owns_data(false) {}
+
+VectorStore::~VectorStore() {
+    if (owns_data) {
+        free(data);
+    }
+}
+
+VectorStore::VectorStore(VectorStore&& other) noexcept
+    : data(other.data), count(other.count), dim(other.dim), stride(other.stride), l2(other.l2), owns_data(other.owns_data) {
+    other.data = nullptr;
+    other.count = other.dim = other.stride = 0;
+}
+
+VectorStore& VectorStore::operator=(VectorStore&& other) noexcept {
+    if (this != &other) {
+        if (owns_data) {
+            free(data);
+        }
+        data = other.data;
+        count = other.count;
+        dim = other.dim;
+        stride = other.stride;
+        l2 = other.l2;
+        owns_data = other.owns_data;
+        other.data = nullptr;
+        other.count = other.dim = other.stride = 0;
+    }
+    return *this;
+}
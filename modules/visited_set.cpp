@@ -0,0 +1,15 @@
+#include "../include/vamana.h"
+
+
+void VisitedSet::reset(size_t count) {
+    if (tags.size() < count) {
+        tags.resize(count, 0);
+    }
+
+    epoch++;
+    if (epoch == 0) {
+        // The epoch wrapped around, so old tags could match it again
+        fill(tags.begin(), tags.end(), 0);
+        epoch = 1;
+    }
+}
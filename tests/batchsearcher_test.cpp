@@ -0,0 +1,112 @@
+#include "../include/acutest.h"
+
+#include "../include/vamana.h"
+
+// Small random index shared by the tests: 300 nodes with 3 labels and 20 queries of both types
+struct TestIndex {
+    VectorStore store;
+    vector<Node*> nodes;
+    DirectedGraph graph;
+    VectorStore query_store;
+    vector<Query> queries;
+
+    TestIndex() : store(300, 4), graph(300, 10), query_store(20, 4) {
+        mt19937 gen(9);
+        uniform_real_distribution<float> dist(0.0, 10.0);
+        for (unsigned int i = 0; i < store.count; i++) {
+            for (unsigned int d = 0; d < store.dim; d++) {
+                store.row(i)[d] = dist(gen);
+            }
+            nodes.push_back(new Node{i, i % 3});
+        }
+        VamanaIndexingAlgorithm(store, graph, nodes, 10, 20, 10, 1.2, nodes.size(), 1, 20);
+
+        for (unsigned int q = 0; q < query_store.count; q++) {
+            for (unsigned int d = 0; d < query_store.dim; d++) {
+                query_store.row(q)[d] = dist(gen);
+            }
+            queries.push_back({q, static_cast<int>(q % 2), q % 3});
+        }
+    }
+
+    ~TestIndex() {
+        for (Node* node : nodes) delete node;
+    }
+};
+
+// Test that every row of the result matrix matches a single search of the same query
+void test_matches_single_searches() {
+    TestIndex index;
+    const unsigned int k = 5, L = 20;
+
+    BatchSearcher searcher(index.store, index.graph, index.nodes, 4);
+    searcher.entry_points = {7, 42};
+    searcher.medoids = findmedoid(searcher.labels, 10);
+
+    vector<uint32_t> results = searcher.search(index.query_store, index.queries, k, L);
+    TEST_CHECK(results.size() == index.queries.size() * k);
+    TEST_CHECK(searcher.search_seconds > 0.0);
+    TEST_CHECK(searcher.plans.size() == index.queries.size());
+
+    SearchScratch scratch;
+
+    for (size_t q = 0; q < index.queries.size(); q++) {
+        const Query& query = index.queries[q];
+        vector<unsigned int> expected;
+        if (query.type == 0) {
+            vector<unsigned int> starts = closestEntryPoints(index.store, searcher.entry_points, index.query_store.row(query.id), ENTRY_SEEDS);
+            expected = GreedySearch(index.store, index.graph, starts, index.query_store.row(query.id), k, L, scratch);
+        } else if (searcher.plans[q].kind == PLAN_SCAN) {
+            const SortedTimestamps& label = searcher.timestamps.by_label.at(query.label);
+            expected = BruteForceSearch(index.store, label.ids.data(), label.ids.size(), index.query_store.row(query.id), k, scratch);
+        } else {
+            expected = FilteredGreedySearch(index.store, index.graph, searcher.labels, {searcher.medoids[query.label]}, index.query_store.row(query.id), k, L, query.label);
+        }
+
+        vector<uint32_t> row(results.begin() + q * k, results.begin() + (q + 1) * k);
+        expected.resize(k, NO_NEIGHBOR);
+        TEST_CHECK(row == expected);
+        TEST_MSG("Query %zu", q);
+    }
+}
+
+// Test that the result does not depend on the number of threads
+void test_thread_counts() {
+    TestIndex index;
+
+    vector<uint32_t> expected;
+    for (unsigned int threads : {1, 2, 8}) {
+        BatchSearcher searcher(index.store, index.graph, index.nodes, threads);
+        searcher.medoids = {0, 1, 2};
+        vector<uint32_t> results = searcher.search(index.query_store, index.queries, 10, 30);
+
+        if (expected.empty()) {
+            expected = results;
+        }
+        TEST_CHECK(results == expected);
+        TEST_MSG("%u threads", threads);
+    }
+}
+
+// Test that rows with fewer than k neighbors are padded and an empty batch gives an empty matrix
+void test_padding_and_empty_batch() {
+    TestIndex index;
+    BatchSearcher searcher(index.store, index.graph, index.nodes, 2);
+
+    // Filtered queries of a label that no node has find nothing
+    vector<Query> filtered = {{0, 1, NO_LABEL}, {1, 1, 7}};
+    vector<uint32_t> results = searcher.search(index.query_store, filtered, 3, 10);
+    TEST_CHECK(results.size() == 6);
+    TEST_CHECK(all_of(results.begin(), results.end(), [](uint32_t id) { return id == NO_NEIGHBOR; }));
+
+    TEST_CHECK(searcher.search(index.query_store, {}, 3, 10).empty());
+}
+
+
+TEST_LIST = {
+    {"test_matches_single_searches", test_matches_single_searches},
+    {"test_thread_counts", test_thread_counts},
+    {"test_padding_and_empty_batch", test_padding_and_empty_batch},
+
+    {NULL, NULL} // Terminate the list
+};
@@ -0,0 +1,142 @@
+#include "../include/acutest.h"
+
+#include "../include/vamana.h"
+
+const string BIN_PATH = "binreader_test.bin";
+
+// Writes a contest file with the header N and the given rows, which may be fewer than N
+void write_bin(uint32_t N, const vector<vector<float>>& rows) {
+    ofstream ofs(BIN_PATH, ios::binary);
+    ofs.write(reinterpret_cast<const char*>(&N), sizeof(N));
+    for (const vector<float>& row : rows) {
+        ofs.write(reinterpret_cast<const char*>(row.data()), row.size() * sizeof(float));
+    }
+}
+
+// Random rows of `columns` floats, where column 0 holds the row number
+vector<vector<float>> random_rows(size_t count, size_t columns) {
+    mt19937 gen(11);
+    uniform_real_distribution<float> dist(-10.0, 10.0);
+    vector<vector<float>> rows(count, vector<float>(columns));
+    for (size_t i = 0; i < count; i++) {
+        for (float& x : rows[i]) {
+            x = dist(gen);
+        }
+        rows[i][0] = i;
+    }
+    return rows;
+}
+
+// Test that both modes hand out every row once, in order, in blocks of the requested size
+void test_blocks() {
+    vector<vector<float>> rows = random_rows(10, 3);
+    write_bin(rows.size(), rows);
+
+    for (bool mapped : {false, true}) {
+        BinReader reader(BIN_PATH, 3, mapped, 4);
+        TEST_ASSERT(reader.is_open());
+        TEST_CHECK(reader.size() == 10);
+
+        vector<size_t> block_sizes;
+        size_t row = 0;
+        const float* block;
+        while (size_t count = reader.next(block)) {
+            block_sizes.push_back(count);
+            for (size_t i = 0; i < count; i++, row++) {
+                TEST_CHECK(equal(block + i * 3, block + (i + 1) * 3, rows[row].begin()));
+            }
+        }
+        TEST_CHECK(row == 10);
+        TEST_CHECK((block_sizes == vector<size_t>{4, 4, 2}));
+        TEST_CHECK(reader.next(block) == 0);
+    }
+
+    remove(BIN_PATH.c_str());
+}
+
+// Test that a file that ends before N rows is read up to its last full row
+void test_short_file() {
+    vector<vector<float>> rows = random_rows(5, 3);
+    rows.push_back({1.0});  // part of a sixth row
+    write_bin(100, rows);
+
+    for (bool mapped : {false, true}) {
+        BinReader reader(BIN_PATH, 3, mapped);
+        TEST_CHECK(reader.size() == 5);
+    }
+
+    BinReader missing("no_such_file.bin", 3);
+    TEST_CHECK(!missing.is_open());
+    TEST_CHECK(missing.size() == 0);
+
+    remove(BIN_PATH.c_str());
+}
+
+// Test that the data layout is split into labels, timestamps and coordinates
+void test_read_nodes() {
+    vector<vector<float>> rows = random_rows(5000, DATA_COLUMNS);
+    for (size_t i = 0; i < rows.size(); i++) {
+        rows[i][0] = (i * 3) % 7 + 0.5f;  // 7 filters, the first 7 rows have all of them
+    }
+    write_bin(rows.size(), rows);
+
+    for (bool mapped : {false, true}) {
+        VectorStore store;
+        vector<float> label_values;
+        vector<Node*> nodes = ReadNodes(BIN_PATH, store, label_values, mapped);
+        TEST_ASSERT(nodes.size() == rows.size());
+        TEST_CHECK(store.count == rows.size());
+        TEST_CHECK(store.dim == VECTOR_DIMENSIONS);
+        TEST_CHECK(label_values.size() == 7);
+
+        for (size_t i = 0; i < rows.size(); i++) {
+            TEST_CHECK(nodes[i]->id == i);
+            TEST_CHECK(nodes[i]->label == i % 7);  // numbered in the order they first appear
+            TEST_CHECK(label_values[nodes[i]->label] == rows[i][0]);
+            TEST_CHECK(nodes[i]->timestamp == rows[i][1]);
+            TEST_CHECK(equal(store.row(i), store.row(i) + store.dim, rows[i].begin() + 2));
+        }
+
+        for (Node* node : nodes) delete node;
+    }
+
+    remove(BIN_PATH.c_str());
+}
+
+// Test that queries of all four types are read, with their label and timestamp window
+void test_read_queries() {
+    vector<vector<float>> rows = random_rows(8, QUERY_COLUMNS);
+    for (size_t i = 0; i < rows.size(); i++) {
+        rows[i][0] = i % 4;  // query type
+        rows[i][1] = 10 + i;  // filter
+    }
+    write_bin(rows.size(), rows);
+
+    // Filters 10 and 12 are labels 1 and 0, the others are on no node
+    VectorStore store;
+    vector<Query> queries = ReadQueries(BIN_PATH, store, {12.0, 10.0, 99.0});
+    TEST_ASSERT(queries.size() == 8);
+    TEST_CHECK(store.count == 8);
+
+    for (size_t q = 0; q < queries.size(); q++) {
+        const vector<float>& row = rows[q];
+        TEST_CHECK(queries[q].id == q);
+        TEST_CHECK(queries[q].type == row[0]);
+        TEST_CHECK(queries[q].label == (q == 0 ? 1 : q == 2 ? 0 : NO_LABEL));
+        TEST_CHECK(queries[q].l == row[2]);
+        TEST_CHECK(queries[q].r == row[3]);
+        TEST_CHECK(equal(store.row(q), store.row(q) + store.dim, row.begin() + 4));
+    }
+
+    remove(BIN_PATH.c_str());
+}
+
+
+TEST_LIST = {
+    {"test_blocks", test_blocks},
+    {"test_short_file", test_short_file},
+    {"test_read_nodes", test_read_nodes},
+    {"test_read_queries", test_read_queries},
+
+    {NULL, NULL} // Terminate the list
+};
@@ -0,0 +1,68 @@
+#include "../include/acutest.h"
+
+#include "../include/vamana.h"
+
+// Test that candidates are kept sorted by distance and the pool never grows past its capacity
+void test_sorted_and_bounded() {
+    CandidatePool pool;
+    pool.reset(3);
+
+    TEST_CHECK(pool.insert(1, 5.0));
+    TEST_CHECK(pool.insert(2, 1.0));
+    TEST_CHECK(pool.insert(3, 3.0));
+    TEST_CHECK(pool.insert(4, 2.0)); // Drops node 1
+    TEST_CHECK(!pool.insert(5, 4.0)); // Farther than all of a full pool
+
+    TEST_CHECK(pool.size() == 3);
+    vector<unsigned int> expected = {2, 4, 3};
+    TEST_CHECK(pool.closest(10) == expected);
+    TEST_CHECK(pool.closest(2) == vector<unsigned int>({2, 4}));
+}
+
+// Test that the cursor always points to the closest unexpanded candidate
+void test_expand_order() {
+    CandidatePool pool;
+    pool.reset(4);
+    pool.insert(1, 2.0);
+    pool.insert(2, 4.0);
+
+    TEST_CHECK(pool.expandNext() == 1);
+
+    // A closer candidate than the cursor is expanded next
+    pool.insert(3, 1.0);
+    TEST_CHECK(pool.expandNext() == 3);
+    TEST_CHECK(pool.expandNext() == 2);
+    TEST_CHECK(!pool.hasUnexpanded());
+
+    pool.insert(4, 3.0);
+    TEST_CHECK(pool.hasUnexpanded());
+    TEST_CHECK(pool.expandNext() == 4);
+    TEST_CHECK(!pool.hasUnexpanded());
+}
+
+// Test that equal distances are ordered by id and reset empties the pool
+void test_ties_and_reset() {
+    CandidatePool pool;
+    pool.reset(2);
+    pool.insert(7, 1.0);
+    pool.insert(3, 1.0);
+    TEST_CHECK(pool.closest(2) == vector<unsigned int>({3, 7}));
+
+    pool.reset(2);
+    TEST_CHECK(pool.size() == 0);
+    TEST_CHECK(!pool.hasUnexpanded());
+
+    // A pool with no room keeps nothing
+    pool.reset(0);
+    TEST_CHECK(!pool.insert(1, 1.0));
+    TEST_CHECK(pool.size() == 0);
+}
+
+
+TEST_LIST = {
+    {"test_sorted_and_bounded", test_sorted_and_bounded},
+    {"test_expand_order", test_expand_order},
+    {"test_ties_and_reset", test_ties_and_reset},
+
+    {NULL, NULL} // Terminate the list
+};
@@ -0,0 +1,182 @@
+#include "../include/acutest.h"
+
+#include "../include/vamana.h"
+
+#include <unistd.h>
+
+const string INDEX_PATH = "diskindex_test.bin";
+
+// 1000 points of `dim` dimensions around 20 centers, with a Vamana graph of degree 16 and PQ codes
+struct TestIndex {
+    VectorStore store;
+    vector<Node*> nodes;
+    DirectedGraph graph;
+    ProductQuantizer pq;
+    unsigned int medoid;
+
+    TestIndex(size_t dim = 32) : store(1000, dim), graph(1000, 16) {
+        mt19937 gen(5);
+        uniform_real_distribution<float> center(0.0, 100.0);
+        normal_distribution<float> noise(0.0, 5.0);
+        vector<vector<float>> centers(20, vector<float>(dim));
+        for (vector<float>& c : centers) {
+            for (float& value : c) value = center(gen);
+        }
+        for (unsigned int i = 0; i < store.count; i++) {
+            for (unsigned int d = 0; d < dim; d++) {
+                store.row(i)[d] = centers[i % 20][d] + noise(gen);
+            }
+            nodes.push_back(new Node{i, 0});
+        }
+        VamanaIndexingAlgorithm(store, graph, nodes, 10, 40, 16, 1.2, nodes.size(), 2);
+        pq = ProductQuantizer(store, nodes, 16, 1000, 1);
+        medoid = datasetMedoid(store, nodes);
+    }
+
+    ~TestIndex() {
+        for (Node* node : nodes) delete node;
+    }
+};
+
+// Test that every record read back from the file holds the vector and the neighbors of its node,
+// and that the codes and entry points are loaded into memory
+void test_round_trip() {
+    TestIndex saved;
+    vector<unsigned int> entry_points = diverseEntryPoints(saved.store, saved.nodes, ENTRY_POINTS, 1);
+    SaveDiskIndex(INDEX_PATH, saved.store, saved.graph, saved.pq, saved.medoid, entry_points);
+
+    DiskIndex index;
+    TEST_ASSERT(OpenDiskIndex(INDEX_PATH, index));
+    TEST_CHECK(index.count == 1000 && index.dim == 32 && index.R == 16);
+    TEST_CHECK(index.node_bytes == (32 + 1 + 16) * 4);
+    TEST_CHECK(index.nodes_per_sector == DISK_SECTOR / index.node_bytes);
+    TEST_CHECK(index.node_sectors == 1);
+    TEST_CHECK(index.entry_point == saved.medoid);
+    TEST_CHECK(index.entry_points == entry_points);
+    TEST_CHECK(index.pq.offsets == saved.pq.offsets);
+    TEST_CHECK(index.pq.centroids == saved.pq.centroids);
+    TEST_CHECK(index.pq.codes == saved.pq.codes);
+
+    vector<char> sector(DISK_SECTOR);
+    for (unsigned int i = 0; i < index.count; i++) {
+        TEST_ASSERT(pread(index.fd, sector.data(), sector.size(), index.readOffset(i)) == static_cast<ssize_t>(sector.size()));
+        const char* record = sector.data() + index.recordOffset(i);
+        TEST_CHECK(memcmp(record, saved.store.row(i), 32 * sizeof(float)) == 0);
+        uint32_t degree;
+        memcpy(&degree, record + 32 * sizeof(float), sizeof(degree));
+        TEST_CHECK(degree == saved.graph.degree(i));
+        TEST_CHECK(memcmp(record + 33 * sizeof(float), saved.graph.neighbors(i), degree * sizeof(uint32_t)) == 0);
+    }
+
+    remove(INDEX_PATH.c_str());
+}
+
+static size_t countFound(const vector<unsigned int>& result, const vector<unsigned int>& truth) {
+    return count_if(result.begin(), result.end(), [&](unsigned int id) { return find(truth.begin(), truth.end(), id) != truth.end(); });
+}
+
+// Test that the disk searches find about as many neighbors of the in-memory search on the floats as
+// the in-memory search on the same codes, that wider beams take fewer hops, and that spreading the
+// reads over threads gives the same results
+void test_search() {
+    TestIndex saved;
+    vector<unsigned int> entry_points = diverseEntryPoints(saved.store, saved.nodes, ENTRY_POINTS, 1);
+    SaveDiskIndex(INDEX_PATH, saved.store, saved.graph, saved.pq, saved.medoid, entry_points);
+
+    DiskIndex index, threaded;
+    TEST_ASSERT(OpenDiskIndex(INDEX_PATH, index));
+    TEST_ASSERT(OpenDiskIndex(INDEX_PATH, threaded, 2));
+    const unsigned int k = 10, L = 40;
+
+    SearchScratch scratch;
+    size_t found_pq = 0, found[2] = {0, 0}, hops[2] = {0, 0};
+    for (unsigned int q = 0; q < 50; q++) {
+        const float* x_q = saved.store.row(q * 20 + 3);
+        vector<unsigned int> exact = GreedySearch(saved.store, saved.graph, saved.medoid, x_q, k, L);
+        found_pq += countFound(GreedySearch(saved.store, saved.pq, saved.graph, entry_points, x_q, k, L, scratch), exact);
+
+        for (unsigned int b = 0; b < 2; b++) {
+            unsigned int beam_width = b == 0 ? 1 : 4;
+            vector<unsigned int> result = DiskSearch(index, x_q, k, L, beam_width, scratch);
+            TEST_CHECK(result.size() == k);
+            TEST_CHECK(scratch.reads <= scratch.hops * beam_width);
+            found[b] += countFound(result, exact);
+            hops[b] += scratch.hops;
+
+            size_t reads = scratch.reads;
+            TEST_CHECK(DiskSearch(threaded, x_q, k, L, beam_width, scratch) == result);
+            TEST_CHECK(scratch.reads == reads);
+        }
+    }
+
+    for (unsigned int b = 0; b < 2; b++) {
+        TEST_CHECK(found[b] >= 0.9 * found_pq);
+        TEST_MSG("Found %zu, on the codes in memory %zu", found[b], found_pq);
+    }
+    TEST_CHECK(hops[1] * 2 < hops[0]);
+    TEST_MSG("%zu hops with a beam of 4, %zu with a beam of 1", hops[1], hops[0]);
+
+    remove(INDEX_PATH.c_str());
+}
+
+// Test records that do not fit in a sector, which take a read of two sectors each
+void test_large_records() {
+    TestIndex saved(1100);
+    SaveDiskIndex(INDEX_PATH, saved.store, saved.graph, saved.pq, saved.medoid);
+
+    DiskIndex index;
+    TEST_ASSERT(OpenDiskIndex(INDEX_PATH, index));
+    TEST_CHECK(index.nodes_per_sector == 1);
+    TEST_CHECK(index.node_sectors == 2);
+    TEST_CHECK(index.entry_points.empty());
+
+    SearchScratch scratch;
+    size_t found = 0, found_pq = 0;
+    for (unsigned int q = 0; q < 20; q++) {
+        const float* x_q = saved.store.row(q * 37);
+        vector<unsigned int> exact = GreedySearch(saved.store, saved.graph, saved.medoid, x_q, 5, 30);
+        found_pq += countFound(GreedySearch(saved.store, saved.pq, saved.graph, {saved.medoid}, x_q, 5, 30, scratch), exact);
+        vector<unsigned int> result = DiskSearch(index, x_q, 5, 30, 2, scratch);
+        TEST_CHECK(result.size() == 5);
+        found += countFound(result, exact);
+    }
+    TEST_CHECK(found >= 0.9 * found_pq);
+    TEST_MSG("Found %zu, on the codes in memory %zu", found, found_pq);
+
+    remove(INDEX_PATH.c_str());
+}
+
+// Test that missing, foreign, truncated and corrupted files are refused
+void test_invalid_files() {
+    DiskIndex index;
+    TEST_CHECK(!OpenDiskIndex("no_such_index.bin", index));
+
+    {
+        ofstream ofs(INDEX_PATH, ios::binary);
+        vector<char> bytes(8192, 1);
+        ofs.write(bytes.data(), bytes.size());
+    }
+    TEST_CHECK(!OpenDiskIndex(INDEX_PATH, index));
+
+    TestIndex saved;
+    SaveDiskIndex(INDEX_PATH, saved.store, saved.graph, saved.pq, saved.medoid);
+    TEST_CHECK(truncate(INDEX_PATH.c_str(), 3 * DISK_SECTOR) == 0);
+    TEST_CHECK(!OpenDiskIndex(INDEX_PATH, index));
+    TEST_CHECK(index.fd == -1);
+
+    // An entry point past the last node
+    SaveDiskIndex(INDEX_PATH, saved.store, saved.graph, saved.pq, saved.medoid, {0, static_cast<unsigned int>(saved.nodes.size())});
+    TEST_CHECK(!OpenDiskIndex(INDEX_PATH, index));
+
+    remove(INDEX_PATH.c_str());
+}
+
+
+TEST_LIST = {
+    {"test_round_trip", test_round_trip},
+    {"test_search", test_search},
+    {"test_large_records", test_large_records},
+    {"test_invalid_files", test_invalid_files},
+
+    {NULL, NULL} // Terminate the list
+};
@@ -0,0 +1,134 @@
+#include "../include/acutest.h"
+
+#include "../include/vamana.h"
+
+// Helper function to create a vector with random coordinates
+vector<float> random_vector(mt19937& gen, size_t dim) {
+    uniform_real_distribution<float> dist(-100.0, 100.0);
+    vector<float> v(dim);
+    for (float& x : v) {
+        x = dist(gen);
+    }
+    return v;
+}
+
+// Test that every supported kernel agrees with the scalar one
+void test_kernels_match_scalar() {
+    mt19937 gen(42);
+    DistanceFunction scalar = distanceKernel(KERNEL_SCALAR);
+
+    for (DistanceKernel kernel : {KERNEL_SSE, KERNEL_AVX2, KERNEL_AVX512}) {
+        DistanceFunction f = distanceKernel(kernel);
+        if (!f) {
+            TEST_MSG("Kernel %s is not supported, skipped", distanceKernelName(kernel));
+            continue;
+        }
+
+        // Every length up to 2 AVX-512 blocks plus a tail, and the common sizes
+        vector<size_t> dims;
+        for (size_t d = 0; d <= 40; d++) {
+            dims.push_back(d);
+        }
+        for (size_t d : {96, 100, 128, 768}) {
+            dims.push_back(d);
+        }
+
+        for (size_t d : dims) {
+            vector<float> a = random_vector(gen, d);
+            vector<float> b = random_vector(gen, d);
+
+            float expected = scalar(a.data(), b.data(), d);
+            float actual = f(a.data(), b.data(), d);
+
+            TEST_CHECK(fabs(expected - actual) <= 1e-4 * max(1.0f, expected));
+            TEST_MSG("%s, dim %zu: expected %f, got %f", distanceKernelName(kernel), d, expected, actual);
+        }
+    }
+}
+
+// Test that the kernels unrolled for a fixed dimension agree with the scalar one
+void test_fixed_dimension_kernels() {
+    mt19937 gen(3);
+    DistanceFunction scalar = distanceKernel(KERNEL_SCALAR);
+
+    for (DistanceKernel kernel : {KERNEL_SCALAR, KERNEL_SSE, KERNEL_AVX2, KERNEL_AVX512}) {
+        for (size_t d : {96, 100, 128, 768}) {
+            DistanceFunction f = distanceKernel(kernel, d);
+            if (!f) {
+                continue;
+            }
+
+            // Plain vectors, without the padding of the store rows
+            vector<float> a = random_vector(gen, d);
+            vector<float> b = random_vector(gen, d);
+
+            float expected = scalar(a.data(), b.data(), d);
+            float actual = f(a.data(), b.data(), d);
+
+            TEST_CHECK(fabs(expected - actual) <= 1e-4 * max(1.0f, expected));
+            TEST_MSG("%s, dim %zu: expected %f, got %f", distanceKernelName(kernel), d, expected, actual);
+        }
+    }
+
+    // Other dimensions get the runtime dimension kernel
+    TEST_CHECK(distanceKernel(bestDistanceKernel(), 3) == distanceKernel(bestDistanceKernel()));
+}
+
+// Test that the distance of a vector to itself is 0
+void test_same_vector() {
+    mt19937 gen(7);
+    vector<float> a = random_vector(gen, 100);
+
+    for (DistanceKernel kernel : {KERNEL_SCALAR, KERNEL_SSE, KERNEL_AVX2, KERNEL_AVX512}) {
+        DistanceFunction f = distanceKernel(kernel);
+        if (f) {
+            TEST_CHECK(f(a.data(), a.data(), a.size()) == 0.0);
+        }
+    }
+}
+
+// Test that the dispatched pointer is the best supported kernel
+void test_dispatch() {
+    DistanceKernel best = bestDistanceKernel();
+
+    TEST_CHECK(distanceKernelSupported(best));
+    TEST_CHECK(l2_distance == distanceKernel(best));
+    TEST_MSG("Dispatched kernel: %s", distanceKernelName(best));
+
+    float a[] = {1.0, 2.0, 3.0};
+    float b[] = {4.0, 5.0, 6.0};
+    TEST_CHECK(euclidean(a, b, 3) == 27.0);
+}
+
+// Test that rows of the vector store are padded with zeros, so padded rows give the same distance
+void test_store_padding() {
+    VectorStore store({{1.0, 2.0, 3.0}, {4.0, 5.0, 6.0}});
+
+    TEST_CHECK(store.stride % 16 == 0);
+    TEST_CHECK(reinterpret_cast<uintptr_t>(store.row(1)) % 64 == 0);
+    TEST_CHECK(euclidean(store.row(0), store.row(1), store.stride) == euclidean(store.row(0), store.row(1), store.dim));
+}
+
+// Test that a store uses the kernel of its dimension
+void test_store_kernel() {
+    VectorStore store(2, 100);
+    fill(store.row(1), store.row(1) + store.dim, 1.0f);
+
+    TEST_CHECK(store.l2 == distanceKernel(bestDistanceKernel(), 100));
+    TEST_CHECK(euclidean(store, store.row(0), store.row(1)) == 100.0);
+
+    VectorStore moved = move(store);
+    TEST_CHECK(moved.l2 == distanceKernel(bestDistanceKernel(), 100));
+}
+
+
+TEST_LIST = {
+    {"test_kernels_match_scalar", test_kernels_match_scalar},
+    {"test_fixed_dimension_kernels", test_fixed_dimension_kernels},
+    {"test_same_vector", test_same_vector},
+    {"test_dispatch", test_dispatch},
+    {"test_store_padding", test_store_padding},
+    {"test_store_kernel", test_store_kernel},
+
+    {NULL, NULL} // Terminate the list
+};
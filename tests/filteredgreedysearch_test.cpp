@@ -1,60 +1,58 @@
 #include "../include/vamana.h"
 #include "../include/acutest.h"
 
-// Helper function to create a Node
-Node* createNode(unsigned int id, float filter, const vector<float>& coords, const vector<Node*>& neighbors) {
+// Helper function to create a Node, store its coordinates in row `id` of the store and add its out-neighbors
+Node* createNode(VectorStore& store, DirectedGraph& graph, unsigned int id, uint32_t label, const vector<float>& coords, const vector<unsigned int>& neighbors) {
     Node* node = new Node();
     node->id = id;
-    node->filter = filter;  // Assign filter attribute
-    node->coords = coords;
-    node->out_neighbors = neighbors;
+    node->label = label;  // Assign label attribute
+    copy(coords.begin(), coords.end(), store.row(id));
+    graph.setNeighbors(id, neighbors);
     return node;
 }
 
 // Test Cases
 void test_small_dataset_single_filter() {
-    // Create nodes
-    Node* node1 = createNode(1, 1.0, {2.0, 3.0}, {});
-    Node* node2 = createNode(2, 3.0, {2.0, 1.0}, {});
-    Node* node3 = createNode(3, 5.0, {5.0, 5.0}, {});
-    Node* node4 = createNode(4, 1.0, {3.0, 5.0}, {});
-
-    // Define neighbors
-    node1->out_neighbors = {node2, node3};
-    node2->out_neighbors = {node4};
-    node3->out_neighbors = {};
-    node4->out_neighbors = {};
-
-    // Define query node
-    Node query;
-    query.filter = 0.0;  // Not used for querying neighbors
-    query.coords = {3.0, 3.0, 3.0};
-
-    // Define the query filter (only nodes with filter attribute in {1.0})
-    unordered_set<float> query_filter = {1.0};
+    // Create nodes, with their neighbors
+    VectorStore store(5, 2);
+    DirectedGraph graph(store.count, 2);
+    Node* node0 = createNode(store, graph, 0, 0, {0.0, 0.0}, {});  // Unused row, not part of the graph
+    Node* node1 = createNode(store, graph, 1, 1, {2.0, 3.0}, {2, 3});
+    Node* node2 = createNode(store, graph, 2, 3, {2.0, 1.0}, {4});
+    Node* node3 = createNode(store, graph, 3, 5, {5.0, 5.0}, {});
+    Node* node4 = createNode(store, graph, 4, 1, {3.0, 5.0}, {});
+    vector<Node*> nodes = {node0, node1, node2, node3, node4};
+    LabelIndex labels(nodes);
+
+    // Define query vector
+    float query[] = {3.0, 3.0};
+
+    // Define the query label (only nodes with label 1)
+    uint32_t label = 1;
 
     // Perform search
-    vector<Node*> start_nodes = {node1, node2, node3, node4};
-    vector<Node*> result = FilteredGreedySearch(start_nodes, &query, 2, 5, query_filter);
+    vector<unsigned int> start_nodes = {1, 2, 3, 4};
+    vector<unsigned int> result = FilteredGreedySearch(store, graph, labels, start_nodes, query, 2, 5, label);
 
-    // Sort the result nodes by distance to the query node
-    sort(result.begin(), result.end(), [&](Node* a, Node* b) {
-        return euclidean(a, &query) < euclidean(b, &query);
+    // Sort the result nodes by distance to the query vector
+    sort(result.begin(), result.end(), [&](unsigned int a, unsigned int b) {
+        return euclidean(store.row(a), query, store.dim) < euclidean(store.row(b), query, store.dim);
     });
 
     // Add debug output to check which nodes were selected
     cout << "Filtered and sorted result nodes (IDs): ";
-    for (Node* node : result) {
-        cout << node->id << " ";
+    for (unsigned int id : result) {
+        cout << id << " ";
     }
     cout << endl;
 
     // Assert results
     TEST_CHECK(result.size() == 2);  // Expecting 2 nodes to match the filter
-    TEST_CHECK(result[0]->id == 1);  // Node 1 should match the filter (filter = 1.0)
-    TEST_CHECK(result[1]->id == 4);  // Node 4 should also match the filter (filter = 1.0)
+    TEST_CHECK(result[0] == 1);  // Node 1 should match the filter (label = 1)
+    TEST_CHECK(result[1] == 4);  // Node 4 should also match the filter (label = 1)
 
     // Cleanup
+    delete node0;
     delete node1;
     delete node2;
     delete node3;
@@ -64,52 +62,52 @@ void test_small_dataset_single_filter() {
 
 void test_resilience_invalid_inputs() {
     // Empty graph
-    vector<Node*> start_nodes;
-    Node query;
-    query.coords = {3.0, 3.0, 3.0};
-    query.filter = 0.0;
-    unordered_set<float> query_filter = {1.0, 3.0};
+    VectorStore store(1, 3);
+    DirectedGraph graph;
+    LabelIndex labels;
+    vector<unsigned int> start_nodes;
+    float query[] = {3.0, 3.0, 3.0};
 
-    vector<Node*> result = FilteredGreedySearch(start_nodes, &query, 3, 5, query_filter);
+    vector<unsigned int> result = FilteredGreedySearch(store, graph, labels, start_nodes, query, 3, 5, 1);
 
     TEST_CHECK(result.empty()); // No nodes to process
 
     // Null query node
-    result = FilteredGreedySearch(start_nodes, nullptr, 3, 5, query_filter);
+    result = FilteredGreedySearch(store, graph, labels, start_nodes, nullptr, 3, 5, 1);
 
     TEST_CHECK(result.empty()); // No query node provided
 }
 
 void test_large_dataset() {
     // Create a large graph
+    VectorStore store(100, 2);
+    DirectedGraph graph(store.count, 1);
     vector<Node*> nodes;
     for (unsigned int i = 0; i < 100; ++i) {
-        nodes.push_back(createNode(i, static_cast<float>(i), {1.0, 2.0}, {}));
+        nodes.push_back(createNode(store, graph, i, i % 2, {1.0, 2.0}, {}));
     }
+    LabelIndex labels(nodes);
 
     // Link the nodes in a linear fashion
     for (unsigned int i = 0; i < 99; ++i) {
-        nodes[i]->out_neighbors.push_back(nodes[i + 1]);
+        graph.addNeighbor(i, i + 1);
     }
 
-    // Define query node
-    Node query;
-    query.coords = {50.0, 1.0, 2.0};
-    query.filter = 0.0;  // Not used for querying neighbors
+    // Define query vector
+    float query[] = {50.0, 1.0};
 
-    // Define query filter (only even IDs as floats)
-    unordered_set<float> query_filter;
-    for (unsigned int i = 0; i < 100; i += 2) {
-        query_filter.insert(static_cast<float>(i));
-    }
+    // Define query label (only even IDs have label 0)
+    uint32_t label = 0;
 
     // Perform search
-    vector<Node*> result = FilteredGreedySearch(nodes, &query, 5, 10, query_filter);
+    vector<unsigned int> start_nodes(nodes.size());
+    iota(start_nodes.begin(), start_nodes.end(), 0);
+    vector<unsigned int> result = FilteredGreedySearch(store, graph, labels, start_nodes, query, 5, 10, label);
 
     // Assert results
     TEST_CHECK(result.size() == 5);
-    for (Node* node : result) {
-        TEST_CHECK(static_cast<int>(node->filter) % 2 == 0); // All results must satisfy the filter
+    for (unsigned int id : result) {
+        TEST_CHECK(id % 2 == 0 && nodes[id]->label == label); // All results must satisfy the filter
     }
 
     // Cleanup
@@ -1,23 +1,23 @@
 #include "../include/acutest.h"
 #include "../include/vamana.h"
 
-// Helper: Create a Node
-Node* createNode(unsigned int id, float filter, const vector<float>& coords, const vector<Node*>& neighbors) {
+// Helper: Create a Node and store its coordinates in row `id` of the store
+Node* createNode(VectorStore& store, unsigned int id, uint32_t label, const vector<float>& coords) {
     Node* node = new Node();
     node->id = id;
-    node->filter = filter;  
-    node->coords = coords;
-    node->out_neighbors = neighbors;
+    node->label = label;  
+    copy(coords.begin(), coords.end(), store.row(id));
     return node;
 }
 
 // Test Fisher-Yates Shuffle
 void test_fisher_yates_shuffle() {
+    VectorStore store(4, 2);
     vector<Node*> nodes = {
-        createNode(0, 0.0, {0.0, 0.0}, {}),
-        createNode(1, 1.0, {1.0, 1.0}, {}),
-        createNode(2, 2.0, {2.0, 2.0}, {}),
-        createNode(3, 1.0, {3.0, 3.0}, {})
+        createNode(store, 0, 0, {0.0, 0.0}),
+        createNode(store, 1, 1, {1.0, 1.0}),
+        createNode(store, 2, 2, {2.0, 2.0}),
+        createNode(store, 3, 1, {3.0, 3.0})
     };
 
     fisherYatesShuffle(nodes);
@@ -39,10 +39,11 @@ void test_fisher_yates_shuffle() {
 
 //Test1: Small dataset
 void test_small_dataset_distinct_filters() {
-    Node* node0 = createNode(0, 0.0, {0.0, 0.0}, {});
-    Node* node1 = createNode(1, 1.0, {0.0, 0.0}, {});
-    Node* node2 = createNode(2, 2.0, {1.0, 1.0}, {});
-    Node* node3 = createNode(3, 3.0, {2.0, 2.0}, {});
+    VectorStore store(4, 2);
+    Node* node0 = createNode(store, 0, 0, {0.0, 0.0});
+    Node* node1 = createNode(store, 1, 1, {0.0, 0.0});
+    Node* node2 = createNode(store, 2, 2, {1.0, 1.0});
+    Node* node3 = createNode(store, 3, 3, {2.0, 2.0});
     vector<Node*> databasePoints = {node0,node1, node2, node3};
     int k = 1;
     unsigned int L = 2;
@@ -51,12 +52,12 @@ void test_small_dataset_distinct_filters() {
     unsigned int tau = 2;
     
     //FilteredVamana
-    DirectedGraph G = FilteredVamana(databasePoints, k, L, R, alpha, tau);
+    DirectedGraph G = FilteredVamana(store, databasePoints, k, L, R, alpha, tau);
     
     //graph properties
-    TEST_CHECK(G.adjacency_list.size() == databasePoints.size()); // All nodes should be in the graph
+    TEST_CHECK(G.size() == databasePoints.size()); // All nodes should be in the graph
     for (Node* node : databasePoints) {
-        TEST_CHECK(G.adjacency_list[node].size() <= R); // Out-degree <= R
+        TEST_CHECK(G.degree(node->id) <= R); // Out-degree <= R
     }
     
     // Cleanup
@@ -67,6 +68,7 @@ void test_small_dataset_distinct_filters() {
 
 // Test2: Empty dataset
 void test_empty_dataset() {
+    VectorStore store;
     vector<Node*> databasePoints;
     int k = 1;
     unsigned int L = 2;
@@ -75,15 +77,16 @@ void test_empty_dataset() {
     unsigned int tau = 1;
 
     //FilteredVamana
-    DirectedGraph G = FilteredVamana(databasePoints, k, L, R, alpha, tau);
+    DirectedGraph G = FilteredVamana(store, databasePoints, k, L, R, alpha, tau);
 
     // Assert empty graph
-    TEST_CHECK(G.adjacency_list.size() == 0);
+    TEST_CHECK(G.size() == 0);
 }
 
 // Test3: Single node
 void test_single_node() {
-    Node* node = createNode(0, 0.0, {0.0, 0.0}, {});
+    VectorStore store(1, 2);
+    Node* node = createNode(store, 0, 0, {0.0, 0.0});
     vector<Node*> databasePoints = {node};
     int k = 1;
     unsigned int L = 1;
@@ -92,20 +95,21 @@ void test_single_node() {
     unsigned int tau = 1;
 
     //FilteredVamana
-    DirectedGraph G = FilteredVamana(databasePoints, k, L, R, alpha, tau);
+    DirectedGraph G = FilteredVamana(store, databasePoints, k, L, R, alpha, tau);
 
     // Assert graph single-node
-    TEST_CHECK(G.adjacency_list.size() == 1);
-    TEST_CHECK(G.adjacency_list[node].empty()); // Single node has no neighbors
+    TEST_CHECK(G.size() == 1);
+    TEST_CHECK(G.degree(node->id) == 0); // Single node has no neighbors
 
     delete node;
 }
 
 // Test4: All nodes same filter
 void test_same_filter() {
-    Node* node0=createNode(0, 0.0, {0.0, 0.0}, {});
-    Node* node1 = createNode(1, 1.0, {0.0, 0.0}, {});
-    Node* node2 = createNode(2, 1.0, {1.0, 1.0}, {});
+    VectorStore store(3, 2);
+    Node* node0=createNode(store, 0, 0, {0.0, 0.0});
+    Node* node1 = createNode(store, 1, 1, {0.0, 0.0});
+    Node* node2 = createNode(store, 2, 1, {1.0, 1.0});
     vector<Node*> databasePoints = {node0,node1, node2};
     int k = 1;
     unsigned int L = 2;
@@ -114,12 +118,12 @@ void test_same_filter() {
     unsigned int tau = 1;
 
     //FilteredVamana
-    DirectedGraph G = FilteredVamana(databasePoints, k, L, R, alpha, tau);
+    DirectedGraph G = FilteredVamana(store, databasePoints, k, L, R, alpha, tau);
 
     //all nodes are connected since they share the same filter
-    TEST_CHECK(G.adjacency_list.size() == databasePoints.size());
+    TEST_CHECK(G.size() == databasePoints.size());
     for (Node* node : databasePoints) {
-        TEST_CHECK(G.adjacency_list[node].size() <= R); // Out-degree <= R
+        TEST_CHECK(G.degree(node->id) <= R); // Out-degree <= R
     }
 
     // Cleanup
@@ -130,9 +134,10 @@ void test_same_filter() {
 
 // Test5: Large dataset
 void test_large_dataset() {
+    VectorStore store(1000, 2);
     vector<Node*> databasePoints;
     for (unsigned int i = 0; i < 1000; ++i) {
-        databasePoints.push_back(createNode(i, i % 10, {static_cast<float>(i), 0.0}, {}));
+        databasePoints.push_back(createNode(store, i, i % 10, {static_cast<float>(i), 0.0}));
     }
     int k = 5;
     unsigned int L = 10;
@@ -141,12 +146,12 @@ void test_large_dataset() {
     unsigned int tau = 10;
 
     //FilteredVamana
-    DirectedGraph G = FilteredVamana(databasePoints, k, L, R, alpha, tau);
+    DirectedGraph G = FilteredVamana(store, databasePoints, k, L, R, alpha, tau);
 
     // Assert basic properties
-    TEST_CHECK(G.adjacency_list.size() == databasePoints.size());
+    TEST_CHECK(G.size() == databasePoints.size());
     for (Node* node : databasePoints) {
-        TEST_CHECK(G.adjacency_list[node].size() <= R); // Out-degree <= R
+        TEST_CHECK(G.degree(node->id) <= R); // Out-degree <= R
     }
 
     // Cleanup
@@ -155,12 +160,60 @@ void test_large_dataset() {
     }
 }
 
+// Test6: Nodes with two labels each
+void test_multi_label() {
+    VectorStore store(300, 2);
+    vector<Node*> databasePoints;
+    vector<vector<uint32_t>> node_labels(store.count);
+    mt19937 gen(4);
+    uniform_real_distribution<float> dist(0.0, 10.0);
+    for (unsigned int i = 0; i < store.count; ++i) {
+        databasePoints.push_back(createNode(store, i, i % 3, {dist(gen), dist(gen)}));
+        node_labels[i] = {i % 3, 3 + i % 2};
+    }
+    LabelIndex labels(node_labels);
+
+    DirectedGraph G = FilteredVamana(store, databasePoints, labels, 5, 20, 10, 1.2, 10);
+
+    // Every label is searchable from its medoid, the search stays inside the label, and it finds
+    // the nearest members of the label that a scan over all the points finds
+    vector<unsigned int> medoids = findmedoid(labels, 10);
+    size_t found = 0, expected = 0;
+    for (uint32_t label = 0; label < labels.size(); label++) {
+        for (unsigned int q = 0; q < 20; q++) {
+            const float* x_q = store.row(q * 15 + label);
+            vector<unsigned int> result = FilteredGreedySearch(store, G, labels, {medoids[label]}, x_q, 5, 20, label);
+            TEST_CHECK(result.size() == 5);
+            for (unsigned int id : result) {
+                TEST_CHECK(labels.has(id, label));
+            }
+
+            vector<pair<float, unsigned int>> members;
+            for (const uint32_t* id = labels.begin(label); id != labels.end(label); id++) {
+                members.push_back({euclidean(store, store.row(*id), x_q), *id});
+            }
+            partial_sort(members.begin(), members.begin() + 5, members.end());
+            for (size_t i = 0; i < 5; i++) {
+                found += find(result.begin(), result.end(), members[i].second) != result.end();
+            }
+            expected += 5;
+        }
+    }
+    TEST_CHECK(found >= 0.95 * expected);
+    TEST_MSG("Found %zu of the %zu nearest members", found, expected);
+
+    for (Node* node : databasePoints) {
+        delete node;
+    }
+}
+
 TEST_LIST = {
     {"Fisher-Yates Shuffle", test_fisher_yates_shuffle},
     {"Small dataset with distinct filters", test_small_dataset_distinct_filters},
     {"Empty dataset", test_empty_dataset},
     {"Single node dataset", test_single_node},
     {"All nodes have the same filter", test_same_filter},
+    {"Nodes with several labels", test_multi_label},
     // {"Large dataset with varying filters", test_large_dataset},
     {NULL, NULL}
 };
\ No newline at end of file
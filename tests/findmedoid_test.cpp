@@ -1,35 +1,37 @@
 #include "../include/acutest.h"
 #include "../include/vamana.h" // Include the updated implementation
 
-// Helper function to create a Node
-Node* createNode(unsigned int id, float filter, const vector<float>& coords) {
+// Helper function to create a Node and store its coordinates in row `id` of the store
+Node* createNode(VectorStore& store, unsigned int id, uint32_t label, const vector<float>& coords) {
     Node* node = new Node();
     node->id = id;
-    node->filter = filter; // Set the explicit filter
-    node->coords = coords;
+    node->label = label; // Set the explicit label
+    copy(coords.begin(), coords.end(), store.row(id));
     return node;
 }
 
 void test_medoid_basic() {
     // Create test nodes with explicit filters
+    VectorStore store(4, 2);
     vector<Node*> nodes = {
-        createNode(0, 1.0, {0.5, 0.2}),
-        createNode(1, 2.0, {1.5, 0.3}),
-        createNode(2, 1.0, {2.5, 0.8}),
-        createNode(3, 3.0, {0.7, 0.9})
+        createNode(store, 0, 0, {0.5, 0.2}),
+        createNode(store, 1, 1, {1.5, 0.3}),
+        createNode(store, 2, 0, {2.5, 0.8}),
+        createNode(store, 3, 2, {0.7, 0.9})
     };
 
     // Number of random samples
     unsigned int tau = 2;
 
     // Run findmedoid
-    unordered_map<float, unsigned int> medoids = findmedoid(nodes, tau);
+    vector<unsigned int> medoids = findmedoid(LabelIndex(nodes), tau);
 
-    // Verify results
-    TEST_CHECK(medoids.find(1.0) != medoids.end()); // Filter 1.0 should have a medoid
-    TEST_CHECK(medoids.find(2.0) != medoids.end()); // Filter 2.0 should have a medoid
-    TEST_MSG("Medoid ID for filter 1.0: %d", medoids[1.0]);
-    TEST_MSG("Medoid ID for filter 2.0: %d", medoids[2.0]);
+    // Verify results, every label has a medoid with that label
+    TEST_ASSERT(medoids.size() == 3);
+    TEST_CHECK(medoids[0] == 0 || medoids[0] == 2);
+    TEST_CHECK(medoids[1] == 1);
+    TEST_CHECK(medoids[2] == 3);
+    TEST_MSG("Medoid ID for label 0: %d", medoids[0]);
 
     // Cleanup
     for (auto node : nodes) {
@@ -39,19 +41,20 @@ void test_medoid_basic() {
 
 void test_medoid_empty_filter() {
     // Create test nodes with explicit filters
+    VectorStore store(2, 2);
     vector<Node*> nodes = {
-        createNode(0, 1.0, {0.5, 0.2}),
-        createNode(1, 2.0, {1.5, 0.3})
+        createNode(store, 0, 0, {0.5, 0.2}),
+        createNode(store, 1, 1, {1.5, 0.3})
     };
 
     // Number of random samples
     unsigned int tau = 1;
 
     // Run findmedoid
-    unordered_map<float, unsigned int> medoids = findmedoid(nodes, tau);
+    vector<unsigned int> medoids = findmedoid(LabelIndex(nodes), tau);
 
     // Verify results
-    TEST_CHECK(medoids.find(3.0) == medoids.end()); // No medoid should exist for filter 3.0
+    TEST_CHECK(medoids.size() == 2); // No medoid should exist for label 2
 
     // Cleanup
     for (auto node : nodes) {
@@ -61,21 +64,23 @@ void test_medoid_empty_filter() {
 
 void test_medoid_small_tau() {
     // Create test nodes with explicit filters
+    VectorStore store(3, 2);
     vector<Node*> nodes = {
-        createNode(0, 1.0, {0.5, 0.2}),
-        createNode(1, 1.0, {1.5, 0.3}),
-        createNode(2, 1.0, {2.5, 0.8})
+        createNode(store, 0, 0, {0.5, 0.2}),
+        createNode(store, 1, 0, {1.5, 0.3}),
+        createNode(store, 2, 0, {2.5, 0.8})
     };
 
     // Small tau value
     unsigned int tau = 1;
 
     // Run findmedoid
-    unordered_map<float, unsigned int> medoids = findmedoid(nodes, tau);
+    vector<unsigned int> medoids = findmedoid(LabelIndex(nodes), tau);
 
     // Verify results
-    TEST_CHECK(medoids.find(1.0) != medoids.end());
-    TEST_MSG("Medoid ID for filter 1.0: %d", medoids[1.0]);
+    TEST_ASSERT(medoids.size() == 1);
+    TEST_CHECK(medoids[0] < 3);
+    TEST_MSG("Medoid ID for label 0: %d", medoids[0]);
 
     // Cleanup
     for (auto node : nodes) {
@@ -83,10 +88,147 @@ void test_medoid_small_tau() {
     }
 }
 
+// Two clusters of 500 points in 3 dimensions, around (0, 0, 0) and (100, 100, 100), with the
+// first 10 points of the first cluster pulled a bit further away
+static vector<Node*> twoClusters(VectorStore& store) {
+    mt19937 gen(7);
+    normal_distribution<float> noise(0.0, 1.0);
+    vector<Node*> nodes;
+    for (unsigned int i = 0; i < store.count; i++) {
+        float center = i < store.count / 2 ? 0.0f : 100.0f;
+        float spread = i < 10 ? 5.0f : 1.0f;
+        nodes.push_back(createNode(store, i, 0, {center + spread * noise(gen), center + spread * noise(gen), center + spread * noise(gen)}));
+    }
+    return nodes;
+}
+
+// Mean distance of node p to all the nodes
+static double meanDistance(const VectorStore& store, const vector<Node*>& nodes, unsigned int p) {
+    double sum = 0.0;
+    for (Node* node : nodes) {
+        sum += sqrt(euclidean(store, store.row(p), store.row(node->id)));
+    }
+    return sum / nodes.size();
+}
+
+void test_dataset_medoid() {
+    VectorStore store(1000, 3);
+    vector<Node*> nodes = twoClusters(store);
+
+    // The node closest to the centroid, found by a plain scan
+    vector<float> centroid = findCentroid(store, nodes);
+    unsigned int expected = 0;
+    for (Node* node : nodes) {
+        if (euclidean(store.row(node->id), centroid.data(), 3) < euclidean(store.row(expected), centroid.data(), 3)) {
+            expected = node->id;
+        }
+    }
+
+    ThreadPool serial(0), pool(3);
+    vector<float> parallel = datasetCentroid(store, nodes, pool);
+    for (size_t d = 0; d < 3; d++) {
+        TEST_CHECK(fabs(parallel[d] - centroid[d]) < 1e-3);
+    }
+    TEST_CHECK(datasetMedoid(store, nodes, serial) == expected);
+    TEST_CHECK(datasetMedoid(store, nodes, pool) == expected);
+    TEST_CHECK(datasetMedoid(store, nodes) == expected);
+
+    for (Node* node : nodes) delete node;
+}
+
+void test_sampled_medoid() {
+    VectorStore store(1000, 3);
+    vector<Node*> nodes = twoClusters(store);
+
+    // With every node as a candidate and a sample, the estimate is the exact medoid
+    ThreadPool serial(0), pool(3);
+    MedoidEstimate exact = sampledMedoid(store, nodes, 1000, 1000, 1, pool);
+    TEST_CHECK(exact.error == 0.0f);
+    TEST_CHECK(fabs(exact.mean_distance - meanDistance(store, nodes, exact.id)) < 1e-2);
+    for (unsigned int i = 0; i < 1000; i += 37) {
+        TEST_CHECK(meanDistance(store, nodes, i) >= exact.mean_distance - 1e-2);
+    }
+
+    // From samples, the mean distance of the pick is inside the error bound of the estimate,
+    // and the same seed picks the same node
+    MedoidEstimate sampled = sampledMedoid(store, nodes, 50, 200, 3, serial);
+    TEST_CHECK(sampled.error > 0.0f);
+    TEST_CHECK(fabs(sampled.mean_distance - meanDistance(store, nodes, sampled.id)) <= sampled.error);
+    TEST_CHECK(sampledMedoid(store, nodes, 50, 200, 3, pool).id == sampled.id);
+
+    for (Node* node : nodes) delete node;
+}
+
+void test_diverse_entry_points() {
+    VectorStore store(1000, 3);
+    vector<Node*> nodes = twoClusters(store);
+
+    ThreadPool serial(0), pool(3);
+    vector<unsigned int> entry_points = diverseEntryPoints(store, nodes, 8, 5, pool);
+    TEST_ASSERT(entry_points.size() == 8);
+    TEST_CHECK(entry_points[0] == datasetMedoid(store, nodes));
+    TEST_CHECK(entry_points == diverseEntryPoints(store, nodes, 8, 5, serial));
+
+    // Distinct, and both clusters get entry points
+    vector<unsigned int> sorted = entry_points;
+    sort(sorted.begin(), sorted.end());
+    TEST_CHECK(adjacent_find(sorted.begin(), sorted.end()) == sorted.end());
+    TEST_CHECK(any_of(entry_points.begin(), entry_points.end(), [](unsigned int id) { return id < 500; }));
+    TEST_CHECK(any_of(entry_points.begin(), entry_points.end(), [](unsigned int id) { return id >= 500; }));
+
+    // No more entry points than distinct nodes
+    VectorStore same(3, 3);
+    vector<Node*> copies = {createNode(same, 0, 0, {1, 1, 1}), createNode(same, 1, 0, {1, 1, 1}), createNode(same, 2, 0, {1, 1, 1})};
+    TEST_CHECK(diverseEntryPoints(same, copies, 4, 5).size() == 1);
+
+    for (Node* node : copies) delete node;
+    for (Node* node : nodes) delete node;
+}
+
+void test_kmeans() {
+    VectorStore store(1000, 3);
+    vector<Node*> nodes = twoClusters(store);
+
+    // Both modes find the two clusters, every node with the centroid of its own cluster
+    ThreadPool serial(0), pool(3);
+    for (size_t batch_size : {size_t(0), size_t(64)}) {
+        KMeansResult result = kMeans(store, nodes, 2, 50, 9, batch_size, pool);
+        TEST_ASSERT(result.centroids.count == 2);
+        TEST_CHECK(result.assignment[0] != result.assignment[999]);
+        for (size_t i = 0; i < nodes.size(); i++) {
+            TEST_CHECK(result.assignment[i] == result.assignment[i < 500 ? 0 : 999]);
+        }
+        float center = result.centroids.row(result.assignment[999])[0];
+        TEST_CHECK(fabs(center - 100.0f) < 1.0f);
+        TEST_MSG("Batch size %zu, centroid at %f", batch_size, center);
+        TEST_CHECK(result.inertia > 0.0 && result.inertia < 1000 * 3 * 4.0);
+    }
+
+    // The same seed gives the same clusters on any number of threads
+    KMeansResult one = kMeans(store, nodes, 8, 20, 3, 0, serial);
+    KMeansResult four = kMeans(store, nodes, 8, 20, 3, 0, pool);
+    TEST_CHECK(one.assignment == four.assignment);
+    TEST_CHECK(equal(one.centroids.data, one.centroids.data + 8 * one.centroids.stride, four.centroids.data));
+    TEST_CHECK(one.iterations <= 20);
+
+    vector<vector<Node*>> clusters = kMeansClustering(store, nodes, 8);
+    size_t total = 0;
+    for (const vector<Node*>& cluster : clusters) {
+        total += cluster.size();
+    }
+    TEST_CHECK(clusters.size() == 8 && total == nodes.size());
+
+    for (Node* node : nodes) delete node;
+}
+
 // Test Suite
 TEST_LIST = {
     {"Basic Medoid Test", test_medoid_basic},
     {"Empty Filter Test", test_medoid_empty_filter},
     {"Small Tau Test", test_medoid_small_tau},
+    {"Dataset Medoid Test", test_dataset_medoid},
+    {"Sampled Medoid Test", test_sampled_medoid},
+    {"Diverse Entry Points Test", test_diverse_entry_points},
+    {"K-means Test", test_kmeans},
     {NULL, NULL}
 };
@@ -3,50 +3,223 @@
 #include "../include/vamana.h"
 
 
-Node* create_node(unsigned int id, const vector<float>& coords) {
-    Node* node = new Node();
-    node->id = id;
-    node->coords = coords;
-    return node;
-}
-
 // Test 1: Basic Functionality Test
 void test_basic_functionality() {
-    Node* node0 = create_node(0, {0.0, 0.0});
-    Node* node1 = create_node(1, {1.0, 1.0});
-    Node* node2 = create_node(2, {2.0, 2.0});
-    node0->out_neighbors = {node1, node2};
+    VectorStore store({{0.0, 0.0}, {1.0, 1.0}, {2.0, 2.0}});
+    DirectedGraph graph(store.count, 2);
+    graph.addNeighbor(0, 1);
+    graph.addNeighbor(0, 2);
 
-    Node query;
-    query.coords = {0.1, 0.1};  // Ελαφρώς πιο κοντά στο node0
-    vector<Node*> result = GreedySearch(node0, &query, 1, 3);
+    float query[] = {0.1, 0.1};  // Ελαφρώς πιο κοντά στο node0
+    vector<unsigned int> result = GreedySearch(store, graph, 0, query, 1, 3);
 
     TEST_CHECK(result.size() == 1);
-    TEST_CHECK(result[0]->id == 0);  // Περιμένουμε να επιστρέψει το node0
-
-    delete node0;
-    delete node1;
-    delete node2;
+    TEST_CHECK(result[0] == 0);  // Περιμένουμε να επιστρέψει το node0
 }
 
 
 // Test 2: Empty Graph Test
 void test_empty_graph() {
-    Node query;
-    query.coords = {0.5, 0.5};
-    vector<Node*> result = GreedySearch(nullptr, &query, 1, 1);
+    VectorStore store({{0.5, 0.5}});
+    DirectedGraph graph;
+    float query[] = {0.5, 0.5};
+    vector<unsigned int> result = GreedySearch(store, graph, 0, query, 1, 1);
     TEST_CHECK(result.empty());
 }
 
 
 void test_multiple_nodes_one_query() {
-    Node node1, node2, query;
-    node1.coords = {1.0, 1.0};
-    node2.coords = {2.0, 2.0};
-    query.coords = {1.5, 1.5};
-    node1.out_neighbors.push_back(&node2); // Node1 has Node2 as neighbor
-    vector<Node*> result = GreedySearch(&node1, &query, 1, 1);
-    TEST_CHECK(result.size() == 1 && result[0] == &node1); // Node1 should be closest
+    VectorStore store({{1.0, 1.0}, {2.0, 2.0}});
+    DirectedGraph graph(store.count, 1);
+    float query[] = {1.5, 1.5};
+    graph.addNeighbor(0, 1); // Node1 has Node2 as neighbor
+    vector<unsigned int> result = GreedySearch(store, graph, 0, query, 1, 1);
+    TEST_CHECK(result.size() == 1 && result[0] == 0); // Node1 should be closest
+}
+
+// Test 4: 64 queries at once over one shared index, each thread with its own scratch
+void test_concurrent_queries() {
+    const unsigned int num_nodes = 400, dim = 8, num_queries = 64, k = 10, L = 30;
+    mt19937 gen(11);
+    uniform_real_distribution<float> dist(0.0, 10.0);
+
+    VectorStore store(num_nodes, dim);
+    vector<Node*> nodes;
+    for (unsigned int i = 0; i < num_nodes; i++) {
+        for (unsigned int d = 0; d < dim; d++) {
+            store.row(i)[d] = dist(gen);
+        }
+        nodes.push_back(new Node{i, i % 4});
+    }
+
+    DirectedGraph graph(store.count, 12);
+    VamanaIndexingAlgorithm(store, graph, nodes, k, L, 12, 1.2, num_nodes, 1, 20);
+
+    VectorStore queries(num_queries, dim);
+    for (unsigned int q = 0; q < num_queries; q++) {
+        for (unsigned int d = 0; d < dim; d++) {
+            queries.row(q)[d] = dist(gen);
+        }
+    }
+
+    vector<unsigned int> start_nodes = {0, 1, 2, 3};
+    LabelIndex labels(nodes);
+    auto search = [&](unsigned int q, SearchScratch& scratch) {
+        vector<unsigned int> result = GreedySearch(store, graph, 0, queries.row(q), k, L, scratch);
+        vector<unsigned int> filtered = FilteredGreedySearch(store, graph, labels, start_nodes, queries.row(q), k, L, q % 4, scratch);
+        result.insert(result.end(), filtered.begin(), filtered.end());
+        return result;
+    };
+
+    // The same queries one after the other
+    SearchScratch sequential_scratch;
+    vector<vector<unsigned int>> expected(num_queries);
+    for (unsigned int q = 0; q < num_queries; q++) {
+        expected[q] = search(q, sequential_scratch);
+    }
+
+    vector<vector<unsigned int>> results(num_queries);
+    vector<thread> threads;
+    for (unsigned int q = 0; q < num_queries; q++) {
+        threads.emplace_back([&, q]() {
+            SearchScratch scratch;
+            results[q] = search(q, scratch);
+        });
+    }
+    for (thread& t : threads) {
+        t.join();
+    }
+
+    for (unsigned int q = 0; q < num_queries; q++) {
+        TEST_CHECK(results[q] == expected[q]);
+        TEST_MSG("Query %u differs from the sequential run", q);
+    }
+
+    for (Node* node : nodes) delete node;
+}
+
+// Test 5: A search from several start nodes, and the entry points closest to a query
+void test_multiple_start_nodes() {
+    // Two chains that are not connected: 0 -> 1 -> 2 and 3 -> 4 -> 5
+    VectorStore store({{0.0, 0.0}, {1.0, 0.0}, {2.0, 0.0}, {10.0, 0.0}, {11.0, 0.0}, {12.0, 0.0}});
+    DirectedGraph graph(store.count, 2);
+    graph.addNeighbor(0, 1);
+    graph.addNeighbor(1, 2);
+    graph.addNeighbor(3, 4);
+    graph.addNeighbor(4, 5);
+
+    float query[] = {11.9, 0.0};
+    vector<unsigned int> closest = closestEntryPoints(store, {0, 3, 2}, query, 2);
+    TEST_CHECK(closest == vector<unsigned int>({3, 2}));
+    TEST_CHECK(closestEntryPoints(store, {0, 3}, query, 4).size() == 2);
+
+    // From node 0 alone the search never reaches the second chain, from both it does
+    SearchScratch scratch;
+    TEST_CHECK(GreedySearch(store, graph, 0, query, 1, 6, scratch) == vector<unsigned int>({2}));
+    TEST_CHECK(GreedySearch(store, graph, vector<unsigned int>{0, 3}, query, 1, 6, scratch) == vector<unsigned int>({5}));
+    TEST_CHECK(scratch.hops == 6);
+    TEST_CHECK(scratch.distances == 6);
+
+    // Start nodes out of the graph are skipped
+    TEST_CHECK(GreedySearch(store, graph, vector<unsigned int>{99, 4}, query, 1, 6, scratch) == vector<unsigned int>({5}));
+    TEST_CHECK(scratch.hops == 2);
+}
+
+// Test that a beam of W nodes per hop takes fewer hops than one node per hop and finds about
+// as many of the true neighbors
+void test_beam_width() {
+    const unsigned int num_nodes = 1000, dim = 8, k = 10, L = 30;
+    mt19937 gen(3);
+    uniform_real_distribution<float> dist(0.0, 10.0);
+
+    VectorStore store(num_nodes, dim);
+    vector<Node*> nodes;
+    for (unsigned int i = 0; i < num_nodes; i++) {
+        for (unsigned int d = 0; d < dim; d++) {
+            store.row(i)[d] = dist(gen);
+        }
+        nodes.push_back(new Node{i, 0});
+    }
+    DirectedGraph graph(store.count, 12);
+    VamanaIndexingAlgorithm(store, graph, nodes, k, L, 12, 1.2, num_nodes, 2);
+
+    // On a chain every hop of a wide beam still expands one node, so the results are the same
+    VectorStore line({{0.0}, {1.0}, {2.0}, {3.0}});
+    DirectedGraph chain(line.count, 1);
+    chain.addNeighbor(0, 1);
+    chain.addNeighbor(1, 2);
+    chain.addNeighbor(2, 3);
+    float end[] = {3.0};
+    SearchScratch scratch;
+    TEST_CHECK(GreedySearch(line, chain, vector<unsigned int>{0}, end, 2, 4, scratch, 4) == vector<unsigned int>({3, 2}));
+    TEST_CHECK(scratch.hops == 4 && scratch.distances == 4);
+
+    size_t hops[4] = {}, found[4] = {};
+    for (unsigned int q = 0; q < 100; q++) {
+        vector<float> query(dim);
+        for (float& value : query) value = dist(gen);
+
+        // The exact neighbors, by scanning every node
+        vector<pair<float, unsigned int>> distances;
+        for (unsigned int i = 0; i < num_nodes; i++) {
+            distances.emplace_back(euclidean(store, store.row(i), query.data()), i);
+        }
+        partial_sort(distances.begin(), distances.begin() + k, distances.end());
+
+        for (unsigned int b = 0; b < 4; b++) {
+            unsigned int beam_width = 1u << b;
+            vector<unsigned int> result = GreedySearch(store, graph, vector<unsigned int>{0}, query.data(), k, L, scratch, beam_width);
+            TEST_CHECK(result.size() == k);
+            hops[b] += scratch.hops;
+            for (unsigned int i = 0; i < k; i++) {
+                found[b] += find(result.begin(), result.end(), distances[i].second) != result.end();
+            }
+        }
+    }
+
+    for (unsigned int b = 1; b < 4; b++) {
+        TEST_CHECK(hops[b] < hops[b - 1]);
+        TEST_MSG("%zu hops with a beam of %u, %zu with %u", hops[b], 1u << b, hops[b - 1], 1u << (b - 1));
+        TEST_CHECK(found[b] + 10 >= found[0]);
+        TEST_MSG("Found %zu with a beam of %u, %zu with 1", found[b], 1u << b, found[0]);
+    }
+
+    for (Node* node : nodes) delete node;
+}
+
+// Test that prefetching changes nothing but the timing: a hop of one node that collects its
+// neighbors first inserts them in the same order as the direct walk
+void test_prefetch() {
+    const unsigned int num_nodes = 500, dim = 20, k = 10, L = 40;
+    mt19937 gen(9);
+    uniform_real_distribution<float> dist(0.0, 10.0);
+
+    VectorStore store(num_nodes, dim);
+    vector<Node*> nodes;
+    for (unsigned int i = 0; i < num_nodes; i++) {
+        for (unsigned int d = 0; d < dim; d++) {
+            store.row(i)[d] = dist(gen);
+        }
+        nodes.push_back(new Node{i, 0});
+    }
+    DirectedGraph graph(store.count, 12);
+    VamanaIndexingAlgorithm(store, graph, nodes, k, L, 12, 1.2, num_nodes, 2);
+
+    SearchScratch scratch;
+    vector<unsigned int> start = {7};
+    for (unsigned int q = 0; q < 50; q++) {
+        const float* x_q = store.row(q * 10);
+        for (unsigned int beam_width : {1u, 4u}) {
+            vector<unsigned int> expected = GreedySearch(store, graph, start, x_q, k, L, scratch, beam_width);
+            size_t hops = scratch.hops, distances = scratch.distances;
+            for (unsigned int ahead : {1u, PREFETCH_AHEAD, 64u}) {
+                TEST_CHECK(GreedySearch(store, graph, start, x_q, k, L, scratch, beam_width, ahead) == expected);
+                TEST_CHECK(scratch.hops == hops && scratch.distances == distances);
+            }
+        }
+    }
+
+    for (Node* node : nodes) delete node;
 }
 
 // List of tests
@@ -54,5 +227,9 @@ TEST_LIST = {
     {"Basic Functionality", test_basic_functionality},
     {"Empty Graph", test_empty_graph},
     {"Test greedysearch with manual nodes", test_multiple_nodes_one_query},
+    {"Concurrent queries", test_concurrent_queries},
+    {"Multiple start nodes", test_multiple_start_nodes},
+    {"Beam width", test_beam_width},
+    {"Prefetch", test_prefetch},
     {NULL, NULL} // End of the list
 };
@@ -0,0 +1,191 @@
+#include "../include/acutest.h"
+
+#include "../include/vamana.h"
+
+const string INDEX_PATH = "indexfile_test.bin";
+
+// Small random index: 200 nodes of 100 dimensions with 4 labels
+struct TestIndex {
+    VectorStore store;
+    vector<Node*> nodes;
+    DirectedGraph graph;
+
+    TestIndex() : store(200, 100), graph(200, 8) {
+        mt19937 gen(5);
+        uniform_real_distribution<float> dist(0.0, 10.0);
+        for (unsigned int i = 0; i < store.count; i++) {
+            for (unsigned int d = 0; d < store.dim; d++) {
+                store.row(i)[d] = dist(gen);
+            }
+            nodes.push_back(new Node{i, i % 4, i * 0.5f});
+        }
+        VamanaIndexingAlgorithm(store, graph, nodes, 8, 16, 8, 1.2, nodes.size(), 1, 20);
+    }
+
+    ~TestIndex() {
+        for (Node* node : nodes) delete node;
+    }
+};
+
+// Test that an opened index has the same vectors, neighbors, labels, timestamps and entry points as the saved one
+void test_round_trip() {
+    TestIndex saved;
+    vector<float> label_values = {10.0, 12.5, -3.0, 7.0};
+    vector<unsigned int> medoids = {4, 5, 6, 7};
+    unsigned int entry_point = datasetMedoid(saved.store, saved.nodes);
+    vector<unsigned int> entry_points = diverseEntryPoints(saved.store, saved.nodes, ENTRY_POINTS, 1);
+    SaveIndex(INDEX_PATH, saved.store, saved.graph, saved.nodes, LabelIndex(saved.nodes), label_values, entry_point, medoids, entry_points);
+
+    IndexFile index;
+    vector<Node*> nodes = OpenIndex(INDEX_PATH, index);
+    TEST_ASSERT(nodes.size() == saved.nodes.size());
+
+    TEST_CHECK(index.store.dim == 100);
+    TEST_CHECK(index.store.l2 == saved.store.l2);
+    TEST_CHECK(reinterpret_cast<uintptr_t>(index.store.data) % 64 == 0);
+    TEST_CHECK(index.graph.R == 8);
+    TEST_CHECK(index.entry_point == entry_point);
+    TEST_CHECK(index.medoids == medoids);
+    TEST_CHECK(entry_points.size() == ENTRY_POINTS);
+    TEST_CHECK(index.entry_points == entry_points);
+    TEST_CHECK(index.label_values == label_values);
+    TEST_CHECK(index.labels.size() == 4);
+    TEST_CHECK(index.labels.count(1) == 50);
+    TEST_CHECK(index.labels.ofNode() != nullptr);
+    TEST_CHECK(index.labels.words == 1);
+
+    for (unsigned int i = 0; i < nodes.size(); i++) {
+        TEST_CHECK(nodes[i] == &index.nodes[i]);
+        TEST_CHECK(nodes[i]->id == i);
+        TEST_CHECK(nodes[i]->label == saved.nodes[i]->label);
+        TEST_CHECK(nodes[i]->timestamp == saved.nodes[i]->timestamp);
+        TEST_CHECK(equal(index.store.row(i), index.store.row(i) + index.store.stride, saved.store.row(i)));
+        TEST_CHECK(index.graph.degree(i) == saved.graph.degree(i));
+        TEST_CHECK(equal(index.graph.neighbors(i), index.graph.neighbors(i) + index.graph.degree(i), saved.graph.neighbors(i)));
+    }
+
+    // A search over the mapping finds what the same search over the saved index finds
+    TEST_CHECK(GreedySearch(index.store, index.graph, entry_point, saved.store.row(3), 5, 16)
+               == GreedySearch(saved.store, saved.graph, entry_point, saved.store.row(3), 5, 16));
+    TEST_CHECK(FilteredGreedySearch(index.store, index.graph, index.labels, {5}, saved.store.row(3), 5, 16, 1)
+               == FilteredGreedySearch(saved.store, saved.graph, LabelIndex(saved.nodes), {5}, saved.store.row(3), 5, 16, 1));
+
+    remove(INDEX_PATH.c_str());
+}
+
+// Test that neighbor ids above 2^24 survive, which a float cannot hold exactly, and that ids past
+// the last node, which a search would follow out of the mapping, are refused by verify
+void test_large_ids() {
+    VectorStore store(2, 3);
+    DirectedGraph graph(2, 2);
+    vector<Node*> nodes = {new Node{0, 0}, new Node{1, 0}};
+    graph.setNeighbors(0, {1});
+    graph.setNeighbors(1, {0});
+    graph.row(1)[1] = (1u << 24) + 1;
+
+    SaveIndex(INDEX_PATH, store, graph, nodes, LabelIndex(nodes), {1.0}, 0, {});
+    IndexFile index;
+    TEST_CHECK(OpenIndex(INDEX_PATH, index, true).empty());
+
+    // Without verify the graph is not read at open
+    TEST_CHECK(OpenIndex(INDEX_PATH, index).size() == 2);
+    TEST_CHECK(index.graph.neighbors(1)[0] == (1u << 24) + 1);
+
+    // A degree above R would read the next rows as neighbors
+    graph.row(1)[1] = 0;
+    graph.row(1)[0] = 3;
+    SaveIndex(INDEX_PATH, store, graph, nodes, LabelIndex(nodes), {1.0}, 0, {});
+    TEST_CHECK(OpenIndex(INDEX_PATH, index, true).empty());
+
+    graph.setNeighbors(1, {0});
+    SaveIndex(INDEX_PATH, store, graph, nodes, LabelIndex(nodes), {1.0}, 0, {});
+    vector<Node*> opened = OpenIndex(INDEX_PATH, index, true);
+    TEST_ASSERT(opened.size() == 2);
+    TEST_CHECK(index.graph.degree(0) == 1);
+    TEST_CHECK(index.graph.neighbors(0)[0] == 1);
+    TEST_CHECK(index.medoids.empty());
+    TEST_CHECK((index.label_values == vector<float>{1.0}));
+    TEST_CHECK(opened[1]->label == 0);
+
+    for (Node* node : nodes) delete node;
+    remove(INDEX_PATH.c_str());
+}
+
+// Test that nodes with several labels, or none, keep all of them
+void test_multi_label() {
+    TestIndex saved;
+    vector<vector<uint32_t>> node_labels(saved.nodes.size());
+    for (unsigned int i = 0; i < node_labels.size(); i++) {
+        if (i % 5 != 0) {
+            node_labels[i] = {i % 4, 4 + i % 3};
+        }
+    }
+    LabelIndex labels(node_labels);
+    SaveIndex(INDEX_PATH, saved.store, saved.graph, saved.nodes, labels, vector<float>(7, 0.0), 0, {});
+
+    IndexFile index;
+    vector<Node*> nodes = OpenIndex(INDEX_PATH, index, true);
+    TEST_ASSERT(nodes.size() == saved.nodes.size());
+    TEST_ASSERT(index.labels.nodeCount() == labels.nodeCount());
+    TEST_CHECK(equal(labels.node_offsets.begin(), labels.node_offsets.end(), index.labels.nodeOffsets()));
+    TEST_CHECK(equal(labels.node_labels.begin(), labels.node_labels.end(), index.labels.nodeLabels()));
+    TEST_CHECK(equal(labels.members.begin(), labels.members.end(), index.labels.memberIds()));
+    TEST_CHECK(equal(labels.bits.begin(), labels.bits.end(), index.labels.bitRows()));
+    TEST_CHECK(index.labels.ofNode() == nullptr);
+
+    for (unsigned int i = 0; i < nodes.size(); i++) {
+        TEST_CHECK(nodes[i]->label == (i % 5 == 0 ? NO_LABEL : i % 4));
+        TEST_CHECK(index.labels.has(i, 4 + i % 3) == (i % 5 != 0));
+        TEST_CHECK(index.labels.matches(i, LabelFilter({i % 4, 4 + i % 3}, MATCH_ALL)) == (i % 5 != 0));
+    }
+
+    remove(INDEX_PATH.c_str());
+}
+
+// Test that missing, foreign, truncated and corrupted files are refused
+void test_invalid_files() {
+    IndexFile index;
+    TEST_CHECK(OpenIndex("no_such_index.bin", index).empty());
+
+    // A file of the old format, which starts with the number of points
+    {
+        ofstream ofs(INDEX_PATH, ios::binary);
+        vector<char> bytes(256, 1);
+        ofs.write(bytes.data(), bytes.size());
+    }
+    TEST_CHECK(OpenIndex(INDEX_PATH, index).empty());
+
+    TestIndex saved;
+    SaveIndex(INDEX_PATH, saved.store, saved.graph, saved.nodes, LabelIndex(), {}, 0, {});
+    TEST_CHECK(truncate(INDEX_PATH.c_str(), 4096) == 0);
+    TEST_CHECK(OpenIndex(INDEX_PATH, index).empty());
+    TEST_CHECK(index.mapping == nullptr);
+
+    // An entry point past the last node
+    vector<float> label_values = {10.0, 12.5, -3.0, 7.0};
+    SaveIndex(INDEX_PATH, saved.store, saved.graph, saved.nodes, LabelIndex(saved.nodes), label_values, 0, {}, {0, static_cast<unsigned int>(saved.nodes.size())});
+    TEST_CHECK(OpenIndex(INDEX_PATH, index).empty());
+
+    // A medoid past the last node
+    SaveIndex(INDEX_PATH, saved.store, saved.graph, saved.nodes, LabelIndex(saved.nodes), label_values, 0, {0, 1, 2, static_cast<unsigned int>(saved.nodes.size())});
+    TEST_CHECK(OpenIndex(INDEX_PATH, index).empty());
+
+    // A label without a value
+    SaveIndex(INDEX_PATH, saved.store, saved.graph, saved.nodes, LabelIndex(saved.nodes), {10.0, 12.5, -3.0}, 0, {});
+    TEST_CHECK(OpenIndex(INDEX_PATH, index).empty());
+
+    SaveIndex(INDEX_PATH, saved.store, saved.graph, saved.nodes, LabelIndex(saved.nodes), label_values, 0, {0, 1, 2, 3});
+    TEST_CHECK(OpenIndex(INDEX_PATH, index, true).size() == saved.nodes.size());
+
+    remove(INDEX_PATH.c_str());
+}
+
+
+TEST_LIST = {
+    {"test_round_trip", test_round_trip},
+    {"test_large_ids", test_large_ids},
+    {"test_multi_label", test_multi_label},
+    {"test_invalid_files", test_invalid_files},
+
+    {NULL, NULL} // Terminate the list
+};
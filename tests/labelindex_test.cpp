@@ -0,0 +1,165 @@
+#include "../include/acutest.h"
+
+#include "../include/vamana.h"
+
+// Random labels for 500 nodes: 0 to 3 labels of num_labels each
+vector<vector<uint32_t>> random_labels(uint32_t num_labels) {
+    mt19937 gen(13);
+    uniform_int_distribution<uint32_t> label(0, num_labels - 1);
+    vector<vector<uint32_t>> node_labels(500);
+    for (size_t i = 0; i < node_labels.size(); i++) {
+        for (size_t j = 0; j < i % 4; j++) {
+            node_labels[i].push_back(label(gen));
+        }
+    }
+    return node_labels;
+}
+
+// Whether a node with these labels passes the filter, from the definition
+bool expected_match(vector<uint32_t> labels, const LabelFilter& filter) {
+    sort(labels.begin(), labels.end());
+    if (filter.mode == MATCH_ALL) {
+        return all_of(filter.labels.begin(), filter.labels.end(), [&](uint32_t f) { return binary_search(labels.begin(), labels.end(), f); });
+    }
+    return any_of(filter.labels.begin(), filter.labels.end(), [&](uint32_t f) { return binary_search(labels.begin(), labels.end(), f); });
+}
+
+// Test that the members of every label are exactly the nodes that have it, in id order
+void test_members() {
+    vector<Node*> nodes;
+    for (unsigned int i = 0; i < 100; i++) {
+        nodes.push_back(new Node{i, i % 3 == 0 ? 2u : i % 2});
+    }
+
+    LabelIndex labels(nodes);
+    TEST_CHECK(labels.size() == 3);
+    TEST_CHECK(labels.nodeCount() == 100);
+    TEST_CHECK(labels.words == 1);
+    TEST_CHECK(labels.of_node.size() == 100);  // one label per node
+    TEST_CHECK(labels.count(2) == 34);
+    TEST_CHECK(labels.count(NO_LABEL) == 0);
+
+    for (uint32_t label = 0; label < labels.size(); label++) {
+        TEST_CHECK(is_sorted(labels.begin(label), labels.end(label)));
+        for (const uint32_t* id = labels.begin(label); id != labels.end(label); id++) {
+            TEST_CHECK(nodes[*id]->label == label);
+            TEST_CHECK(labels.has(*id, label));
+        }
+    }
+    TEST_CHECK(!labels.has(0, NO_LABEL));
+
+    for (Node* node : nodes) delete node;
+}
+
+// Test that the bitsets and the sorted lists give the same answers as the definitions
+void test_filters() {
+    // 100 labels fit the bitsets, 2000 do not
+    for (uint32_t num_labels : {100u, 2000u}) {
+        vector<vector<uint32_t>> node_labels = random_labels(num_labels);
+        LabelIndex labels(node_labels);
+        TEST_CHECK((labels.words > 0) == (num_labels <= LABEL_BITSET_WORDS * 64));
+        TEST_CHECK(labels.of_node.empty());
+
+        size_t total = 0;
+        for (vector<uint32_t> of_node : node_labels) {
+            sort(of_node.begin(), of_node.end());
+            total += unique(of_node.begin(), of_node.end()) - of_node.begin();
+        }
+        TEST_CHECK(labels.members.size() == total);
+
+        mt19937 gen(3);
+        uniform_int_distribution<uint32_t> label(0, num_labels - 1);
+        for (size_t f = 0; f < 20; f++) {
+            // Filters of 1 to 3 labels, over several words of the bitset
+            vector<uint32_t> filter_labels(1 + f % 3);
+            for (uint32_t& l : filter_labels) {
+                l = label(gen);
+            }
+            filter_labels[0] = node_labels[f * 8 + 3][0];  // a label that node has
+
+            for (FilterMode mode : {MATCH_ANY, MATCH_ALL}) {
+                LabelFilter filter(filter_labels, mode);
+                for (unsigned int id = 0; id < node_labels.size(); id++) {
+                    TEST_CHECK(labels.matches(id, filter) == expected_match(node_labels[id], filter));
+                }
+            }
+        }
+
+        for (unsigned int a = 0; a < 50; a++) {
+            for (unsigned int b = 0; b < 50; b++) {
+                bool common = false;
+                for (uint32_t l : node_labels[a]) {
+                    common = common || count(node_labels[b].begin(), node_labels[b].end(), l) > 0;
+                }
+                TEST_CHECK(labels.shares(a, b) == common);
+
+                // c = 0 has no labels, c = 1 has one
+                for (unsigned int c : {0u, 1u, a}) {
+                    bool covered = true;
+                    for (uint32_t l : node_labels[a]) {
+                        bool in_b = count(node_labels[b].begin(), node_labels[b].end(), l) > 0;
+                        bool in_c = count(node_labels[c].begin(), node_labels[c].end(), l) > 0;
+                        covered = covered && (!in_b || in_c);
+                    }
+                    TEST_CHECK(labels.covers(a, b, c) == covered);
+                }
+            }
+        }
+    }
+}
+
+// Test that a single label filter matches like has(), and that NO_LABEL matches nothing
+void test_single_label_filter() {
+    vector<vector<uint32_t>> node_labels = random_labels(100);
+    LabelIndex labels(node_labels);
+
+    for (uint32_t label : {0u, 63u, 64u, 99u, 150u, NO_LABEL}) {
+        LabelFilter filter = label;
+        TEST_CHECK(filter.words.size() == (label == NO_LABEL ? 0 : 1));
+        for (unsigned int id = 0; id < node_labels.size(); id++) {
+            TEST_CHECK(labels.matches(id, filter) == labels.has(id, label));
+        }
+    }
+    TEST_CHECK(!labels.matches(1, LabelFilter(NO_LABEL)));
+}
+
+// Test that a filtered search over nodes with several labels only returns nodes that pass
+void test_search_all_of() {
+    VectorStore store(400, 4);
+    mt19937 gen(8);
+    uniform_real_distribution<float> dist(0.0, 10.0);
+    vector<Node*> nodes;
+    vector<vector<uint32_t>> node_labels(store.count);
+    for (unsigned int i = 0; i < store.count; i++) {
+        for (unsigned int d = 0; d < store.dim; d++) {
+            store.row(i)[d] = dist(gen);
+        }
+        node_labels[i] = {i % 2, 2 + i % 3};
+        nodes.push_back(new Node{i, i % 2});
+    }
+    LabelIndex labels(node_labels);
+
+    DirectedGraph graph(store.count, 12);
+    VamanaIndexingAlgorithm(store, graph, nodes, 10, 30, 12, 1.2, nodes.size(), 1, 20);
+
+    vector<unsigned int> start_nodes(nodes.size());
+    iota(start_nodes.begin(), start_nodes.end(), 0);
+    LabelFilter both({1, 3}, MATCH_ALL);
+    vector<unsigned int> result = FilteredGreedySearch(store, graph, labels, start_nodes, store.row(7), 10, 30, both);
+    TEST_CHECK(result.size() == 10);
+    for (unsigned int id : result) {
+        TEST_CHECK(id % 2 == 1 && id % 3 == 1);
+    }
+
+    for (Node* node : nodes) delete node;
+}
+
+
+TEST_LIST = {
+    {"test_members", test_members},
+    {"test_filters", test_filters},
+    {"test_single_label_filter", test_single_label_filter},
+    {"test_search_all_of", test_search_all_of},
+
+    {NULL, NULL} // Terminate the list
+};
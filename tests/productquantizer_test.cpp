@@ -0,0 +1,136 @@
+#include "../include/acutest.h"
+#include "../include/vamana.h"
+
+// 1000 points of 10 dimensions around 20 centers, so the subspaces have clusters to learn
+struct TestIndex {
+    VectorStore store;
+    vector<Node*> nodes;
+    DirectedGraph graph;
+
+    TestIndex() : store(1000, 10), graph(1000, 16) {
+        mt19937 gen(5);
+        uniform_real_distribution<float> center(0.0, 100.0);
+        normal_distribution<float> noise(0.0, 0.5);
+        vector<vector<float>> centers(20, vector<float>(10));
+        for (vector<float>& c : centers) {
+            for (float& value : c) value = center(gen);
+        }
+        for (unsigned int i = 0; i < 1000; i++) {
+            for (unsigned int d = 0; d < 10; d++) {
+                store.row(i)[d] = centers[i % 20][d] + noise(gen);
+            }
+            nodes.push_back(new Node{i, i % 3});
+        }
+        // A fixed seed, so the graph and its recall are the same on every run
+        srand(5);
+        VamanaIndexingAlgorithm(store, graph, nodes, 10, 40, 16, 1.2, nodes.size(), 2);
+    }
+
+    ~TestIndex() {
+        for (Node* node : nodes) delete node;
+    }
+};
+
+// Test the split of the dimensions, the size of the codes and that the table distances are close to the exact ones
+void test_codes() {
+    TestIndex index;
+    ThreadPool pool(1);
+    ProductQuantizer pq(index.store, index.nodes, 4, 1000, 1, pool);
+
+    TEST_CHECK(pq.offsets == vector<uint32_t>({0, 2, 5, 7, 10}));
+    TEST_CHECK(pq.sub_dim == 3);
+    TEST_CHECK(pq.codes.size() == 1000 * 4);
+
+    // A row's code is its encoding, and a row is closer to its own code than most rows are
+    vector<uint8_t> code(4);
+    pq.encode(index.store.row(17), code.data());
+    TEST_CHECK(equal(code.begin(), code.end(), pq.code(17)));
+
+    vector<float> table;
+    double error = 0.0, spread = 0.0;
+    for (unsigned int q = 0; q < 1000; q += 10) {
+        pq.distanceTable(index.store.row(q), table);
+        for (unsigned int i = 0; i < 1000; i += 7) {
+            float exact = euclidean(index.store, index.store.row(q), index.store.row(i));
+            error += fabs(pq.distance(table.data(), i) - exact);
+            spread += exact;
+        }
+    }
+    TEST_CHECK(error < 0.05 * spread);
+    TEST_MSG("Mean relative error %f", error / spread);
+}
+
+// Test that the searches on the codes find about as many of the true neighbors as the searches on
+// the floats over the same graph. The graph is seeded by the clock, so the bar is relative to it.
+void test_search() {
+    TestIndex index;
+    ProductQuantizer pq(index.store, index.nodes, 5, 1000, 3);
+    const unsigned int k = 10, L = 40;
+
+    LabelIndex labels(index.nodes);
+    vector<unsigned int> start_nodes(index.nodes.size());
+    iota(start_nodes.begin(), start_nodes.end(), 0);
+
+    // The k nearest nodes of x_q that pass `keep`, by a scan over all of them
+    auto nearest = [&](const float* x_q, const function<bool(unsigned int)>& keep) {
+        vector<pair<float, unsigned int>> distances;
+        for (unsigned int i = 0; i < index.store.count; i++) {
+            if (keep(i)) distances.push_back({euclidean(index.store, index.store.row(i), x_q), i});
+        }
+        partial_sort(distances.begin(), distances.begin() + k, distances.end());
+        vector<unsigned int> ids;
+        for (unsigned int i = 0; i < k; i++) ids.push_back(distances[i].second);
+        return ids;
+    };
+    auto countFound = [](const vector<unsigned int>& result, const vector<unsigned int>& truth) {
+        return count_if(result.begin(), result.end(), [&](unsigned int id) { return find(truth.begin(), truth.end(), id) != truth.end(); });
+    };
+
+    SearchScratch scratch;
+    size_t found = 0, found_exact = 0, found_filtered = 0, found_filtered_exact = 0;
+    for (unsigned int q = 0; q < 50; q++) {
+        const float* x_q = index.store.row(q * 20 + 3);
+
+        vector<unsigned int> truth = nearest(x_q, [](unsigned int) { return true; });
+        vector<unsigned int> result = GreedySearch(index.store, pq, index.graph, {0}, x_q, k, L, scratch);
+        TEST_CHECK(result.size() == k);
+        found += countFound(result, truth);
+        found_exact += countFound(GreedySearch(index.store, index.graph, 0, x_q, k, L), truth);
+
+        uint32_t label = q % 3;
+        vector<unsigned int> truth_filtered = nearest(x_q, [&](unsigned int id) { return index.nodes[id]->label == label; });
+        vector<unsigned int> filtered = FilteredGreedySearch(index.store, pq, index.graph, labels, start_nodes, x_q, k, L, label, scratch);
+        for (unsigned int id : filtered) {
+            TEST_CHECK(index.nodes[id]->label == label);
+        }
+        found_filtered += countFound(filtered, truth_filtered);
+        found_filtered_exact += countFound(FilteredGreedySearch(index.store, index.graph, labels, start_nodes, x_q, k, L, label), truth_filtered);
+    }
+
+    TEST_CHECK(found >= 0.75 * found_exact);
+    TEST_MSG("Found %zu, on the floats %zu", found, found_exact);
+    TEST_CHECK(found_filtered >= 0.9 * found_filtered_exact);
+    TEST_MSG("Found %zu, on the floats %zu", found_filtered, found_filtered_exact);
+}
+
+void test_invalid() {
+    VectorStore store(4, 2);
+    vector<Node*> nodes;
+    TEST_EXCEPTION(ProductQuantizer(store, nodes, 1, 4, 0), invalid_argument);
+    Node node{0, 0, 0.0f};
+    nodes.push_back(&node);
+    TEST_EXCEPTION(ProductQuantizer(store, nodes, 3, 4, 0), invalid_argument);
+
+    // Fewer training points than centroids
+    ProductQuantizer pq(store, nodes, 2, 4, 0);
+    TEST_CHECK(pq.codes.size() == 8);
+}
+
+
+TEST_LIST = {
+    {"test_codes", test_codes},
+    {"test_search", test_search},
+    {"test_invalid", test_invalid},
+
+    {NULL, NULL} // Terminate the list
+};
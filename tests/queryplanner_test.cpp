@@ -0,0 +1,132 @@
+#include "../include/acutest.h"
+
+#include "../include/vamana.h"
+
+// Nodes of 1000 points without coordinates: label 0 on 900 of them, label 1 on 95 and label 2 on 5,
+// with timestamps i / 1000
+vector<Node*> make_nodes() {
+    vector<Node*> nodes;
+    for (unsigned int i = 0; i < 1000; i++) {
+        uint32_t label = i < 900 ? 0 : (i < 995 ? 1 : 2);
+        nodes.push_back(new Node{i, label, i / 1000.0f});
+    }
+    return nodes;
+}
+
+// Test that unfiltered queries walk the graph
+void test_unfiltered() {
+    vector<Node*> nodes = make_nodes();
+    TimestampIndex timestamps(nodes, LabelIndex(nodes));
+    DirectedGraph graph(nodes.size(), 16);
+
+    QueryPlan plan = planQuery(timestamps, graph, 0, {0, 0, NO_LABEL, -1.0, -1.0}, 20);
+    TEST_CHECK(plan.kind == PLAN_GRAPH);
+    TEST_CHECK(plan.list_size == 20);
+
+    for (Node* node : nodes) delete node;
+}
+
+// Test that rare labels are scanned and common ones walked, depending on the start nodes
+void test_filter_cardinality() {
+    vector<Node*> nodes = make_nodes();
+    TimestampIndex timestamps(nodes, LabelIndex(nodes));
+    DirectedGraph graph(nodes.size(), 16);
+
+    // 5 nodes are cheaper to scan than any walk, and the scan goes over exactly them
+    QueryPlan plan = planQuery(timestamps, graph, 1, {0, 1, 2, -1.0, -1.0}, 20);
+    TEST_CHECK(plan.kind == PLAN_SCAN);
+    TEST_CHECK(plan.last - plan.first == 5);
+    TEST_CHECK(plan.cost == 5.0);
+
+    // 900 nodes are walked from the medoid
+    plan = planQuery(timestamps, graph, 1, {0, 1, 0, -1.0, -1.0}, 20);
+    TEST_CHECK(plan.kind == PLAN_FILTERED_GRAPH || plan.kind == PLAN_POST_FILTER);
+    TEST_CHECK(plan.cost < 900.0);
+
+    // 95 nodes are walked from the medoid, but scanned when every node is a start node
+    plan = planQuery(timestamps, graph, 1, {0, 1, 1, -1.0, -1.0}, 5);
+    TEST_CHECK(plan.kind == PLAN_FILTERED_GRAPH);
+    plan = planQuery(timestamps, graph, nodes.size(), {0, 1, 1, -1.0, -1.0}, 5);
+    TEST_CHECK(plan.kind == PLAN_SCAN);
+
+    // A label that no node has gives an empty scan
+    plan = planQuery(timestamps, graph, 1, {0, 1, 9, -1.0, -1.0}, 20);
+    TEST_CHECK(plan.kind == PLAN_SCAN);
+    TEST_CHECK(plan.last == plan.first);
+
+    for (Node* node : nodes) delete node;
+}
+
+// Test that the timestamp window decides the plan of types 2 and 3
+void test_windows() {
+    vector<Node*> nodes = make_nodes();
+    TimestampIndex timestamps(nodes, LabelIndex(nodes));
+    DirectedGraph graph(nodes.size(), 16);
+
+    // A narrow window is scanned
+    QueryPlan plan = planQuery(timestamps, graph, 3, {0, 2, NO_LABEL, 0.1, 0.15}, 20);
+    TEST_CHECK(plan.kind == PLAN_SCAN);
+    TEST_CHECK(plan.last - plan.first == 51);
+
+    // A wide one is walked with a larger search list
+    plan = planQuery(timestamps, graph, 3, {0, 2, NO_LABEL, 0.0, 0.5}, 20);
+    TEST_CHECK(plan.kind == PLAN_GRAPH);
+    TEST_CHECK(plan.list_size == rangeListSize(20, 501, 1000));
+
+    // The window is applied to the nodes of the label
+    plan = planQuery(timestamps, graph, 3, {0, 3, 1, 0.9, 0.95}, 20);
+    TEST_CHECK(plan.kind == PLAN_SCAN);
+    TEST_CHECK(plan.last - plan.first == 51);
+    for (size_t i = plan.first; i < plan.last; i++) {
+        TEST_CHECK(nodes[plan.candidates->ids[i]]->label == 1);
+    }
+
+    for (Node* node : nodes) delete node;
+}
+
+// Test that a common label with a wide window is post filtered when the filtered walk has to start from every node
+void test_post_filter() {
+    vector<Node*> nodes = make_nodes();
+    TimestampIndex timestamps(nodes, LabelIndex(nodes));
+    DirectedGraph graph(nodes.size(), 4);
+
+    QueryPlan plan = planQuery(timestamps, graph, nodes.size(), {0, 1, 0, -1.0, -1.0}, 20);
+    TEST_CHECK(plan.kind == PLAN_POST_FILTER);
+    TEST_CHECK(plan.list_size == 22);
+
+    for (Node* node : nodes) delete node;
+}
+
+// Test that a label on 30% of the nodes is walked from its medoid at the usual search list, and
+// scanned when it has no medoid or the walk starts from every node of the label
+void test_medoid_start() {
+    vector<Node*> nodes;
+    for (unsigned int i = 0; i < 1000; i++) {
+        nodes.push_back(new Node{i, i < 700 ? 0u : 1u, i / 1000.0f});
+    }
+    TimestampIndex timestamps(nodes, LabelIndex(nodes));
+    DirectedGraph graph(nodes.size(), 16);
+
+    QueryPlan plan = planQuery(timestamps, graph, 1, {0, 1, 1, -1.0, -1.0}, 20);
+    TEST_CHECK(plan.kind == PLAN_FILTERED_GRAPH);
+    TEST_CHECK(plan.list_size == 20);
+    TEST_CHECK(plan.cost < 300.0);
+
+    plan = planQuery(timestamps, graph, 0, {0, 1, 1, -1.0, -1.0}, 20);
+    TEST_CHECK(plan.kind == PLAN_SCAN);
+    plan = planQuery(timestamps, graph, 300, {0, 1, 1, -1.0, -1.0}, 20);
+    TEST_CHECK(plan.kind == PLAN_SCAN);
+
+    for (Node* node : nodes) delete node;
+}
+
+
+TEST_LIST = {
+    {"test_unfiltered", test_unfiltered},
+    {"test_filter_cardinality", test_filter_cardinality},
+    {"test_windows", test_windows},
+    {"test_post_filter", test_post_filter},
+    {"test_medoid_start", test_medoid_start},
+
+    {NULL, NULL} // Terminate the list
+};
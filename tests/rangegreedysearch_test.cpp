@@ -0,0 +1,190 @@
+#include "../include/acutest.h"
+
+#include "../include/vamana.h"
+
+// Random index of 1000 nodes with 4 labels and timestamps in [0, 1)
+struct TestIndex {
+    VectorStore store;
+    vector<Node*> nodes;
+    DirectedGraph graph;
+    LabelIndex labels;
+
+    TestIndex() : store(1000, 8), graph(1000, 16) {
+        mt19937 gen(21);
+        uniform_real_distribution<float> dist(0.0, 10.0);
+        uniform_real_distribution<float> time(0.0, 1.0);
+        for (unsigned int i = 0; i < store.count; i++) {
+            for (unsigned int d = 0; d < store.dim; d++) {
+                store.row(i)[d] = dist(gen);
+            }
+            nodes.push_back(new Node{i, i % 4, time(gen)});
+        }
+        // A fixed seed, so the graph and its recall are the same on every run
+        srand(1);
+        VamanaIndexingAlgorithm(store, graph, nodes, 16, 40, 16, 1.2, nodes.size(), 1, 50);
+        labels = LabelIndex(nodes);
+    }
+
+    ~TestIndex() {
+        for (Node* node : nodes) delete node;
+    }
+
+    // Exact k nearest of the nodes that pass the query, by a scan of every node
+    vector<unsigned int> exact(const float* x_q, unsigned int k, uint32_t label, float l, float r) const {
+        vector<pair<float, unsigned int>> distances;
+        for (const Node* node : nodes) {
+            if ((label == NO_LABEL || node->label == label) && node->timestamp >= l && node->timestamp <= r) {
+                distances.emplace_back(euclidean(store, store.row(node->id), x_q), node->id);
+            }
+        }
+        sort(distances.begin(), distances.end());
+
+        vector<unsigned int> ids;
+        for (size_t i = 0; i < distances.size() && i < k; i++) {
+            ids.push_back(distances[i].second);
+        }
+        return ids;
+    }
+};
+
+size_t overlap(const vector<unsigned int>& a, const vector<unsigned int>& b) {
+    unordered_set<unsigned int> in_a(a.begin(), a.end());
+    return count_if(b.begin(), b.end(), [&](unsigned int id) { return in_a.count(id) > 0; });
+}
+
+// Test that the windows of the sorted timestamps hold exactly the nodes inside them
+void test_timestamp_windows() {
+    TestIndex index;
+    TimestampIndex timestamps(index.nodes, index.labels);
+
+    TEST_CHECK(timestamps.all.ids.size() == 1000);
+    TEST_CHECK(is_sorted(timestamps.all.timestamps.begin(), timestamps.all.timestamps.end()));
+    TEST_CHECK(timestamps.by_label.size() == 4);
+
+    auto [first, last] = timestamps.all.window(0.25, 0.5);
+    size_t inside = count_if(index.nodes.begin(), index.nodes.end(), [](const Node* n) { return n->timestamp >= 0.25 && n->timestamp <= 0.5; });
+    TEST_CHECK(last - first == inside);
+    for (size_t i = first; i < last; i++) {
+        const Node* node = index.nodes[timestamps.all.ids[i]];
+        TEST_CHECK(node->timestamp >= 0.25 && node->timestamp <= 0.5);
+    }
+
+    const SortedTimestamps& label = timestamps.by_label.at(2);
+    tie(first, last) = label.window(0.0, 1.0);
+    TEST_CHECK(last - first == 250);
+    for (unsigned int id : label.ids) {
+        TEST_CHECK(index.nodes[id]->label == 2);
+    }
+
+    // Empty and reversed windows
+    tie(first, last) = timestamps.all.window(2.0, 3.0);
+    TEST_CHECK(first == last);
+    tie(first, last) = timestamps.all.window(0.6, 0.4);
+    TEST_CHECK(first == last);
+}
+
+// Test that the scan of a window returns its exact nearest nodes
+void test_brute_force_search() {
+    TestIndex index;
+    TimestampIndex timestamps(index.nodes, index.labels);
+    SearchScratch scratch;
+
+    const float* x_q = index.store.row(17);
+    auto [first, last] = timestamps.all.window(0.1, 0.3);
+    vector<unsigned int> result = BruteForceSearch(index.store, timestamps.all.ids.data() + first, last - first, x_q, 10, scratch);
+
+    TEST_CHECK(result == index.exact(x_q, 10, NO_LABEL, 0.1, 0.3));
+}
+
+// Test that the walk returns only nodes inside the window and of the label, with high recall
+void test_range_greedy_search() {
+    TestIndex index;
+    SearchScratch scratch;
+    const unsigned int k = 10;
+    vector<unsigned int> start_nodes(index.nodes.size());
+    iota(start_nodes.begin(), start_nodes.end(), 0);
+
+    size_t found = 0, expected = 0;
+    for (unsigned int q = 0; q < 20; q++) {
+        const float* x_q = index.store.row(q * 37);
+        float l = 0.05f * q, r = l + 0.4f;
+
+        vector<unsigned int> result = RangeGreedySearch(index.store, index.graph, index.nodes, index.labels, {0}, x_q, k, rangeListSize(40, 400, 1000), NO_LABEL, NO_LABEL, l, r, scratch);
+        for (unsigned int id : result) {
+            TEST_CHECK(index.nodes[id]->timestamp >= l && index.nodes[id]->timestamp <= r);
+        }
+        vector<unsigned int> exact = index.exact(x_q, k, NO_LABEL, l, r);
+        found += overlap(exact, result);
+        expected += exact.size();
+
+        // With a label every result also has it
+        uint32_t label = q % 4;
+        result = RangeGreedySearch(index.store, index.graph, index.nodes, index.labels, start_nodes, x_q, k, 40, label, label, l, r, scratch);
+        for (unsigned int id : result) {
+            TEST_CHECK(index.nodes[id]->label == label);
+            TEST_CHECK(index.nodes[id]->timestamp >= l && index.nodes[id]->timestamp <= r);
+        }
+    }
+
+    TEST_CHECK(found >= expected * 9 / 10);
+    TEST_MSG("Recall %zu of %zu", found, expected);
+}
+
+// Test the growth of the search list with the selectivity of the window
+void test_range_list_size() {
+    TEST_CHECK(rangeListSize(100, 1000, 1000) == 100);
+    TEST_CHECK(rangeListSize(100, 500, 1000) == 200);
+    TEST_CHECK(rangeListSize(100, 1, 1000) == 800);
+    TEST_CHECK(rangeListSize(100, 0, 1000) == 100);
+}
+
+// Test that the batch searcher answers all four query types
+void test_batch_all_types() {
+    TestIndex index;
+    const unsigned int k = 5, L = 20;
+
+    VectorStore query_store(8, 8);
+    vector<Query> queries;
+    for (unsigned int q = 0; q < 8; q++) {
+        copy(index.store.row(q * 100), index.store.row(q * 100) + 8, query_store.row(q));
+        // Types 2 and 3 get a narrow window, scanned, and a wide one, walked
+        float l = q < 4 ? 0.5f : 0.0f, r = q < 4 ? 0.52f : 1.0f;
+        queries.push_back({q, static_cast<int>(q % 4), 1, l, r});
+    }
+
+    BatchSearcher searcher(index.store, index.graph, index.nodes, 2);
+    searcher.entry_points = {0};
+    searcher.medoids = findmedoid(searcher.labels, 10);
+
+    vector<uint32_t> results = searcher.search(query_store, queries, k, L);
+
+    for (size_t q = 0; q < queries.size(); q++) {
+        const Query& query = queries[q];
+        for (size_t j = 0; j < k && results[q * k + j] != NO_NEIGHBOR; j++) {
+            const Node* node = index.nodes[results[q * k + j]];
+            if (query.type == 1 || query.type == 3) {
+                TEST_CHECK(node->label == query.label);
+            }
+            if (query.type == 2 || query.type == 3) {
+                TEST_CHECK(node->timestamp >= query.l && node->timestamp <= query.r);
+            }
+        }
+    }
+
+    // The narrow window of type 2 is scanned, so it is exact
+    vector<uint32_t> row(results.begin() + 2 * k, results.begin() + 3 * k);
+    vector<unsigned int> exact = index.exact(query_store.row(2), k, NO_LABEL, queries[2].l, queries[2].r);
+    exact.resize(k, NO_NEIGHBOR);
+    TEST_CHECK((row == vector<uint32_t>(exact.begin(), exact.end())));
+}
+
+
+TEST_LIST = {
+    {"test_timestamp_windows", test_timestamp_windows},
+    {"test_brute_force_search", test_brute_force_search},
+    {"test_range_greedy_search", test_range_greedy_search},
+    {"test_range_list_size", test_range_list_size},
+    {"test_batch_all_types", test_batch_all_types},
+
+    {NULL, NULL} // Terminate the list
+};
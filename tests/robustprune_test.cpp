@@ -2,47 +2,61 @@
 
 #include "../include/vamana.h"
 
-// Helper function to create a Node with specified coordinates
-Node* create_node(unsigned int id, const vector<float>& coords) {
+// Helper function to create a Node and store its coordinates in row `id` of the store
+Node* create_node(VectorStore& store, unsigned int id, const vector<float>& coords) {
     Node* node = new Node();
     node->id = id;
-    node->coords = coords;
+    copy(coords.begin(), coords.end(), store.row(id));
     return node;
 }
 
 // Test that the euclidean works as expected
 void test_euclidean_distance() {
-    Node* node1 = create_node(1, {1.0, 2.0, 3.0});
-    Node* node2 = create_node(2, {4.0, 5.0, 6.0});
+    VectorStore store(3, 3);
+    Node* node1 = create_node(store, 1, {1.0, 2.0, 3.0});
+    Node* node2 = create_node(store, 2, {4.0, 5.0, 6.0});
     float expected_distance = 27.0;
-    TEST_CHECK(euclidean(node1, node2) == expected_distance);
+    TEST_CHECK(euclidean(store, node1, node2) == expected_distance);
+    TEST_CHECK(euclidean(store.row(1), store.row(2), store.dim) == expected_distance);
 
     delete node1;
     delete node2;
 }
 
 void test_node_add_get_neighbour() {
-    Node* node1 = create_node(1, {1.0, 1.0, 1.0});
-    Node* node2 = create_node(2, {2.0, 2.0, 2.0});
-    node1->out_neighbors.push_back(node2);
+    VectorStore store(3, 3);
+    DirectedGraph graph(store.count, 1);
+    Node* node1 = create_node(store, 1, {1.0, 1.0, 1.0});
+    Node* node2 = create_node(store, 2, {2.0, 2.0, 2.0});
+    TEST_CHECK(graph.addNeighbor(node1->id, node2->id));
 
-    TEST_CHECK(node1->out_neighbors.size() == 1);
-    TEST_CHECK(node1->out_neighbors.at(0)->coords == node2->coords);
+    TEST_CHECK(graph.degree(node1->id) == 1);
+    TEST_CHECK(graph.neighbors(node1->id)[0] == node2->id);
+    TEST_CHECK(store.row(graph.neighbors(node1->id)[0])[0] == 2.0);
+
+    // The row is full, a second neighbor does not fit
+    TEST_CHECK(!graph.addNeighbor(node1->id, 0));
+    TEST_CHECK(graph.degree(node1->id) == 1);
 
     delete node1;
     delete node2;
 }
 
 void test_compare_func_for_nodes() {
-    Node* reference_node = create_node(0, {0.0, 0.0});
-    Node* node1 = create_node(1, {1.0, 1.0});
-    Node* node2 = create_node(2, {2.0, 2.0});
+    VectorStore store(3, 2);
+    Node* reference_node = create_node(store, 0, {0.0, 0.0});
+    Node* node1 = create_node(store, 1, {1.0, 1.0});
+    Node* node2 = create_node(store, 2, {2.0, 2.0});
 
-    node1->distance = euclidean(reference_node, node1);
-    node2->distance = euclidean(reference_node, node2);
+    pair<float, unsigned int> distance1 = {euclidean(store, reference_node, node1), node1->id};
+    pair<float, unsigned int> distance2 = {euclidean(store, reference_node, node2), node2->id};
 
-    bool d = compare_distance(node1, node2);
+    bool d = compare_distance(distance1, distance2);
     TEST_CHECK(d == true);
+    TEST_CHECK(!compare_distance(distance2, distance1));
+
+    // Equal distances are ordered by id
+    TEST_CHECK(compare_distance({1.0, 1}, {1.0, 2}));
 
     delete reference_node;
     delete node1;
@@ -51,28 +65,30 @@ void test_compare_func_for_nodes() {
 
 void test_robust_prune() {
     // Create central node and neighbors
-    Node* central_node = create_node(10, {0.0, 0.0, 0.0});
-    Node* node1 = create_node(1, {1.0, 0.0, 0.0});
-    Node* node2 = create_node(2, {0.0, 1.0, 0.0});
-    Node* node3 = create_node(3, {0.0, 0.0, 1.0});
-    Node* node4 = create_node(4, {2.0, 2.0, 2.0});
+    VectorStore store(11, 3);
+    DirectedGraph graph(store.count, 4);
+    Node* central_node = create_node(store, 10, {0.0, 0.0, 0.0});
+    Node* node1 = create_node(store, 1, {1.0, 0.0, 0.0});
+    Node* node2 = create_node(store, 2, {0.0, 1.0, 0.0});
+    Node* node3 = create_node(store, 3, {0.0, 0.0, 1.0});
+    Node* node4 = create_node(store, 4, {2.0, 2.0, 2.0});
 
-    vector<Node*> possible_neighbours = { node1, node2, node3, node4 };
+    vector<unsigned int> possible_neighbours = { node1->id, node2->id, node3->id, node4->id };
 
     // Define parameters
     int max_neighbours = 2;
     float a = 1.5;
 
     // Run RobustPrune
-    RobustPrune(central_node, possible_neighbours, a, max_neighbours);
+    RobustPrune(store, graph, central_node->id, possible_neighbours, a, max_neighbours);
 
     // Check if the correct number of neighbors were selected
-    TEST_CHECK(central_node->out_neighbors.size() <= static_cast<size_t>(max_neighbours));
+    TEST_CHECK(graph.degree(central_node->id) <= static_cast<size_t>(max_neighbours));
 
     // Validate that the closest neighbors are chosen
     vector<float> distances;
-    for (Node* neighbor : central_node->out_neighbors) {
-        distances.push_back(neighbor->distance);
+    for (uint32_t i = 0; i < graph.degree(central_node->id); i++) {
+        distances.push_back(euclidean(store.row(central_node->id), store.row(graph.neighbors(central_node->id)[i]), store.dim));
     }
     
     // Check if distances are sorted and within the acceptable range
@@ -96,31 +112,40 @@ void test_robust_prune() {
 
 void test_robust_prune_with_filters() {
     // Create central node and neighbors with different filters
-    Node* central_node = create_node(10, {0.0, 0.0, 0.0});
-    central_node->filter = 1.0;
-
-    Node* node1 = create_node(1, {1.0, 0.0, 0.0});
-    node1->filter = 1.0;  // Same filter as central node
-    Node* node2 = create_node(2, {0.0, 1.0, 0.0});
-    node2->filter = 1.0;  // Same filter as central node
-    Node* node3 = create_node(3, {0.0, 0.0, 1.0});
-    node3->filter = 2.0;  // Different filter
-    Node* node4 = create_node(4, {2.0, 2.0, 2.0});
-    node4->filter = 3.0;  // Different filter
-
-    vector<Node*> possible_neighbours = { node1, node2, node3, node4 };
+    VectorStore store(11, 3);
+    DirectedGraph graph(store.count, 4);
+    Node* central_node = create_node(store, 10, {0.0, 0.0, 0.0});
+    central_node->label = 1;
+
+    Node* node1 = create_node(store, 1, {1.0, 0.0, 0.0});
+    node1->label = 1;  // Same filter as central node
+    Node* node2 = create_node(store, 2, {0.0, 1.0, 0.0});
+    node2->label = 1;  // Same filter as central node
+    Node* node3 = create_node(store, 3, {0.0, 0.0, 1.0});
+    node3->label = 2;  // Different filter
+    Node* node4 = create_node(store, 4, {2.0, 2.0, 2.0});
+    node4->label = 3;  // Different filter
+
+    vector<Node*> nodes(store.count, nullptr);
+    nodes[10] = central_node;
+    nodes[1] = node1;
+    nodes[2] = node2;
+    nodes[3] = node3;
+    nodes[4] = node4;
+
+    vector<unsigned int> possible_neighbours = { node1->id, node2->id, node3->id, node4->id };
 
     // Define parameters
     int max_neighbours = 2;
     float a = 1.5;
 
     // Run RobustPrune
-    RobustPrune(central_node, possible_neighbours, a, max_neighbours);
+    RobustPrune(store, graph, central_node->id, possible_neighbours, a, max_neighbours);
 
     // Check if only nodes with matching filters were selected
-    TEST_CHECK(central_node->out_neighbors.size() <= static_cast<size_t>(max_neighbours));
-    for (Node* neighbor : central_node->out_neighbors) {
-        TEST_CHECK(neighbor->filter == central_node->filter);
+    TEST_CHECK(graph.degree(central_node->id) <= static_cast<size_t>(max_neighbours));
+    for (uint32_t i = 0; i < graph.degree(central_node->id); i++) {
+        TEST_CHECK(nodes[graph.neighbors(central_node->id)[i]]->label == central_node->label);
     }
 
     delete central_node;
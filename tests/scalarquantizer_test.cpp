@@ -0,0 +1,175 @@
+#include "../include/acutest.h"
+#include "../include/vamana.h"
+
+// 1000 points of 20 dimensions, uniform in [0, 100)
+static VectorStore randomStore(size_t count, size_t dim, unsigned int seed) {
+    VectorStore store(count, dim);
+    mt19937 gen(seed);
+    uniform_real_distribution<float> value(0.0, 100.0);
+    for (size_t i = 0; i < count; i++) {
+        for (size_t d = 0; d < dim; d++) {
+            store.row(i)[d] = value(gen);
+        }
+    }
+    return store;
+}
+
+// Test that half floats round trip exactly, subnormals and the largest half included,
+// and that the other floats are rounded to the nearest half
+void test_fp16() {
+    vector<float> values = {0.0f, -0.0f, 1.0f, -2.5f, 65504.0f, 6.103515625e-05f, 5.9604644775390625e-08f, 3.0517578125e-05f, 1.0f / 3.0f, 1000.1f};
+    VectorStore store(1, values.size());
+    copy(values.begin(), values.end(), store.row(0));
+
+    ScalarQuantizedStore codes(store, PRECISION_FP16);
+    TEST_CHECK(codes.row_bytes % 64 == 0);
+    vector<float> decoded(values.size());
+    codes.decode(0, decoded.data());
+    for (size_t d = 0; d < 8; d++) {
+        TEST_CHECK(decoded[d] == values[d]);
+        TEST_MSG("%zu: %g instead of %g", d, decoded[d], values[d]);
+    }
+    TEST_CHECK(fabs(decoded[8] - values[8]) <= values[8] / 2048);
+    TEST_CHECK(fabs(decoded[9] - values[9]) <= values[9] / 2048);
+}
+
+// Test that every SQ8 value is within half a step of its dimension from the float it encodes
+void test_sq8() {
+    VectorStore store = randomStore(1000, 20, 1);
+    ScalarQuantizedStore codes(store, PRECISION_SQ8);
+
+    vector<float> decoded(store.dim);
+    for (unsigned int i = 0; i < store.count; i++) {
+        codes.decode(i, decoded.data());
+        for (size_t d = 0; d < store.dim; d++) {
+            TEST_CHECK(fabs(decoded[d] - store.row(i)[d]) <= codes.scale[d] / 2 + 1e-4f);
+        }
+    }
+
+    // A dimension with one value has no range and decodes to that value
+    VectorStore flat(3, 2);
+    for (unsigned int i = 0; i < 3; i++) {
+        flat.row(i)[0] = 7.0f;
+        flat.row(i)[1] = i;
+    }
+    ScalarQuantizedStore flat_codes(flat, PRECISION_SQ8);
+    flat_codes.decode(2, decoded.data());
+    TEST_CHECK(decoded[0] == 7.0f);
+    TEST_CHECK(decoded[1] == 2.0f);
+    TEST_CHECK(flat_codes.distance(0u, 2u) == 4.0f);
+}
+
+// Test that the SIMD kernels give the distances of the plain loops, also for dimensions that
+// are not a multiple of 8, and that they are close to the exact ones
+void test_kernels() {
+    for (size_t dim : {5, 16, 21}) {
+        VectorStore store = randomStore(50, dim, dim);
+        for (ScalarPrecision precision : {PRECISION_FP16, PRECISION_SQ8}) {
+            ScalarQuantizedStore simd(store, precision), plain(store, precision, false);
+            for (unsigned int i = 0; i < store.count; i++) {
+                const float* x_q = store.row((i * 7) % store.count);
+                float exact = euclidean(store, store.row(i), x_q);
+                float to_query = plain.distance(x_q, i);
+                TEST_CHECK(fabs(simd.distance(x_q, i) - to_query) <= 1e-3f * (1.0f + to_query));
+                float between = plain.distance(i, (i * 7) % store.count);
+                TEST_CHECK(fabs(simd.distance(i, (i * 7) % store.count) - between) <= 1e-3f * (1.0f + between));
+                TEST_CHECK(fabs(to_query - exact) <= 0.02f * exact + 1.0f);
+            }
+        }
+    }
+}
+
+// The k closest rows to x_q, of every label when label < 0, by scanning them all
+static vector<unsigned int> bruteForce(const VectorStore& store, const vector<Node*>& nodes, const float* x_q, unsigned int k, int label) {
+    vector<pair<float, unsigned int>> distances;
+    for (Node* node : nodes) {
+        if (label < 0 || node->label == static_cast<uint32_t>(label)) {
+            distances.emplace_back(euclidean(store, store.row(node->id), x_q), node->id);
+        }
+    }
+    partial_sort(distances.begin(), distances.begin() + k, distances.end());
+    vector<unsigned int> closest;
+    for (unsigned int i = 0; i < k; i++) {
+        closest.push_back(distances[i].second);
+    }
+    return closest;
+}
+
+static size_t countFound(const vector<unsigned int>& result, const vector<unsigned int>& truth) {
+    return count_if(result.begin(), result.end(), [&](unsigned int id) { return find(truth.begin(), truth.end(), id) != truth.end(); });
+}
+
+// Test that graphs built and searched on the codes find about as many of the true neighbors as
+// the graph built and searched on the floats, that the filtered searches on the codes find about as
+// many as on the floats, and that the builds keep the degree bound
+void test_search() {
+    VectorStore store = randomStore(1000, 20, 2);
+    vector<Node*> nodes;
+    for (unsigned int i = 0; i < store.count; i++) {
+        nodes.push_back(new Node{i, i % 2});
+    }
+    const unsigned int k = 10, L = 50, R = 16, queries = 50;
+
+    DirectedGraph exact_graph(store.count, R);
+    VamanaIndexingAlgorithm(store, exact_graph, nodes, k, L, R, 1.2, nodes.size(), 2);
+    unsigned int s = datasetMedoid(store, nodes);
+    vector<unsigned int> start_nodes = {s, s ^ 1u};  // one node of each label
+    LabelIndex labels(nodes);
+
+    size_t exact_found = 0;
+    for (unsigned int q = 0; q < queries; q++) {
+        const float* x_q = store.row(q * 13);
+        exact_found += countFound(GreedySearch(store, exact_graph, s, x_q, k, L), bruteForce(store, nodes, x_q, k, -1));
+    }
+
+    for (ScalarPrecision precision : {PRECISION_FP16, PRECISION_SQ8}) {
+        ScalarQuantizedStore codes(store, precision);
+        for (unsigned int num_threads : {1u, 3u}) {
+            DirectedGraph graph(store.count, R);
+            VamanaIndexingAlgorithm(codes, graph, nodes, L, R, 1.2, s, num_threads);
+            for (unsigned int i = 0; i < graph.size(); i++) {
+                TEST_CHECK(graph.degree(i) > 0 && graph.degree(i) <= R);
+            }
+
+            SearchScratch scratch;
+            size_t found = 0, found_reranked = 0, found_filtered = 0, float_found_filtered = 0;
+            for (unsigned int q = 0; q < queries; q++) {
+                const float* x_q = store.row(q * 13);
+                vector<unsigned int> truth = bruteForce(store, nodes, x_q, k, -1);
+
+                vector<unsigned int> result = GreedySearch(codes, graph, {s}, x_q, k, L, scratch);
+                TEST_CHECK(result.size() == k);
+                found += countFound(result, truth);
+                found_reranked += countFound(GreedySearch(codes, graph, {s}, x_q, k, L, scratch, &store), truth);
+
+                vector<unsigned int> filtered = FilteredGreedySearch(codes, graph, labels, start_nodes, x_q, k, L, q % 2, scratch, &store);
+                for (unsigned int id : filtered) {
+                    TEST_CHECK(nodes[id]->label == q % 2);
+                }
+                vector<unsigned int> truth_filtered = bruteForce(store, nodes, x_q, k, q % 2);
+                found_filtered += countFound(filtered, truth_filtered);
+                float_found_filtered += countFound(FilteredGreedySearch(store, graph, labels, start_nodes, x_q, k, L, q % 2), truth_filtered);
+            }
+
+            TEST_CHECK(found >= 0.9 * exact_found);
+            TEST_MSG("Found %zu, the float graph %zu", found, exact_found);
+            TEST_CHECK(found_reranked >= 0.9 * exact_found && found_reranked >= found - 5);
+            TEST_MSG("Found %zu after the re-rank, the float graph %zu", found_reranked, exact_found);
+            // The same graph walked on the floats
+            TEST_CHECK(found_filtered >= 0.95 * float_found_filtered);
+            TEST_MSG("Found %zu with the filter, on the floats %zu", found_filtered, float_found_filtered);
+        }
+    }
+
+    for (Node* node : nodes) delete node;
+}
+
+
+TEST_LIST = {
+    {"test_fp16", test_fp16},
+    {"test_sq8", test_sq8},
+    {"test_kernels", test_kernels},
+    {"test_search", test_search},
+
+    {NULL, NULL} // Terminate the list
+};
@@ -2,36 +2,44 @@
 
 #include "../include/vamana.h"
 
-// Helper function to create a Node with specified coordinates
-Node* create_node(unsigned int id, const vector<float>& coords) {
+// Helper function to create a Node and store its coordinates in row `id` of the store
+Node* create_node(VectorStore& store, unsigned int id, const vector<float>& coords) {
     Node* node = new Node();
     node->id = id;
-    node->coords = coords;
+    copy(coords.begin(), coords.end(), store.row(id));
     return node;
 }
 
 void test_node_add_get_neighbour() {
-    Node* node1 = create_node(1, {1.0, 1.0, 1.0});
-    Node* node2 = create_node(2, {2.0, 2.0, 2.0});
-    node1->out_neighbors.push_back(node2);
+    VectorStore store(3, 3);
+    DirectedGraph graph(store.count, 2);
+    Node* node1 = create_node(store, 1, {1.0, 1.0, 1.0});
+    Node* node2 = create_node(store, 2, {2.0, 2.0, 2.0});
+    graph.addNeighbor(node1->id, node2->id);
 
-    TEST_CHECK(node1->out_neighbors.size() == 1);
-    TEST_CHECK(node1->out_neighbors.at(0)->coords == node2->coords);
+    TEST_CHECK(graph.degree(node1->id) == 1);
+    TEST_CHECK(graph.neighbors(node1->id)[0] == node2->id);
+    TEST_CHECK(store.row(graph.neighbors(node1->id)[0])[0] == 2.0);
 
     delete node1;
     delete node2;
 }
 
 void test_compare_func_for_nodes() {
-    Node* reference_node = create_node(0, {0.0, 0.0});
-    Node* node1 = create_node(1, {1.0, 1.0});
-    Node* node2 = create_node(2, {2.0, 2.0});
+    VectorStore store(3, 2);
+    Node* reference_node = create_node(store, 0, {0.0, 0.0});
+    Node* node1 = create_node(store, 1, {1.0, 1.0});
+    Node* node2 = create_node(store, 2, {2.0, 2.0});
 
-    node1->distance = euclidean(reference_node, node1);
-    node2->distance = euclidean(reference_node, node2);
+    pair<float, unsigned int> distance1 = {euclidean(store, reference_node, node1), node1->id};
+    pair<float, unsigned int> distance2 = {euclidean(store, reference_node, node2), node2->id};
 
-    bool d = compare_distance(node1, node2);
+    bool d = compare_distance(distance1, distance2);
     TEST_CHECK(d == true);
+    TEST_CHECK(!compare_distance(distance2, distance1));
+
+    // Equal distances are ordered by id
+    TEST_CHECK(compare_distance({1.0, 1}, {1.0, 2}));
 
     delete reference_node;
     delete node1;
@@ -46,6 +54,7 @@ void testStitchedVamana() {
 
     // Generate 100 nodes with random coordinates
     const int num_nodes = 100;
+    VectorStore store(num_nodes, 3);
     vector<Node*> nodes;
     srand(static_cast<unsigned>(time(0)));
 
@@ -53,16 +62,17 @@ void testStitchedVamana() {
         vector<float> coords = {static_cast<float>(rand() % 100) / 10.0f,
                                 static_cast<float>(rand() % 100) / 10.0f,
                                 static_cast<float>(rand() % 100) / 10.0f};
-        Node* node = create_node(i, coords);
-        node->filter = static_cast<float>(rand() % 3 + 1);
+        Node* node = create_node(store, i, coords);
+        node->label = rand() % 3;
         nodes.push_back(node);
     }
 
     cout << "Generated " << num_nodes << " nodes with random positions and filters." << endl;
 
     // Run the Stitched Vamana algorithm
+    DirectedGraph graph;
     try {
-        StitchedVamana(nodes, alpha, L_small, R_small, R_stitched);
+        graph = StitchedVamana(store, nodes, alpha, L_small, R_small, R_stitched);
     } catch (const std::exception& e) {
         cerr << "Error during StitchedVamana execution: " << e.what() << endl;
         assert(false);
@@ -70,9 +80,9 @@ void testStitchedVamana() {
 
     // Verify properties of the final graph
     for (Node* n : nodes) {
-        TEST_CHECK(n->out_neighbors.size() <= static_cast<size_t>(R_stitched));
-        for (Node* neighbor : n->out_neighbors) {
-            TEST_CHECK(n->filter == neighbor->filter);
+        TEST_CHECK(graph.degree(n->id) <= static_cast<size_t>(R_stitched));
+        for (uint32_t i = 0; i < graph.degree(n->id); i++) {
+            TEST_CHECK(n->label == nodes[graph.neighbors(n->id)[i]]->label);
         }
     }
 
@@ -80,42 +90,45 @@ void testStitchedVamana() {
 
     // Cleanup
     for (Node* n : nodes) {
-        n->out_neighbors.clear(); // Avoid dangling references
         delete n;
     }
 }
 
 // Test with a single node
 void testStitchedVamana_single_node() {
+    VectorStore store(1, 3);
     vector<Node*> nodes;
-    Node* node = create_node(0, {1.0, 1.0, 1.0});
-    node->filter = 1.0;
+    Node* node = create_node(store, 0, {1.0, 1.0, 1.0});
+    node->label = 0;
     nodes.push_back(node);
 
-    StitchedVamana(nodes, 1.2f, 5, 5, 5);
+    DirectedGraph graph = StitchedVamana(store, nodes, 1.2f, 5, 5, 5);
 
-    TEST_CHECK(node->out_neighbors.empty()); // Single node should have no neighbors
+    TEST_CHECK(graph.degree(node->id) == 0); // Single node should have no neighbors
 
     delete node;
 }
 
 // Test with multiple filters and no possible connections
 void testStitchedVamana_no_connections() {
+    VectorStore store(10, 3);
     vector<Node*> nodes;
 
     // Create nodes with disjoint filters
     for (int i = 0; i < 10; ++i) {
-        Node* node = create_node(i, {static_cast<float>(i), static_cast<float>(i + 1), static_cast<float>(i + 2)});
-        node->filter = static_cast<float>(i + 1); // Unique filter for each node
+        Node* node = create_node(store, i, {static_cast<float>(i), static_cast<float>(i + 1), static_cast<float>(i + 2)});
+        node->label = i; // Unique label for each node
         nodes.push_back(node);
     }
 
-    StitchedVamana(nodes, 1.2f, 5, 5, 5);
+    DirectedGraph graph = StitchedVamana(store, nodes, 1.2f, 5, 5, 5);
 
     for (Node*n : nodes) {
-        for (Node* neighbor : n->out_neighbors) {
-            TEST_CHECK(n->filter != neighbor->filter); // Ensure connections are between different filters
+        for (uint32_t i = 0; i < graph.degree(n->id); i++) {
+            TEST_CHECK(n->label != nodes[graph.neighbors(n->id)[i]]->label); // Ensure connections are between different filters
         }
+    }
+    for (Node*n : nodes) {
         delete n;
     }
 }
@@ -123,6 +136,7 @@ void testStitchedVamana_no_connections() {
 // Test with large number of filters
 void testStitchedVamana_large_filters() {
     const int num_nodes = 1000;
+    VectorStore store(num_nodes, 3);
     vector<Node*> nodes;
 
     // Generate nodes with random filters
@@ -130,16 +144,93 @@ void testStitchedVamana_large_filters() {
         vector<float> coords = {static_cast<float>(rand() % 100) / 10.0f,
                                 static_cast<float>(rand() % 100) / 10.0f,
                                 static_cast<float>(rand() % 100) / 10.0f};
-        Node* node = create_node(i, coords);
-        node->filter = static_cast<float>(rand() % 50 + 1); // 50 unique filters
+        Node* node = create_node(store, i, coords);
+        node->label = rand() % 50; // 50 unique labels
         nodes.push_back(node);
     }
 
-    StitchedVamana(nodes, 1.5f, 20, 15, 10);
+    DirectedGraph graph = StitchedVamana(store, nodes, 1.5f, 20, 15, 10);
 
     // Verify the graph is within constraints
     for (Node* n : nodes) {
-        TEST_CHECK(n->out_neighbors.size() <= 10); // R_stitched limit
+        TEST_CHECK(graph.degree(n->id) <= 10); // R_stitched limit
+        delete n;
+    }
+}
+
+
+// The labels built on several threads: one label large enough for intra-label threads, the rest one per thread
+void testStitchedVamana_parallel() {
+    const int num_nodes = 600;
+    VectorStore store(num_nodes, 3);
+    vector<Node*> nodes;
+
+    for (int i = 0; i < num_nodes; ++i) {
+        vector<float> coords = {static_cast<float>(rand() % 100) / 10.0f,
+                                static_cast<float>(rand() % 100) / 10.0f,
+                                static_cast<float>(rand() % 100) / 10.0f};
+        Node* node = create_node(store, i, coords);
+        node->label = i < 300 ? 0 : 1 + rand() % 10;
+        nodes.push_back(node);
+    }
+
+    DirectedGraph graph = StitchedVamana(store, nodes, 1.2f, 20, 12, 10, 4);
+
+    for (Node* n : nodes) {
+        TEST_CHECK(graph.degree(n->id) <= 10);
+        TEST_CHECK(graph.degree(n->id) > 0);
+        for (uint32_t i = 0; i < graph.degree(n->id); i++) {
+            TEST_CHECK(n->label == nodes[graph.neighbors(n->id)[i]]->label);
+        }
+    }
+
+    for (Node* n : nodes) {
+        delete n;
+    }
+}
+
+
+// Nodes with one or two labels. Every label is built on its own rows, so a node with one label only
+// ever links to nodes that have its label, and a node with two labels keeps neighbors of both.
+void testStitchedVamana_multi_label() {
+    const int num_nodes = 600;
+    VectorStore store(num_nodes, 3);
+    vector<Node*> nodes;
+    vector<vector<uint32_t>> node_labels(num_nodes);
+
+    for (int i = 0; i < num_nodes; ++i) {
+        vector<float> coords = {static_cast<float>(rand() % 100) / 10.0f,
+                                static_cast<float>(rand() % 100) / 10.0f,
+                                static_cast<float>(rand() % 100) / 10.0f};
+        nodes.push_back(create_node(store, i, coords));
+        node_labels[i] = {static_cast<uint32_t>(i % 3)};
+        if (i % 4 == 0) {
+            node_labels[i].push_back(3);
+        }
+    }
+    LabelIndex labels(node_labels);
+
+    DirectedGraph graph = StitchedVamana(store, nodes, labels, 1.2f, 20, 12, 16, 2);
+
+    size_t both = 0;
+    for (Node* n : nodes) {
+        TEST_CHECK(graph.degree(n->id) <= 16);
+        TEST_CHECK(graph.degree(n->id) > 0);
+        bool own = false, shared = false;
+        for (uint32_t i = 0; i < graph.degree(n->id); i++) {
+            unsigned int neighbor = graph.neighbors(n->id)[i];
+            TEST_CHECK(labels.has(neighbor, n->id % 3) || labels.has(n->id, 3));
+            own = own || labels.has(neighbor, n->id % 3);
+            shared = shared || labels.has(neighbor, 3);
+        }
+        both += own && shared;
+    }
+
+    // The nodes of label 3 are the only ones that can take edges of two labels
+    TEST_CHECK(both >= num_nodes / 4 * 0.9);
+    TEST_MSG("%zu nodes with neighbors of both labels", both);
+
+    for (Node* n : nodes) {
         delete n;
     }
 }
@@ -153,6 +244,8 @@ TEST_LIST = {
     {"testStitchedVamana_single_node", testStitchedVamana_single_node},
     {"testStitchedVamana_no_connections", testStitchedVamana_no_connections},
     {"testStitchedVamana_large_filters", testStitchedVamana_large_filters},
+    {"testStitchedVamana_parallel", testStitchedVamana_parallel},
+    {"testStitchedVamana_multi_label", testStitchedVamana_multi_label},
 
     {NULL, NULL} // Terminate the list
 };
\ No newline at end of file
@@ -2,36 +2,44 @@
 
 #include "../include/vamana.h"
 
-// Helper function to create a Node with specified coordinates
-Node* create_node(unsigned int id, const vector<float>& coords) {
+// Helper function to create a Node and store its coordinates in row `id` of the store
+Node* create_node(VectorStore& store, unsigned int id, const vector<float>& coords) {
     Node* node = new Node();
     node->id = id;
-    node->coords = coords;
+    copy(coords.begin(), coords.end(), store.row(id));
     return node;
 }
 
 void test_node_add_get_neighbour() {
-    Node* node1 = create_node(1, {1.0, 1.0, 1.0});
-    Node* node2 = create_node(2, {2.0, 2.0, 2.0});
-    node1->out_neighbors.push_back(node2);
+    VectorStore store(3, 3);
+    DirectedGraph graph(store.count, 2);
+    Node* node1 = create_node(store, 1, {1.0, 1.0, 1.0});
+    Node* node2 = create_node(store, 2, {2.0, 2.0, 2.0});
+    graph.addNeighbor(node1->id, node2->id);
 
-    TEST_CHECK(node1->out_neighbors.size() == 1);
-    TEST_CHECK(node1->out_neighbors.at(0)->coords == node2->coords);
+    TEST_CHECK(graph.degree(node1->id) == 1);
+    TEST_CHECK(graph.neighbors(node1->id)[0] == node2->id);
+    TEST_CHECK(store.row(graph.neighbors(node1->id)[0])[0] == 2.0);
 
     delete node1;
     delete node2;
 }
 
 void test_compare_func_for_nodes() {
-    Node* reference_node = create_node(0, {0.0, 0.0});
-    Node* node1 = create_node(1, {1.0, 1.0});
-    Node* node2 = create_node(2, {2.0, 2.0});
+    VectorStore store(3, 2);
+    Node* reference_node = create_node(store, 0, {0.0, 0.0});
+    Node* node1 = create_node(store, 1, {1.0, 1.0});
+    Node* node2 = create_node(store, 2, {2.0, 2.0});
 
-    node1->distance = euclidean(reference_node, node1);
-    node2->distance = euclidean(reference_node, node2);
+    pair<float, unsigned int> distance1 = {euclidean(store, reference_node, node1), node1->id};
+    pair<float, unsigned int> distance2 = {euclidean(store, reference_node, node2), node2->id};
 
-    bool d = compare_distance(node1, node2);
+    bool d = compare_distance(distance1, distance2);
     TEST_CHECK(d == true);
+    TEST_CHECK(!compare_distance(distance2, distance1));
+
+    // Equal distances are ordered by id
+    TEST_CHECK(compare_distance({1.0, 1}, {1.0, 2}));
 
     delete reference_node;
     delete node1;
@@ -46,6 +54,7 @@ void testStitchedVamana() {
 
     // Generate 100 nodes with random coordinates
     const int num_nodes = 100;
+    VectorStore store(num_nodes, 3);
     vector<Node*> nodes;
     srand(static_cast<unsigned>(time(0)));
 
@@ -53,16 +62,17 @@ void testStitchedVamana() {
         vector<float> coords = {static_cast<float>(rand() % 100) / 10.0f,
                                 static_cast<float>(rand() % 100) / 10.0f,
                                 static_cast<float>(rand() % 100) / 10.0f};
-        Node* node = create_node(i, coords);
-        node->filter = static_cast<float>(rand() % 3 + 1);
+        Node* node = create_node(store, i, coords);
+        node->label = rand() % 3;
         nodes.push_back(node);
     }
 
     cout << "Generated " << num_nodes << " nodes with random positions and filters." << endl;
 
     // Run the Stitched Vamana algorithm
+    DirectedGraph graph;
     try {
-        StitchedVamana(nodes, alpha, L_small, R_small, R_stitched);
+        graph = StitchedVamana(store, nodes, alpha, L_small, R_small, R_stitched);
     } catch (const std::exception& e) {
         cerr << "Error during StitchedVamana execution: " << e.what() << endl;
         assert(false);
@@ -70,9 +80,9 @@ void testStitchedVamana() {
 
     // Verify properties of the final graph
     for (Node* n : nodes) {
-        TEST_CHECK(n->out_neighbors.size() <= static_cast<size_t>(R_stitched));
-        for (Node* neighbor : n->out_neighbors) {
-            TEST_CHECK(n->filter == neighbor->filter);
+        TEST_CHECK(graph.degree(n->id) <= static_cast<size_t>(R_stitched));
+        for (uint32_t i = 0; i < graph.degree(n->id); i++) {
+            TEST_CHECK(n->label == nodes[graph.neighbors(n->id)[i]]->label);
         }
     }
 
@@ -80,7 +90,6 @@ void testStitchedVamana() {
 
     // Cleanup
     for (Node* n : nodes) {
-        n->out_neighbors.clear(); // Avoid dangling references
         delete n;
     }
 }
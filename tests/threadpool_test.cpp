@@ -0,0 +1,64 @@
+#include "../include/acutest.h"
+
+#include "../include/vamana.h"
+
+// Test that parallelFor calls the body exactly once for every index
+void test_parallel_for_covers_range() {
+    ThreadPool pool(4);
+
+    for (size_t grain : {1, 3, 64, 1000}) {
+        vector<atomic<int>> calls(1000);
+        pool.parallelFor(0, calls.size(), [&](size_t i) { calls[i]++; }, grain);
+
+        bool once = all_of(calls.begin(), calls.end(), [](const atomic<int>& c) { return c == 1; });
+        TEST_CHECK(once);
+        TEST_MSG("grain %zu", grain);
+    }
+
+    // An empty range does nothing
+    bool called = false;
+    pool.parallelFor(5, 5, [&](size_t) { called = true; });
+    TEST_CHECK(!called);
+}
+
+// Test that submitted tasks all run before the pool is destroyed
+void test_submit() {
+    atomic<int> count{0};
+    {
+        ThreadPool pool(3);
+        for (int i = 0; i < 100; i++) {
+            pool.submit([&]() { count++; });
+        }
+    }
+    TEST_CHECK(count == 100);
+}
+
+// Test that a parallelFor inside the tasks of another one finishes, even with every worker busy
+void test_nested_parallel_for() {
+    ThreadPool pool(2);
+    vector<long> sums(8, 0);
+
+    pool.parallelFor(0, sums.size(), [&](size_t i) {
+        vector<long> values(100, 0);
+        pool.parallelFor(0, values.size(), [&](size_t j) { values[j] = j; }, 10);
+        sums[i] = accumulate(values.begin(), values.end(), 0L);
+    });
+
+    TEST_CHECK(all_of(sums.begin(), sums.end(), [](long sum) { return sum == 4950; }));
+}
+
+// Test that the shared pool exists and has at least one worker
+void test_instance() {
+    TEST_CHECK(&ThreadPool::instance() == &ThreadPool::instance());
+    TEST_CHECK(ThreadPool::instance().size() >= 1);
+}
+
+
+TEST_LIST = {
+    {"test_parallel_for_covers_range", test_parallel_for_covers_range},
+    {"test_submit", test_submit},
+    {"test_nested_parallel_for", test_nested_parallel_for},
+    {"test_instance", test_instance},
+
+    {NULL, NULL} // Terminate the list
+};
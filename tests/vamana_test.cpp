@@ -1,10 +1,10 @@
 #include "../include/acutest.h"
 #include "../include/vamana.h"
 
-Node* create_node(unsigned int id, const vector<float>& coords) {
+Node* create_node(VectorStore& store, unsigned int id, const vector<float>& coords) {
     Node* node = new Node();
     node->id = id;
-    node->coords = coords;
+    copy(coords.begin(), coords.end(), store.row(id));
     
     return node;
 }
@@ -12,27 +12,27 @@ Node* create_node(unsigned int id, const vector<float>& coords) {
 
 // Basic Vamana Indexing Functionality
 void test_vamana_basic_functionality() {
+    VectorStore store(4, 2);
     vector<Node*> nodes={
-    create_node(0, {0.0, 0.0}),
-    create_node(1, {1.0, 1.0}),
-    create_node(2, {2.0, 2.0}),
-    create_node(3, {3.0, 3.0})
+    create_node(store, 0, {0.0, 0.0}),
+    create_node(store, 1, {1.0, 1.0}),
+    create_node(store, 2, {2.0, 2.0}),
+    create_node(store, 3, {3.0, 3.0})
     };
 
-    // for(int i=0;i<4;i++){
-    //     cout << "Node ID: " << (nodes[i] ? nodes[i]->id : -1) << " | Possible neighbors count: " << nodes[i]->out_neighbors.size() << std::endl;}
     
     unsigned int k = 1, L = 2, R = 2;
     float a = 1.5;
     // int n = nodes.size();
     int medoidCase = 2;
 
-    VamanaIndexingAlgorithm(nodes, k, L, R, a, medoidCase, 2);
+    DirectedGraph graph(store.count, R);
+    VamanaIndexingAlgorithm(store, graph, nodes, k, L, R, a, medoidCase, 2);
     
     // Check if each node has at most R neighbors
     for (Node* node : nodes) {
-        TEST_CHECK(node->out_neighbors.size() <= R);
-        //cout << "Node ID: " << node->id << " | Out neighbors: " << node->out_neighbors.size() << std::endl;
+        TEST_CHECK(graph.degree(node->id) <= R);
+        //cout << "Node ID: " << node->id << " | Out neighbors: " << graph.degree(node->id) << std::endl;
     }
 
     for (Node* node : nodes) delete node;
@@ -40,25 +40,25 @@ void test_vamana_basic_functionality() {
 
 // Small Dataset
 void test_vamana_small_dataset() {
+    VectorStore store(2, 2);
     vector<Node*> nodes={
-    create_node(0, {0.0, 0.0}),
-    create_node(1, {1.0, 1.0})
+    create_node(store, 0, {0.0, 0.0}),
+    create_node(store, 1, {1.0, 1.0})
     };
 
-    // for(int i=0;i<2;i++){
-    //     cout << "Node ID: " << (nodes[i] ? nodes[i]->id : -1) << " | Possible neighbors count: " << nodes[i]->out_neighbors.size() << std::endl;}
 
     unsigned int k = 1, L = 1, R = 1;
     float a = 1.5;
     int n = nodes.size();
     int medoidCase = 1;
 
-    VamanaIndexingAlgorithm(nodes, k, L, R, a, n, medoidCase, 1);
+    DirectedGraph graph(store.count, R);
+    VamanaIndexingAlgorithm(store, graph, nodes, k, L, R, a, n, medoidCase, 1);
 
     // Verify that each node is connected within the small dataset limit
     for (Node* node : nodes) {
-        TEST_CHECK(node->out_neighbors.size() <= R);
-        //cout << "Node ID: " << node->id << " | Out neighbors: " << node->out_neighbors.size() << std::endl;
+        TEST_CHECK(graph.degree(node->id) <= R);
+        //cout << "Node ID: " << node->id << " | Out neighbors: " << graph.degree(node->id) << std::endl;
     }
     
     for (Node* node : nodes) delete node;
@@ -76,17 +76,19 @@ void test_initializeRandomGraph() {
         nodes.push_back(&node_storing[i]);
     }
     
-    initializeRandomGraph(nodes, R);
+    DirectedGraph graph(num_nodes, R);
+    initializeRandomGraph(graph, nodes, R);
     
     // Test: Each node has exactly R neighbors, no duplicates and not itself
     for (Node* node : nodes) {
-        TEST_CHECK(node->out_neighbors.size() == R);
+        TEST_CHECK(graph.degree(node->id) == R);
 
         unordered_set<int> unique_neighbors;
-        for (Node* neighbor : node->out_neighbors) {
-            TEST_CHECK(neighbor->id != node->id);
-            TEST_CHECK(unique_neighbors.find(neighbor->id) == unique_neighbors.end());
-            unique_neighbors.insert(neighbor->id);
+        for (uint32_t i = 0; i < graph.degree(node->id); i++) {
+            unsigned int neighbor = graph.neighbors(node->id)[i];
+            TEST_CHECK(neighbor != node->id);
+            TEST_CHECK(unique_neighbors.find(neighbor) == unique_neighbors.end());
+            unique_neighbors.insert(neighbor);
         }
     }
     
@@ -95,9 +97,10 @@ void test_initializeRandomGraph() {
 //Large Dataset 
 void test_vamana_large_dataset() {
     const int num_nodes = 100;
+    VectorStore store(num_nodes, 2);
     vector<Node*> nodes;
     for (int i = 0; i < num_nodes; ++i) {
-        nodes.push_back(create_node(i, {static_cast<float>(i), static_cast<float>(i)}));
+        nodes.push_back(create_node(store, i, {static_cast<float>(i), static_cast<float>(i)}));
     }
 
     unsigned int k = 1, L = 10, R = 5;
@@ -105,21 +108,76 @@ void test_vamana_large_dataset() {
     int n = nodes.size();
     int medoidCase = 0;
 
-    VamanaIndexingAlgorithm(nodes, k, L, R, a, n, medoidCase, 0);
+    DirectedGraph graph(store.count, R);
+    VamanaIndexingAlgorithm(store, graph, nodes, k, L, R, a, n, medoidCase, 0);
 
     // Verify that each node has at most R neighbors
     for (Node* node : nodes) {
-        TEST_CHECK(node->out_neighbors.size() <= R);
+        TEST_CHECK(graph.degree(node->id) <= R);
     }
 
     for (Node* node : nodes) delete node;
 }
 
+// Parallel build with several threads
+void test_vamana_parallel_build() {
+    const int num_nodes = 500;
+    VectorStore store(num_nodes, 2);
+    vector<Node*> nodes;
+    mt19937 gen(5);
+    uniform_real_distribution<float> dist(0.0, 100.0);
+    for (int i = 0; i < num_nodes; ++i) {
+        nodes.push_back(create_node(store, i, {dist(gen), dist(gen)}));
+    }
+
+    unsigned int k = 1, L = 20, R = 8;
+    float a = 1.2;
+    int n = nodes.size();
+
+    // Nodes that a search from node 0 finds exactly
+    auto found_nodes = [&](const DirectedGraph& graph) {
+        int found = 0;
+        for (Node* node : nodes) {
+            vector<unsigned int> result = GreedySearch(store, graph, 0, store.row(node->id), 1, L);
+            if (!result.empty() && euclidean(store, store.row(result[0]), store.row(node->id)) == 0.0) {
+                found++;
+            }
+        }
+        return found;
+    };
+
+    DirectedGraph sequential(store.count, R);
+    VamanaIndexingAlgorithm(store, sequential, nodes, k, L, R, a, n, 1, 50, 1);
+
+    DirectedGraph graph(store.count, R);
+    VamanaIndexingAlgorithm(store, graph, nodes, k, L, R, a, n, 1, 50, 4);
+
+    // Every node keeps between 1 and R distinct neighbors, none of them itself
+    for (Node* node : nodes) {
+        TEST_CHECK(graph.degree(node->id) >= 1 && graph.degree(node->id) <= R);
+
+        unordered_set<unsigned int> unique_neighbors;
+        for (uint32_t i = 0; i < graph.degree(node->id); i++) {
+            unsigned int neighbor = graph.neighbors(node->id)[i];
+            TEST_CHECK(neighbor != node->id);
+            TEST_CHECK(unique_neighbors.insert(neighbor).second);
+        }
+    }
+
+    // The parallel graph is about as searchable as the sequential one
+    int found_sequential = found_nodes(sequential);
+    int found_parallel = found_nodes(graph);
+    TEST_CHECK(found_parallel >= found_sequential - num_nodes / 10);
+    TEST_MSG("Found %d nodes in the parallel graph, %d in the sequential one", found_parallel, found_sequential);
+
+    for (Node* node : nodes) delete node;
+}
 
 TEST_LIST = {
     {"Vamana Basic Functionality", test_vamana_basic_functionality},
     {"Vamana Small Dataset", test_vamana_small_dataset},
     {"Initialize random graph", test_initializeRandomGraph},
     {"Vamana Large Dataset", test_vamana_large_dataset},
+    {"Vamana Parallel Build", test_vamana_parallel_build},
     {NULL, NULL} 
 };
\ No newline at end of file
@@ -0,0 +1,59 @@
+#include "../include/acutest.h"
+
+#include "../include/vamana.h"
+
+// Test inserting and looking up ids
+void test_insert_contains() {
+    VisitedSet visited;
+    visited.reset(10);
+
+    TEST_CHECK(!visited.contains(3));
+    TEST_CHECK(visited.insert(3));
+    TEST_CHECK(visited.contains(3));
+    TEST_CHECK(!visited.insert(3)); // Already in the set
+    TEST_CHECK(!visited.contains(4));
+}
+
+// Test that reset empties the set and makes room for more ids
+void test_reset() {
+    VisitedSet visited;
+    visited.reset(5);
+    visited.insert(1);
+    visited.insert(4);
+
+    visited.reset(20);
+    TEST_CHECK(!visited.contains(1));
+    TEST_CHECK(!visited.contains(4));
+    TEST_CHECK(!visited.contains(19));
+
+    visited.insert(19);
+    TEST_CHECK(visited.contains(19));
+}
+
+// Test that ids inserted before the epoch wraps around are not found after it
+void test_epoch_wraparound() {
+    VisitedSet visited;
+    visited.reset(3);
+    visited.insert(0);
+
+    // Run the epoch once around, up to the value it had when 0 was inserted
+    for (int i = 0; i < 65535; i++) {
+        visited.reset(3);
+        TEST_CHECK(!visited.contains(0));
+        visited.insert(1);
+    }
+
+    visited.reset(3);
+    TEST_CHECK(visited.epoch != 0);
+    TEST_CHECK(!visited.contains(0));
+    TEST_CHECK(!visited.contains(1));
+}
+
+
+TEST_LIST = {
+    {"test_insert_contains", test_insert_contains},
+    {"test_reset", test_reset},
+    {"test_epoch_wraparound", test_epoch_wraparound},
+
+    {NULL, NULL} // Terminate the list
+};